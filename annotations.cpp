@@ -0,0 +1,148 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "annotations.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+#include "gif.h"
+
+static const char *MEMORY_TYPE_NAMES[MEMTYPE_COUNT] = {
+	"none", "vec4", "int32x4", "int16x8", "giftag", "xyzf2"
+};
+
+const char *memory_type_name(MemoryType type)
+{
+	return type < MEMTYPE_COUNT ? MEMORY_TYPE_NAMES[type] : "";
+}
+
+bool parse_memory_type(MemoryType &type, const std::string &name)
+{
+	for(u8 i = 0; i < MEMTYPE_COUNT; i++) {
+		if(name == MEMORY_TYPE_NAMES[i]) {
+			type = (MemoryType) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string format_qword(MemoryType type, const u8 *qword)
+{
+	char buffer[256];
+	switch(type) {
+		case MEMTYPE_VEC4: {
+			float value[4];
+			memcpy(value, qword, 16);
+			snprintf(buffer, sizeof(buffer), "(%g, %g, %g, %g)", value[0], value[1], value[2], value[3]);
+			break;
+		}
+		case MEMTYPE_INT32X4: {
+			s32 value[4];
+			memcpy(value, qword, 16);
+			snprintf(buffer, sizeof(buffer), "%d %d %d %d", value[0], value[1], value[2], value[3]);
+			break;
+		}
+		case MEMTYPE_INT16X8: {
+			s16 value[8];
+			memcpy(value, qword, 16);
+			snprintf(buffer, sizeof(buffer), "%d %d %d %d %d %d %d %d",
+				value[0], value[1], value[2], value[3], value[4], value[5], value[6], value[7]);
+			break;
+		}
+		case MEMTYPE_GIF_TAG: {
+			u64 lo, hi;
+			memcpy(&lo, qword, 8);
+			memcpy(&hi, qword + 8, 8);
+			snprintf(buffer, sizeof(buffer), "NLOOP=%x EOP=%x PRE=%x PRIM=%x FLG=%s NREG=%x REGS=%016llx",
+				bit_range(lo, 0, 14), bit_range(lo, 15, 15), bit_range(lo, 46, 46), bit_range(lo, 47, 57),
+				gif_flag_name((GifFlag) bit_range(lo, 58, 59)), bit_range(lo, 60, 63), (unsigned long long) hi);
+			break;
+		}
+		case MEMTYPE_XYZF2: {
+			// X and Y are 12.4 fixed point.
+			u64 lo, hi;
+			memcpy(&lo, qword, 8);
+			memcpy(&hi, qword + 8, 8);
+			snprintf(buffer, sizeof(buffer), "X=%.4f Y=%.4f Z=%x F=%x ADC=%x",
+				bit_range(lo, 0, 15) / 16.f, bit_range(lo, 32, 47) / 16.f,
+				bit_range(hi, 4, 27), bit_range(hi, 36, 43), bit_range(hi, 47, 47));
+			break;
+		}
+		default: {
+			return "";
+		}
+	}
+	return buffer;
+}
+
+void MemoryAnnotations::set(u32 begin, u32 end, MemoryType type)
+{
+	begin &= ~15u;
+	end = std::min((end + 15) & ~15u, (u32) VU1_MEMSIZE);
+	if(begin >= end) {
+		return;
+	}
+	// Cut the new range out of the existing ones.
+	std::vector<MemoryAnnotation> result;
+	for(const MemoryAnnotation &range : ranges) {
+		if(range.end <= begin || range.begin >= end) {
+			result.push_back(range);
+			continue;
+		}
+		if(range.begin < begin) {
+			result.push_back({range.begin, begin, range.type});
+		}
+		if(range.end > end) {
+			result.push_back({end, range.end, range.type});
+		}
+	}
+	if(type != MEMTYPE_NONE) {
+		result.push_back({begin, end, type});
+	}
+	std::sort(result.begin(), result.end(), [](auto &l, auto &r) { return l.begin < r.begin; });
+	// Merge neighbouring ranges of the same type.
+	ranges.clear();
+	for(const MemoryAnnotation &range : result) {
+		if(!ranges.empty() && ranges.back().end == range.begin && ranges.back().type == range.type) {
+			ranges.back().end = range.end;
+		} else {
+			ranges.push_back(range);
+		}
+	}
+}
+
+MemoryType MemoryAnnotations::find(u32 address) const
+{
+	auto [begin, end] = find_range(address, address + 1);
+	return begin != end ? begin->type : MEMTYPE_NONE;
+}
+
+std::pair<const MemoryAnnotation*, const MemoryAnnotation*> MemoryAnnotations::find_range(u32 begin, u32 end) const
+{
+	// The first range that ends after begin, then every range after it that
+	// starts before end.
+	auto first = std::upper_bound(ranges.begin(), ranges.end(), begin, [](u32 address, const MemoryAnnotation &range) {
+		return address < range.end;
+	});
+	auto last = std::lower_bound(first, ranges.end(), end, [](const MemoryAnnotation &range, u32 address) {
+		return range.begin < address;
+	});
+	return {ranges.data() + (first - ranges.begin()), ranges.data() + (last - ranges.begin())};
+}
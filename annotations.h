@@ -0,0 +1,74 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANNOTATIONS_H
+#define ANNOTATIONS_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "pcsx2defs.h"
+
+// How a quadword of VU memory should be interpreted.
+enum MemoryType : u8
+{
+	MEMTYPE_NONE,
+	MEMTYPE_VEC4,    // Four floats.
+	MEMTYPE_INT32X4, // Four signed 32-bit integers.
+	MEMTYPE_INT16X8, // Eight signed 16-bit integers.
+	MEMTYPE_GIF_TAG,
+	MEMTYPE_XYZF2,   // A vertex position in the PACKED XYZF2 format.
+	MEMTYPE_COUNT
+};
+
+const char *memory_type_name(MemoryType type);
+bool parse_memory_type(MemoryType &type, const std::string &name);
+std::string format_qword(MemoryType type, const u8 *qword);
+
+// A range of memory [begin, end) in bytes, aligned to quadwords.
+struct MemoryAnnotation
+{
+	u32 begin;
+	u32 end;
+	MemoryType type;
+};
+
+// The types assigned to ranges of VU memory for a single program. The ranges
+// are kept sorted and don't overlap, since each quadword can only be shown
+// as one type, so lookups are a binary search. They're only edited by hand,
+// so it doesn't matter that inserting one is linear.
+class MemoryAnnotations
+{
+public:
+	// Assign a type to [begin, end) rounded out to quadwords, replacing the
+	// parts of any ranges it overlaps. MEMTYPE_NONE removes the annotations.
+	void set(u32 begin, u32 end, MemoryType type);
+	// Returns the type of the quadword at an address.
+	MemoryType find(u32 address) const;
+	// Returns the annotations overlapping [begin, end).
+	std::pair<const MemoryAnnotation*, const MemoryAnnotation*> find_range(u32 begin, u32 end) const;
+
+	const std::vector<MemoryAnnotation> &all() const { return ranges; }
+	bool empty() const { return ranges.empty(); }
+
+private:
+	std::vector<MemoryAnnotation> ranges;
+};
+
+#endif
@@ -0,0 +1,425 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Benchmarks for the parts of vutrace that get slow with big traces. Each
+// trace given on the command line is loaded the same way the GUI loads it,
+// and the results are written as JSON so runs can be compared over time.
+// vutrace-gen can be used to make traces of a known size.
+
+#include <chrono>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+#include "pcsx2defs.h"
+#include "pcsx2disassemble.h"
+#include "trace.h"
+#include "snapshotstore.h"
+#include "gif.h"
+#include "branches.h"
+#include "callstack.h"
+#include "profile.h"
+#include "session.h"
+
+struct LatencyResult
+{
+	std::size_t samples = 0;
+	double mean_us = 0;
+	double median_us = 0;
+	double max_us = 0;
+};
+
+struct TraceBenchResult
+{
+	std::string path;
+	std::size_t file_size = 0;
+	std::size_t snapshots = 0;
+	// Seconds spent in each step of loading a trace, as in parse_trace.
+	double read_seconds = 0;
+	double branches_seconds = 0;
+	double call_tree_seconds = 0;
+	double profile_seconds = 0;
+	double disassembly_seconds = 0;
+	double parse_seconds = 0;
+	LatencyResult walk_pc;
+	LatencyResult walk_mem;
+	LatencyResult random_access; // Decoding a snapshot from the store.
+	std::size_t resident_bytes = 0;
+	std::size_t spilled_bytes = 0;
+	double disassemble_per_second = 0;
+	std::size_t gs_packet_count = 0;
+	double gs_packets_per_second = 0;
+	std::size_t peak_rss = 0;
+	double rss_per_million_snapshots = 0;
+	std::string error;
+};
+
+using BenchClock = std::chrono::steady_clock;
+
+// Results are written here so the compiler can't optimise the work away.
+static volatile std::size_t bench_sink;
+
+bool bench_trace(TraceBenchResult &result, const std::string &path, int repeat, std::size_t budget, std::size_t baseline_rss);
+LatencyResult summarise_latencies(std::vector<double> &microseconds);
+double seconds_since(BenchClock::time_point start);
+std::size_t peak_rss_bytes();
+void write_bench_json(FILE *file, const std::string &label, const std::vector<TraceBenchResult> &results);
+void write_latency_json(FILE *file, const char *name, const LatencyResult &latency);
+std::string json_escape(const std::string &string);
+
+int main(int argc, char **argv)
+{
+	std::string json_path;
+	std::string label;
+	int repeat = 1;
+	std::size_t budget = SnapshotStore::DEFAULT_BUDGET;
+	std::vector<std::string> paths;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			json_path = argv[++i];
+		} else if(strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+			label = argv[++i];
+		} else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			repeat = std::max(1, atoi(argv[++i]));
+		} else if(strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+			budget = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+	if(paths.empty()) {
+		fprintf(stderr, "usage: %s [--json <output file>] [--label <name>] [--repeat <n>] [--budget <MB>] <trace files...>\n", argv[0]);
+		fprintf(stderr, "  --json    Write the results to a file instead of standard output.\n");
+		fprintf(stderr, "  --label   Stored in the results e.g. a version number or commit hash.\n");
+		fprintf(stderr, "  --repeat  Load each trace n times and report the fastest (default 1).\n");
+		fprintf(stderr, "  --budget  Memory budget for the snapshot store in MB, as set in the GUI.\n");
+		return 1;
+	}
+
+	// Peak memory usage only ever goes up, so traces are loaded from smallest
+	// to largest to make the peak for each one meaningful.
+	std::error_code error;
+	std::stable_sort(paths.begin(), paths.end(), [&](const std::string &l, const std::string &r) {
+		return std::filesystem::file_size(l, error) < std::filesystem::file_size(r, error);
+	});
+
+	std::size_t baseline_rss = peak_rss_bytes();
+	std::vector<TraceBenchResult> results;
+	int exit_code = 0;
+	for(const std::string &path : paths) {
+		fprintf(stderr, "Benchmarking %s...\n", path.c_str());
+		TraceBenchResult &result = results.emplace_back();
+		if(!bench_trace(result, path, repeat, budget, baseline_rss)) {
+			fprintf(stderr, "Error: %s\n", result.error.c_str());
+			exit_code = 1;
+		}
+	}
+
+	FILE *file = stdout;
+	if(!json_path.empty()) {
+		file = fopen(json_path.c_str(), "w");
+		if(file == nullptr) {
+			fprintf(stderr, "Error: Failed to open %s for writing.\n", json_path.c_str());
+			return 1;
+		}
+	}
+	write_bench_json(file, label, results);
+	if(file != stdout) {
+		fclose(file);
+	}
+	return exit_code;
+}
+
+bool bench_trace(TraceBenchResult &result, const std::string &path, int repeat, std::size_t budget, std::size_t baseline_rss)
+{
+	result.path = path;
+	std::error_code error;
+	result.file_size = std::filesystem::file_size(path, error);
+
+	// Parse the trace the same way parse_trace does, keeping the fastest run.
+	SnapshotStore snapshots;
+	snapshots.set_budget(budget);
+	const std::vector<u32> &pcs = snapshots.pcs();
+	result.parse_seconds = 1e30;
+	for(int i = 0; i < repeat; i++) {
+		BenchClock::time_point start = BenchClock::now();
+		if(!snapshots.load(path, result.error)) {
+			return false;
+		}
+		double read_seconds = seconds_since(start);
+		const u8 *program = snapshots.program();
+
+		BenchClock::time_point step = BenchClock::now();
+		BranchStatistics branches = compute_branch_statistics(pcs.data(), pcs.size());
+		double branches_seconds = seconds_since(step);
+
+		step = BenchClock::now();
+		CallTree call_tree = build_call_tree(pcs.data(), pcs.size(), program);
+		double call_tree_seconds = seconds_since(step);
+
+		step = BenchClock::now();
+		ProgramProfile profile;
+		accumulate_profile(profile, pcs.data(), pcs.size(), program);
+		ProfileReport report = build_profile_report(profile);
+		double profile_seconds = seconds_since(step);
+
+		step = BenchClock::now();
+		std::vector<std::string> disassembly;
+		for(u32 address = 0; address < VU1_PROGSIZE; address += INSN_PAIR_SIZE) {
+			disassembly.push_back(disassemble((u8*) &program[address], address));
+		}
+		double disassembly_seconds = seconds_since(step);
+
+		bench_sink = branches.times_executed[0] + call_tree.nodes.size() + report.blocks.size() + disassembly.size();
+		double total = seconds_since(start);
+		if(total < result.parse_seconds) {
+			result.parse_seconds = total;
+			result.read_seconds = read_seconds;
+			result.branches_seconds = branches_seconds;
+			result.call_tree_seconds = call_tree_seconds;
+			result.profile_seconds = profile_seconds;
+			result.disassembly_seconds = disassembly_seconds;
+		}
+	}
+	result.snapshots = snapshots.size();
+	result.resident_bytes = snapshots.resident_bytes();
+	result.spilled_bytes = snapshots.spilled_bytes();
+	result.peak_rss = peak_rss_bytes();
+	if(result.peak_rss > baseline_rss) {
+		result.rss_per_million_snapshots = (result.peak_rss - baseline_rss) * (1000000.0 / result.snapshots);
+	}
+
+	// Walk latency from evenly spaced starting points. The targets are taken
+	// from later in the trace, plus one that's never reached, which is the
+	// worst case since the whole rest of the trace has to be searched.
+	const std::size_t samples = 64;
+	std::vector<double> latencies;
+	for(std::size_t i = 0; i < samples; i++) {
+		bool unreachable = i == samples - 1;
+		std::size_t start = unreachable ? 0 : result.snapshots * i / samples;
+		std::size_t target = std::min(result.snapshots - 1, start + (result.snapshots - start) * (i % 8) / 8);
+		u32 target_pc = unreachable ? VU1_PROGSIZE : pcs[target];
+		std::size_t snapshot = start;
+		BenchClock::time_point begin = BenchClock::now();
+		bench_sink = find_pc(snapshots, snapshot, target_pc, 1) + snapshot;
+		latencies.push_back(seconds_since(begin) * 1e6);
+	}
+	result.walk_pc = summarise_latencies(latencies);
+
+	latencies.clear();
+	for(std::size_t i = 0; i < samples; i++) {
+		std::size_t start = result.snapshots * i / samples;
+		std::size_t target = std::min(result.snapshots - 1, start + (result.snapshots - start) * (i % 8) / 8);
+		u32 address = snapshots.write_size(target) > 0 ? snapshots.write_addr(target) : snapshots.read_addr(target);
+		std::size_t snapshot = start;
+		BenchClock::time_point begin = BenchClock::now();
+		bench_sink = find_memory_access(snapshots, snapshot, address) + snapshot;
+		latencies.push_back(seconds_since(begin) * 1e6);
+	}
+	result.walk_mem = summarise_latencies(latencies);
+
+	// Jumping to a snapshot in a different block, which has to be decoded
+	// from its keyframe and possibly read back from the spill file.
+	latencies.clear();
+	for(std::size_t i = 0; i < samples; i++) {
+		std::size_t snapshot = (i * 7919 * SnapshotStore::KEYFRAME_INTERVAL + i * 37) % result.snapshots;
+		BenchClock::time_point begin = BenchClock::now();
+		bench_sink = snapshots.get(snapshot)->read_size;
+		latencies.push_back(seconds_since(begin) * 1e6);
+	}
+	result.random_access = summarise_latencies(latencies);
+
+	// Disassembly throughput, over the whole program for at least a second.
+	{
+		const u8 *program = snapshots.program();
+		std::size_t calls = 0;
+		std::size_t length = 0;
+		BenchClock::time_point start = BenchClock::now();
+		double elapsed = 0;
+		do {
+			for(u32 address = 0; address < VU1_PROGSIZE; address += INSN_PAIR_SIZE) {
+				length += disassemble(&program[address], address).size();
+			}
+			calls += VU1_PROGSIZE / INSN_PAIR_SIZE;
+			elapsed = seconds_since(start);
+		} while(elapsed < 1.0);
+		result.disassemble_per_second = calls / elapsed;
+		bench_sink = length;
+	}
+
+	// GS packet parsing throughput, using the packets actually kicked.
+	std::vector<std::pair<std::shared_ptr<const Snapshot>, u32>> kicks;
+	for(std::size_t i = 0; i < result.snapshots && kicks.size() < 1024; i++) {
+		if(snapshots.flags(i) & SNAPSHOT_XGKICK) {
+			u32 lower;
+			memcpy(&lower, snapshots.instruction(i), 4);
+			std::shared_ptr<const Snapshot> snap = snapshots.get(i);
+			u32 address = (snap->registers.VI[bit_range(lower, 11, 15)].UL * 0x10) % VU1_MEMSIZE;
+			kicks.emplace_back(snap, address);
+		}
+	}
+	result.gs_packet_count = kicks.size();
+	if(!kicks.empty()) {
+		std::size_t packets = 0;
+		std::size_t primitives = 0;
+		BenchClock::time_point start = BenchClock::now();
+		double elapsed = 0;
+		do {
+			for(const auto &[snapshot, address] : kicks) {
+				GsPacket packet = read_gs_packet(&snapshot->memory[address], VU1_MEMSIZE - address);
+				primitives += packet.primitives.size();
+				packets++;
+			}
+			elapsed = seconds_since(start);
+		} while(elapsed < 1.0);
+		result.gs_packets_per_second = packets / elapsed;
+		bench_sink = primitives;
+	}
+	return result.error.empty();
+}
+
+LatencyResult summarise_latencies(std::vector<double> &microseconds)
+{
+	LatencyResult result;
+	if(microseconds.empty()) {
+		return result;
+	}
+	std::sort(microseconds.begin(), microseconds.end());
+	result.samples = microseconds.size();
+	for(double latency : microseconds) {
+		result.mean_us += latency;
+	}
+	result.mean_us /= microseconds.size();
+	result.median_us = microseconds[microseconds.size() / 2];
+	result.max_us = microseconds.back();
+	return result;
+}
+
+double seconds_since(BenchClock::time_point start)
+{
+	return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+std::size_t peak_rss_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+	#ifdef __APPLE__
+		return (std::size_t) usage.ru_maxrss; // Bytes.
+	#else
+		return (std::size_t) usage.ru_maxrss * 1024; // Kilobytes.
+	#endif
+#endif
+}
+
+void write_bench_json(FILE *file, const std::string &label, const std::vector<TraceBenchResult> &results)
+{
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"format\": 1,\n");
+	fprintf(file, "\t\"label\": \"%s\",\n", json_escape(label).c_str());
+	fprintf(file, "\t\"traces\": [");
+	for(std::size_t i = 0; i < results.size(); i++) {
+		const TraceBenchResult &result = results[i];
+		double megabytes = result.file_size / (1024.0 * 1024.0);
+		fprintf(file, "%s\n\t\t{\n", i == 0 ? "" : ",");
+		fprintf(file, "\t\t\t\"path\": \"%s\",\n", json_escape(result.path).c_str());
+		// There are no meaningful timings for a trace that failed to load, so
+		// they're left out rather than written as zeros or sentinels.
+		if(!result.error.empty()) {
+			fprintf(file, "\t\t\t\"file_size\": %zu,\n", result.file_size);
+			fprintf(file, "\t\t\t\"error\": \"%s\"\n", json_escape(result.error).c_str());
+			fprintf(file, "\t\t}");
+			continue;
+		}
+		fprintf(file, "\t\t\t\"file_size\": %zu,\n", result.file_size);
+		fprintf(file, "\t\t\t\"snapshots\": %zu,\n", result.snapshots);
+		fprintf(file, "\t\t\t\"parse\": {\n");
+		fprintf(file, "\t\t\t\t\"seconds\": %.6f,\n", result.parse_seconds);
+		fprintf(file, "\t\t\t\t\"mb_per_second\": %.3f,\n", result.parse_seconds > 0 ? megabytes / result.parse_seconds : 0);
+		fprintf(file, "\t\t\t\t\"snapshots_per_second\": %.1f,\n", result.parse_seconds > 0 ? result.snapshots / result.parse_seconds : 0);
+		fprintf(file, "\t\t\t\t\"read_seconds\": %.6f,\n", result.read_seconds);
+		fprintf(file, "\t\t\t\t\"branches_seconds\": %.6f,\n", result.branches_seconds);
+		fprintf(file, "\t\t\t\t\"call_tree_seconds\": %.6f,\n", result.call_tree_seconds);
+		fprintf(file, "\t\t\t\t\"profile_seconds\": %.6f,\n", result.profile_seconds);
+		fprintf(file, "\t\t\t\t\"disassembly_seconds\": %.6f\n", result.disassembly_seconds);
+		fprintf(file, "\t\t\t},\n");
+		write_latency_json(file, "walk_until_pc_equal", result.walk_pc);
+		write_latency_json(file, "walk_until_mem_access", result.walk_mem);
+		write_latency_json(file, "random_access", result.random_access);
+		fprintf(file, "\t\t\t\"store_resident_bytes\": %zu,\n", result.resident_bytes);
+		fprintf(file, "\t\t\t\"store_spilled_bytes\": %zu,\n", result.spilled_bytes);
+		fprintf(file, "\t\t\t\"disassemble_calls_per_second\": %.1f,\n", result.disassemble_per_second);
+		fprintf(file, "\t\t\t\"gs_packets_sampled\": %zu,\n", result.gs_packet_count);
+		fprintf(file, "\t\t\t\"gs_packets_per_second\": %.1f,\n", result.gs_packets_per_second);
+		fprintf(file, "\t\t\t\"peak_rss_bytes\": %zu,\n", result.peak_rss);
+		fprintf(file, "\t\t\t\"rss_bytes_per_million_snapshots\": %.0f\n", result.rss_per_million_snapshots);
+		fprintf(file, "\t\t}");
+	}
+	fprintf(file, "\n\t]\n}\n");
+}
+
+void write_latency_json(FILE *file, const char *name, const LatencyResult &latency)
+{
+	fprintf(file, "\t\t\t\"%s\": {\"samples\": %zu, \"mean_us\": %.3f, \"median_us\": %.3f, \"max_us\": %.3f},\n",
+		name, latency.samples, latency.mean_us, latency.median_us, latency.max_us);
+}
+
+std::string json_escape(const std::string &string)
+{
+	std::string escaped;
+	for(char c : string) {
+		if(c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		} else if((u8) c < 0x20) {
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
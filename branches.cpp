@@ -0,0 +1,84 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "branches.h"
+
+// Each thread counts the executions and taken branches for a contiguous range
+// of snapshots into its own tables, which are merged at the end.
+BranchStatistics compute_branch_statistics(const u32 *pcs, std::size_t count)
+{
+	std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+	if(count < 65536) {
+		thread_count = 1;
+	}
+	std::size_t chunk_size = (count + thread_count - 1) / thread_count;
+
+	std::vector<BranchEdgeTable> tables(thread_count);
+	std::vector<std::vector<std::size_t>> times(thread_count, std::vector<std::size_t>(BRANCH_SLOT_COUNT));
+	auto worker = [&](std::size_t thread) {
+		std::size_t begin = thread * chunk_size;
+		std::size_t end = std::min(begin + chunk_size, count);
+		std::vector<std::size_t> &local_times = times[thread];
+		for(std::size_t i = begin; i < end; i++) {
+			local_times[(pcs[i] / 8) % BRANCH_SLOT_COUNT]++;
+			if(i > 0 && pcs[i - 1] + 8 != pcs[i]) {
+				// A branch has taken place.
+				tables[thread].increment(pcs[i - 1], pcs[i]);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for(std::size_t i = 1; i < thread_count; i++) {
+		threads.emplace_back(worker, i);
+	}
+	worker(0);
+	for(std::thread &thread : threads) {
+		thread.join();
+	}
+
+	BranchStatistics stats;
+	stats.times_executed = std::move(times[0]);
+	for(std::size_t i = 1; i < thread_count; i++) {
+		tables[0].merge(tables[i]);
+		for(u32 j = 0; j < BRANCH_SLOT_COUNT; j++) {
+			stats.times_executed[j] += times[i][j];
+		}
+	}
+
+	stats.edges_by_source = tables[0].edges();
+	std::sort(stats.edges_by_source.begin(), stats.edges_by_source.end(), [](const BranchEdge &l, const BranchEdge &r) {
+		return l.from != r.from ? l.from < r.from : l.to < r.to;
+	});
+	stats.edges_by_target = stats.edges_by_source;
+	std::sort(stats.edges_by_target.begin(), stats.edges_by_target.end(), [](const BranchEdge &l, const BranchEdge &r) {
+		return l.to != r.to ? l.to < r.to : l.from < r.from;
+	});
+
+	stats.source_begin.resize(BRANCH_SLOT_COUNT + 1);
+	stats.target_begin.resize(BRANCH_SLOT_COUNT + 1);
+	u32 source = 0, target = 0;
+	for(u32 i = 0; i <= BRANCH_SLOT_COUNT; i++) {
+		while(source < stats.edges_by_source.size() && stats.edges_by_source[source].from / 8 < i) source++;
+		while(target < stats.edges_by_target.size() && stats.edges_by_target[target].to / 8 < i) target++;
+		stats.source_begin[i] = source;
+		stats.target_begin[i] = target;
+	}
+
+	return stats;
+}
@@ -0,0 +1,129 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRANCHES_H
+#define BRANCHES_H
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "pcsx2defs.h"
+
+static const u32 BRANCH_SLOT_COUNT = VU1_PROGSIZE / 8;
+
+struct BranchEdge
+{
+	u32 from;
+	u32 to;
+	std::size_t times;
+};
+
+// Open addressing hash table of (from, to) -> times. Most branches only ever
+// go to one place, so the slot last used for each source address is cached
+// and checked before probing.
+class BranchEdgeTable
+{
+public:
+	BranchEdgeTable() : slots(64), last_slot(BRANCH_SLOT_COUNT, EMPTY) {}
+
+	void increment(u32 from, u32 to, std::size_t times = 1)
+	{
+		u32 &cached = last_slot[(from / 8) % BRANCH_SLOT_COUNT];
+		if(cached != EMPTY && slots[cached].to == to && slots[cached].from == from) {
+			slots[cached].times += times;
+			return;
+		}
+		if((used + 1) * 4 > slots.size() * 3) {
+			grow();
+		}
+		u32 index = find(from, to);
+		if(slots[index].times == 0) {
+			slots[index].from = from;
+			slots[index].to = to;
+			used++;
+		}
+		slots[index].times += times;
+		cached = index;
+	}
+
+	void merge(const BranchEdgeTable &other)
+	{
+		for(const BranchEdge &edge : other.slots) {
+			if(edge.times > 0) {
+				increment(edge.from, edge.to, edge.times);
+			}
+		}
+	}
+
+	std::vector<BranchEdge> edges() const
+	{
+		std::vector<BranchEdge> result;
+		result.reserve(used);
+		for(const BranchEdge &edge : slots) {
+			if(edge.times > 0) {
+				result.push_back(edge);
+			}
+		}
+		return result;
+	}
+
+private:
+	static constexpr u32 EMPTY = 0xffffffff;
+
+	u32 find(u32 from, u32 to) const
+	{
+		u32 mask = (u32) slots.size() - 1;
+		u32 index = (((from / 8) * 2654435761u) ^ (to / 8)) & mask;
+		while(slots[index].times > 0 && (slots[index].from != from || slots[index].to != to)) {
+			index = (index + 1) & mask;
+		}
+		return index;
+	}
+
+	void grow()
+	{
+		std::vector<BranchEdge> old = std::move(slots);
+		slots = std::vector<BranchEdge>(old.size() * 2);
+		std::fill(last_slot.begin(), last_slot.end(), EMPTY);
+		for(const BranchEdge &edge : old) {
+			if(edge.times > 0) {
+				slots[find(edge.from, edge.to)] = edge;
+			}
+		}
+	}
+
+	std::vector<BranchEdge> slots;
+	std::vector<u32> last_slot;
+	std::size_t used = 0;
+};
+
+struct BranchStatistics
+{
+	std::vector<std::size_t> times_executed; // Indexed by pc / 8.
+	std::vector<BranchEdge> edges_by_source; // Sorted by (from, to).
+	std::vector<BranchEdge> edges_by_target; // Sorted by (to, from).
+	// Index ranges into the above arrays for each instruction pair, so the
+	// edges for pc are [source_begin[pc / 8], source_begin[pc / 8 + 1]).
+	std::vector<u32> source_begin;
+	std::vector<u32> target_begin;
+};
+
+BranchStatistics compute_branch_statistics(const u32 *pcs, std::size_t count);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "callstack.h"
+
+// Returns the opcode of the lower instruction at pc, or 0 if the lower slot
+// holds an immediate value for the I register instead.
+u32 lower_opcode(const u8 *program, u32 pc)
+{
+	u32 lower, upper;
+	memcpy(&lower, &program[pc % VU1_PROGSIZE], 4);
+	memcpy(&upper, &program[(pc + 4) % VU1_PROGSIZE], 4);
+	if(upper & I_BIT) {
+		return 0;
+	}
+	return lower >> 25;
+}
+
+// BAL and JALR write the address of the instruction after their delay slot to
+// a link register, so a call is recorded when the snapshot after the delay
+// slot is reached, and a JR is treated as a return when it jumps to the
+// return address of a frame that is currently on the stack. Other JRs (e.g.
+// jump tables) are treated as plain branches.
+CallTree build_call_tree(const u32 *pcs, std::size_t count, const u8 *program)
+{
+	CallTree tree;
+	CallNode root;
+	root.parent = 0;
+	root.entry_pc = count > 0 ? pcs[0] : 0;
+	root.call_site = 0;
+	root.depth = 0;
+	tree.nodes.push_back(root);
+	tree.snapshot_nodes.resize(count);
+
+	std::unordered_map<u64, u32> children;
+	u32 node = 0;
+	for(std::size_t i = 0; i < count; i++) {
+		if(i >= 2) {
+			u32 opcode = lower_opcode(program, pcs[i - 2]);
+			if(opcode == VULOWER_BAL || opcode == VULOWER_JALR) {
+				u32 call_site = pcs[i - 2];
+				u64 key = ((u64) node << 32) | ((u64) call_site << 16) | pcs[i];
+				auto iter = children.find(key);
+				if(iter != children.end()) {
+					node = iter->second;
+				} else {
+					CallNode child;
+					child.parent = node;
+					child.entry_pc = pcs[i];
+					child.call_site = call_site;
+					child.depth = tree.nodes[node].depth + 1;
+					u32 index = (u32) tree.nodes.size();
+					tree.nodes.push_back(child);
+					children.emplace(key, index);
+					node = index;
+				}
+			} else if(opcode == VULOWER_JR) {
+				for(u32 frame = node; frame != 0; frame = tree.nodes[frame].parent) {
+					if(tree.nodes[frame].call_site + 16 == pcs[i]) {
+						node = tree.nodes[frame].parent;
+						break;
+					}
+				}
+			}
+		}
+		tree.snapshot_nodes[i] = node;
+		tree.nodes[node].exclusive++;
+	}
+
+	// Aggregate the per-node counts by subroutine. Recursive subroutines are
+	// only counted once per node for the inclusive total.
+	std::unordered_map<u32, SubroutineStats> subroutines;
+	std::vector<u32> seen;
+	for(std::size_t i = 0; i < tree.nodes.size(); i++) {
+		const CallNode &callee = tree.nodes[i];
+		SubroutineStats &stats = subroutines[callee.entry_pc];
+		stats.entry_pc = callee.entry_pc;
+		stats.exclusive += callee.exclusive;
+		seen.clear();
+		for(u32 frame = (u32) i;; frame = tree.nodes[frame].parent) {
+			u32 entry_pc = tree.nodes[frame].entry_pc;
+			if(std::find(seen.begin(), seen.end(), entry_pc) == seen.end()) {
+				subroutines[entry_pc].inclusive += callee.exclusive;
+				seen.push_back(entry_pc);
+			}
+			if(frame == 0) break;
+		}
+	}
+	// Count the number of times each subroutine was entered.
+	for(std::size_t i = 1; i < count; i++) {
+		u32 current = tree.snapshot_nodes[i];
+		if(current != tree.snapshot_nodes[i - 1] && tree.nodes[current].depth > tree.nodes[tree.snapshot_nodes[i - 1]].depth) {
+			subroutines[tree.nodes[current].entry_pc].calls++;
+		}
+	}
+	for(auto &[entry_pc, stats] : subroutines) {
+		tree.subroutines.push_back(stats);
+	}
+	std::sort(tree.subroutines.begin(), tree.subroutines.end(), [](const SubroutineStats &l, const SubroutineStats &r) {
+		return l.inclusive != r.inclusive ? l.inclusive > r.inclusive : l.entry_pc < r.entry_pc;
+	});
+
+	return tree;
+}
+
+// Returns the node indices of the stack at the given snapshot, innermost first.
+std::vector<u32> call_stack_at(const CallTree &tree, std::size_t snapshot)
+{
+	std::vector<u32> stack;
+	if(snapshot >= tree.snapshot_nodes.size()) {
+		return stack;
+	}
+	for(u32 frame = tree.snapshot_nodes[snapshot];; frame = tree.nodes[frame].parent) {
+		stack.push_back(frame);
+		if(frame == 0) break;
+	}
+	return stack;
+}
+
+std::string subroutine_name(const CallNode &node, bool is_root)
+{
+	char name[16];
+	snprintf(name, sizeof(name), "%s_%04x", is_root ? "entry" : "sub", node.entry_pc);
+	return name;
+}
+
+// Writes the tree in the folded format used by flamegraph.pl and friends:
+// one line per call path with the number of snapshots spent in it.
+bool write_folded_stacks(const std::string &path, const CallTree &tree)
+{
+	FILE *file = fopen(path.c_str(), "w");
+	if(file == nullptr) {
+		return false;
+	}
+	std::vector<u32> frames;
+	for(std::size_t i = 0; i < tree.nodes.size(); i++) {
+		if(tree.nodes[i].exclusive == 0) continue;
+		frames.clear();
+		for(u32 frame = (u32) i;; frame = tree.nodes[frame].parent) {
+			frames.push_back(frame);
+			if(frame == 0) break;
+		}
+		for(std::size_t j = frames.size(); j > 0; j--) {
+			u32 frame = frames[j - 1];
+			fprintf(file, "%s%s", subroutine_name(tree.nodes[frame], frame == 0).c_str(), j > 1 ? ";" : "");
+		}
+		fprintf(file, " %zu\n", tree.nodes[i].exclusive);
+	}
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,73 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALLSTACK_H
+#define CALLSTACK_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <stdio.h>
+
+#include "pcsx2defs.h"
+#include "pcsx2disassemble.h"
+
+enum VuLowerOpcode
+{
+	VULOWER_B    = 0x20,
+	VULOWER_BAL  = 0x21,
+	VULOWER_JR   = 0x24,
+	VULOWER_JALR = 0x25
+};
+
+// A node in the call tree. Every distinct call path gets one node, and each
+// snapshot points at the node that was executing, so the stack at any
+// snapshot can be recovered by following the parent links.
+struct CallNode
+{
+	u32 parent;
+	u32 entry_pc;  // Address of the first instruction of the subroutine.
+	u32 call_site; // Address of the BAL/JALR instruction that called it.
+	u32 depth;
+	std::size_t exclusive = 0; // Number of snapshots spent in this node.
+};
+
+struct SubroutineStats
+{
+	u32 entry_pc;
+	std::size_t inclusive = 0;
+	std::size_t exclusive = 0;
+	std::size_t calls = 0;
+};
+
+struct CallTree
+{
+	std::vector<CallNode> nodes; // nodes[0] is the root.
+	std::vector<u32> snapshot_nodes; // Indexed by snapshot.
+	std::vector<SubroutineStats> subroutines; // Sorted by inclusive count.
+};
+
+u32 lower_opcode(const u8 *program, u32 pc);
+CallTree build_call_tree(const u32 *pcs, std::size_t count, const u8 *program);
+std::vector<u32> call_stack_at(const CallTree &tree, std::size_t snapshot);
+std::string subroutine_name(const CallNode &node, bool is_root);
+bool write_folded_stacks(const std::string &path, const CallTree &tree);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPTUREFILTER_H
+#define CAPTUREFILTER_H
+
+// Like tracewriter.h, this is meant to be included by the capture patch, so
+// it doesn't depend on pcsx2defs.h.
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Decides which invocations of a microprogram (one per MSCAL etc.) get
+// traced, and how many instructions of each. An invocation is recorded if
+// its entry PC is in range, its program has one of the given hashes, and
+// it's the nth such invocation. The checks are done in that order, so the
+// cheap ones rule out most invocations first. The program hash is the same
+// one vutrace shows (see hash_program in trace.h), and is only recomputed
+// when the program changes.
+class CaptureFilter
+{
+public:
+	static constexpr uint32_t PROGRAM_SIZE = 0x4000;
+
+	std::vector<uint64_t> program_hashes; // Empty to allow any program.
+	uint32_t entry_pc_min = 0;
+	uint32_t entry_pc_max = UINT32_MAX; // Inclusive.
+	uint32_t interval = 1; // Record every nth invocation that passes the other checks.
+	uint64_t max_instructions = 0; // Per trace, or 0 for no limit.
+
+	// Parse a list of options separated by spaces e.g.
+	// "program=0123456789abcdef,fedcba9876543210 entry=0x100-0x200 every=4 max=100000".
+	bool parse(const std::string &text, std::string &error);
+	// Called when a microprogram is started. Returns whether the invocation
+	// should be traced.
+	bool accept(const uint8_t *program, uint32_t entry_pc);
+	// Number of invocations seen and accepted so far.
+	uint64_t invocations() const { return invocation_count; }
+	uint64_t accepted() const { return accepted_count; }
+
+	static uint64_t hash_program(const uint8_t *program);
+
+private:
+	uint64_t invocation_count = 0;
+	uint64_t matched_count = 0;
+	uint64_t accepted_count = 0;
+	std::vector<uint8_t> last_program;
+	uint64_t last_hash = 0;
+};
+
+inline bool CaptureFilter::parse(const std::string &text, std::string &error)
+{
+	std::stringstream stream(text);
+	std::string option;
+	while(stream >> option) {
+		std::size_t equals = option.find('=');
+		std::string key = option.substr(0, equals);
+		std::string value = equals == std::string::npos ? "" : option.substr(equals + 1);
+		char *end = nullptr;
+		if(key == "program" && !value.empty()) {
+			std::stringstream hashes(value);
+			std::string hash;
+			while(std::getline(hashes, hash, ',')) {
+				program_hashes.push_back(strtoull(hash.c_str(), &end, 16));
+				if(hash.empty()) end = nullptr;
+				if(end == nullptr || *end != '\0') break;
+			}
+		} else if(key == "entry" && !value.empty()) {
+			entry_pc_min = (uint32_t) strtoul(value.c_str(), &end, 0);
+			entry_pc_max = entry_pc_min;
+			if(*end == '-') {
+				entry_pc_max = (uint32_t) strtoul(end + 1, &end, 0);
+			}
+		} else if(key == "every" && !value.empty()) {
+			interval = (uint32_t) strtoul(value.c_str(), &end, 0);
+			if(interval == 0) end = nullptr;
+		} else if(key == "max" && !value.empty()) {
+			max_instructions = strtoull(value.c_str(), &end, 0);
+		}
+		if(end == nullptr || *end != '\0') {
+			error = "Bad capture filter option '" + option + "'.";
+			return false;
+		}
+	}
+	if(entry_pc_min > entry_pc_max) {
+		error = "The entry PC range of the capture filter is backwards.";
+		return false;
+	}
+	return true;
+}
+
+inline bool CaptureFilter::accept(const uint8_t *program, uint32_t entry_pc)
+{
+	invocation_count++;
+	if(entry_pc < entry_pc_min || entry_pc > entry_pc_max) {
+		return false;
+	}
+	if(!program_hashes.empty()) {
+		// Comparing against the last program is much faster than hashing it.
+		if(last_program.empty() || memcmp(last_program.data(), program, PROGRAM_SIZE) != 0) {
+			last_program.assign(program, program + PROGRAM_SIZE);
+			last_hash = hash_program(program);
+		}
+		bool found = false;
+		for(uint64_t hash : program_hashes) {
+			found |= hash == last_hash;
+		}
+		if(!found) {
+			return false;
+		}
+	}
+	if(matched_count++ % interval != 0) {
+		return false;
+	}
+	accepted_count++;
+	return true;
+}
+
+// 64-bit FNV-1a.
+inline uint64_t CaptureFilter::hash_program(const uint8_t *program)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	for(uint32_t i = 0; i < PROGRAM_SIZE; i++) {
+		hash ^= program[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+#endif
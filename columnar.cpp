@@ -0,0 +1,234 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "columnar.h"
+
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <stdio.h>
+
+#include "trace.h"
+
+// Rows are buffered per column and written out this many at a time.
+static const std::size_t COLUMNAR_CHUNK_ROWS = 16 * 1024;
+
+struct ColumnWriter
+{
+	ColumnarColumn column = {};
+	std::size_t source = 0; // Offset of the value in the Snapshot struct.
+	std::vector<u32> buffer;
+};
+
+static ColumnWriter make_column(const std::string &name, const char *dtype, std::size_t source)
+{
+	ColumnWriter writer;
+	strncpy(writer.column.name, name.c_str(), sizeof(writer.column.name) - 1);
+	memcpy(writer.column.dtype, dtype, 4);
+	writer.column.element_size = 4;
+	writer.source = source;
+	return writer;
+}
+
+// Every per-snapshot column is a 32-bit value stored somewhere in the
+// Snapshot struct, so the columns just record where.
+static std::vector<ColumnWriter> make_row_columns()
+{
+	std::unique_ptr<Snapshot> probe(new Snapshot);
+	const u8 *base = (const u8*) probe.get();
+	auto source = [&](const void *value) { return (std::size_t) ((const u8*) value - base); };
+	const VURegs &regs = probe->registers;
+
+	std::vector<ColumnWriter> columns;
+	columns.push_back(make_column("pc", "<u4", source(&regs.VI[TPC].UL)));
+	columns.push_back(make_column("read_addr", "<u4", source(&probe->read_addr)));
+	columns.push_back(make_column("read_size", "<u4", source(&probe->read_size)));
+	columns.push_back(make_column("write_addr", "<u4", source(&probe->write_addr)));
+	columns.push_back(make_column("write_size", "<u4", source(&probe->write_size)));
+	static const char *lanes[] = {"x", "y", "z", "w"};
+	for(int i = 0; i < 32; i++) {
+		for(int lane = 0; lane < 4; lane++) {
+			char name[24];
+			snprintf(name, sizeof(name), "vf%02d.%s", i, lanes[lane]);
+			columns.push_back(make_column(name, "<f4", source(&regs.VF[i].UL[lane])));
+		}
+	}
+	for(int i = 0; i < 32; i++) {
+		char name[24];
+		snprintf(name, sizeof(name), "vi%02d", i);
+		columns.push_back(make_column(name, "<u4", source(&regs.VI[i].UL)));
+	}
+	for(int lane = 0; lane < 4; lane++) {
+		columns.push_back(make_column(std::string("acc.") + lanes[lane], "<f4", source(&regs.ACC.UL[lane])));
+	}
+	columns.push_back(make_column("q", "<f4", source(&regs.q.UL)));
+	columns.push_back(make_column("p", "<f4", source(&regs.p.UL)));
+	return columns;
+}
+
+// Calls callback with each 32-bit word of memory that differs from previous,
+// and updates previous to match.
+template <typename Callback>
+static void diff_memory(u8 *previous, const u8 *memory, Callback callback)
+{
+	for(u32 block = 0; block < VU1_MEMSIZE; block += 64) {
+		if(memcmp(&previous[block], &memory[block], 64) == 0) {
+			continue;
+		}
+		for(u32 address = block; address < block + 64; address += 4) {
+			if(memcmp(&previous[address], &memory[address], 4) != 0) {
+				u32 value;
+				memcpy(&value, &memory[address], 4);
+				callback(address, value);
+			}
+		}
+		memcpy(&previous[block], &memory[block], 64);
+	}
+}
+
+static bool flush_column(FILE *file, ColumnWriter &writer, u64 first_row, std::string &error)
+{
+	if(writer.buffer.empty()) {
+		return true;
+	}
+	u64 offset = writer.column.offset + first_row * writer.column.element_size;
+	if(!seek_file(file, offset) || fwrite(writer.buffer.data(), writer.buffer.size() * 4, 1, file) != 1) {
+		error = "Failed to write column " + std::string(writer.column.name) + ".";
+		return false;
+	}
+	writer.buffer.clear();
+	return true;
+}
+
+bool write_columnar_trace(ColumnarStats &stats, const std::string &trace_path, const std::string &output_path, std::string &error)
+{
+	stats = ColumnarStats();
+	std::vector<u8> previous(VU1_MEMSIZE);
+
+	// First pass: count the rows and the write events. Memory starts out
+	// zeroed, so the first snapshot's non-zero words are events too.
+	TraceReader reader;
+	if(!reader.open(trace_path)) {
+		error = reader.error;
+		return false;
+	}
+	while(reader.next_snapshot()) {
+		stats.rows++;
+		diff_memory(previous.data(), reader.snapshot().memory, [&](u32, u32) {
+			stats.events++;
+		});
+	}
+	if(!reader.error.empty()) {
+		error = reader.error;
+		return false;
+	}
+
+	// Lay out the columns.
+	std::vector<ColumnWriter> rows = make_row_columns();
+	std::vector<ColumnWriter> events;
+	events.push_back(make_column("write_snapshot", "<u4", 0));
+	events.push_back(make_column("write_address", "<u4", 0));
+	events.push_back(make_column("write_value", "<u4", 0));
+	u32 column_count = (u32) (rows.size() + events.size());
+	u64 offset = sizeof(ColumnarHeader) + column_count * sizeof(ColumnarColumn);
+	u64 data_end = offset;
+	auto place = [&](ColumnWriter &writer, u64 count) {
+		offset = (offset + COLUMNAR_ALIGNMENT - 1) & ~(u64) (COLUMNAR_ALIGNMENT - 1);
+		writer.column.offset = offset;
+		writer.column.count = count;
+		offset += count * writer.column.element_size;
+		if(count > 0) {
+			data_end = offset;
+		}
+	};
+	for(ColumnWriter &writer : rows) place(writer, stats.rows);
+	for(ColumnWriter &writer : events) place(writer, stats.events);
+	stats.file_size = offset;
+
+	FILE *file = fopen(output_path.c_str(), "wb");
+	if(file == nullptr) {
+		error = "Failed to open " + output_path + " for writing.";
+		return false;
+	}
+	ColumnarHeader header = {};
+	memcpy(header.magic, COLUMNAR_MAGIC, sizeof(header.magic));
+	header.version = COLUMNAR_VERSION;
+	header.column_count = column_count;
+	header.row_count = stats.rows;
+	header.event_count = stats.events;
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+	for(const ColumnWriter &writer : rows) success &= fwrite(&writer.column, sizeof(ColumnarColumn), 1, file) == 1;
+	for(const ColumnWriter &writer : events) success &= fwrite(&writer.column, sizeof(ColumnarColumn), 1, file) == 1;
+	if(!success) {
+		error = "Failed to write header to " + output_path + ".";
+		fclose(file);
+		return false;
+	}
+
+	// Second pass: fill in the columns a chunk at a time.
+	std::fill(previous.begin(), previous.end(), 0);
+	if(!reader.open(trace_path)) {
+		error = reader.error;
+		fclose(file);
+		return false;
+	}
+	u64 row = 0, chunk_row = 0, event = 0, chunk_event = 0;
+	while(success && reader.next_snapshot() && row < stats.rows) {
+		const Snapshot &snapshot = reader.snapshot();
+		for(ColumnWriter &writer : rows) {
+			u32 value;
+			memcpy(&value, (const u8*) &snapshot + writer.source, 4);
+			writer.buffer.push_back(value);
+		}
+		diff_memory(previous.data(), snapshot.memory, [&](u32 address, u32 value) {
+			events[0].buffer.push_back((u32) row);
+			events[1].buffer.push_back(address);
+			events[2].buffer.push_back(value);
+			event++;
+		});
+		row++;
+		if(row - chunk_row >= COLUMNAR_CHUNK_ROWS) {
+			for(ColumnWriter &writer : rows) success &= flush_column(file, writer, chunk_row, error);
+			chunk_row = row;
+		}
+		if(event - chunk_event >= COLUMNAR_CHUNK_ROWS) {
+			for(ColumnWriter &writer : events) success &= flush_column(file, writer, chunk_event, error);
+			chunk_event = event;
+		}
+	}
+	for(ColumnWriter &writer : rows) success &= flush_column(file, writer, chunk_row, error);
+	for(ColumnWriter &writer : events) success &= flush_column(file, writer, chunk_event, error);
+	if(success && (row != stats.rows || event != stats.events)) {
+		error = "Trace changed while it was being exported.";
+		success = false;
+	}
+	// Pad the file out to the offset of the last column if it's empty, so
+	// every column lies within the file.
+	if(success && stats.file_size > data_end) {
+		u8 zero = 0;
+		if(!seek_file(file, stats.file_size - 1) || fwrite(&zero, 1, 1, file) != 1) {
+			error = "Failed to write " + output_path + ".";
+			success = false;
+		}
+	}
+	if(fclose(file) != 0 && success) {
+		error = "Failed to write " + output_path + ".";
+		success = false;
+	}
+	return success;
+}
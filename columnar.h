@@ -0,0 +1,78 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <string>
+#include <vector>
+
+#include "pcsx2defs.h"
+
+// A columnar export of a trace, meant to be memory mapped by analysis tools.
+// The file starts with a ColumnarHeader followed by column_count
+// ColumnarColumn entries. Each column is a little endian array of count
+// elements starting at offset, which is aligned to COLUMNAR_ALIGNMENT bytes.
+// The dtype field is a numpy type string e.g. "<u4" or "<f4".
+//
+// There's one row per snapshot in the per-snapshot columns: the PC, the
+// load and store recorded with the snapshot, and every lane of every
+// register. Like in the trace, a snapshot is taken after an instruction
+// runs, so pc is that of the next instruction, and the load and store of
+// row n were done by the instruction at the pc of row n - 1. Those of row 0
+// were done by the first instruction. Memory is exported as sparse write events, one per 32-bit word
+// that changed, in the write_snapshot, write_address and write_value
+// columns, which have event_count rows.
+static const char COLUMNAR_MAGIC[8] = {'V', 'U', 'C', 'O', 'L', 'U', 'M', 'N'};
+static const u32 COLUMNAR_VERSION = 1;
+static const u32 COLUMNAR_ALIGNMENT = 64;
+
+struct ColumnarHeader
+{
+	char magic[8];
+	u32 version;
+	u32 column_count;
+	u64 row_count;
+	u64 event_count;
+};
+
+struct ColumnarColumn
+{
+	char name[24];
+	char dtype[4];
+	u32 element_size;
+	u64 offset;
+	u64 count;
+};
+
+static_assert(sizeof(ColumnarHeader) == 32, "ColumnarHeader has the wrong size.");
+static_assert(sizeof(ColumnarColumn) == 48, "ColumnarColumn has the wrong size.");
+
+struct ColumnarStats
+{
+	u64 rows = 0;
+	u64 events = 0;
+	u64 file_size = 0;
+};
+
+// Streams through the trace twice, first to count the rows and write events
+// so the columns can be laid out, then to fill them in. Only the current
+// snapshot and the memory of the previous one are kept in memory.
+bool write_columnar_trace(ColumnarStats &stats, const std::string &trace_path, const std::string &output_path, std::string &error);
+
+#endif
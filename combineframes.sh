@@ -1,19 +1,13 @@
 #!/bin/bash
 
 # This script uses ffmpeg to combine all the dumped framebuffers from a trace
-# session into a single video file.
+# session into a single video file. vutrace decodes the dumps and streams
+# them to ffmpeg directly, so they don't need to be copied and renamed first.
+# Set VUTRACE to the path of the vutrace executable if it's not on the PATH.
 
 if [[ ! -f LOG.txt ]] ; then
 	echo "LOG.txt does not exist. You need to run this from the trace directory."
 	exit 1
 fi
 
-mkdir combineframestemp
-cp *.png combineframestemp
-iter=0
-for f in combineframestemp/* ; do
-	mv $f "combineframestemp/fb$iter.png";
-	iter=$((iter+1))
-done
-ffmpeg -r 30 -i "combineframestemp/fb%d.png" -pix_fmt yuv420p -r 30 _video.mp4
-rm -r combineframestemp
+"${VUTRACE:-vutrace}" --frames . --video - --fps 30 | ffmpeg -f yuv4mpegpipe -i - -pix_fmt yuv420p -r 30 _video.mp4
@@ -0,0 +1,263 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "comments.h"
+
+#include <fstream>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *COMMENT_FILE_HEADER = "vutrace comments 1";
+
+// The file starts with COMMENT_FILE_HEADER, then for each program there's a
+// "program <hash>" line followed by "<address> <comment>" lines and
+// "@<begin> <end> <type>" lines for the memory annotations, with all the
+// numbers in hex.
+bool CommentDatabase::load(const std::string &path, std::string &error)
+{
+	flush();
+	file_path = path;
+	programs.clear();
+	legacy.clear();
+	unsaved = false;
+	this->error.clear();
+
+	std::ifstream file(path);
+	if(!file) {
+		if(std::filesystem::exists(path)) {
+			error = "Failed to open " + path + ".";
+			file_path.clear();
+			return false;
+		}
+		return true;
+	}
+	std::string line;
+	if(!std::getline(file, line)) {
+		return true;
+	}
+	if(line != COMMENT_FILE_HEADER) {
+		u32 address = 0;
+		do {
+			if(!line.empty()) {
+				legacy.emplace_back(address, line);
+			}
+			address += INSN_PAIR_SIZE;
+		} while(address < VU1_PROGSIZE && std::getline(file, line));
+		return true;
+	}
+	Program *program = nullptr;
+	for(std::size_t number = 2; std::getline(file, line); number++) {
+		if(line.empty()) {
+			continue;
+		}
+		if(line.rfind("program ", 0) == 0) {
+			program = &programs[strtoull(line.c_str() + 8, nullptr, 16)];
+			continue;
+		}
+		bool valid = program != nullptr;
+		if(valid && line[0] == '@') {
+			u32 begin, end;
+			char type_name[16];
+			MemoryType type;
+			valid = sscanf(line.c_str(), "@%x %x %15s", &begin, &end, type_name) == 3 && parse_memory_type(type, type_name);
+			if(valid) {
+				program->annotations.set(begin, end, type);
+			}
+		} else if(valid) {
+			char *end = nullptr;
+			u32 address = (u32) strtoul(line.c_str(), &end, 16);
+			valid = end != line.c_str() && *end == ' ';
+			if(valid) {
+				program->comments[address] = std::string(end + 1);
+			}
+		}
+		if(!valid) {
+			error = path + ":" + std::to_string(number) + ": Invalid comment.";
+			file_path.clear();
+			programs.clear();
+			return false;
+		}
+	}
+	auto unassigned = programs.find(0);
+	if(unassigned != programs.end()) {
+		const std::map<u32, std::string> &comments = unassigned->second.comments;
+		legacy.assign(comments.begin(), comments.end());
+		programs.erase(unassigned);
+	}
+	return true;
+}
+
+void CommentDatabase::assign_legacy(u64 program_hash)
+{
+	for(auto &[address, text] : legacy) {
+		programs[program_hash].comments[address] = std::move(text);
+	}
+	legacy.clear();
+}
+
+const std::string &CommentDatabase::get(u64 program_hash, u32 address) const
+{
+	static const std::string empty;
+	auto program = programs.find(program_hash);
+	if(program == programs.end()) {
+		return empty;
+	}
+	auto comment = program->second.comments.find(address);
+	return comment == program->second.comments.end() ? empty : comment->second;
+}
+
+void CommentDatabase::set(u64 program_hash, u32 address, const std::string &text)
+{
+	if(text.empty()) {
+		auto program = programs.find(program_hash);
+		if(program == programs.end() || program->second.comments.erase(address) == 0) {
+			return;
+		}
+	} else {
+		programs[program_hash].comments[address] = text;
+	}
+	edited();
+}
+
+const MemoryAnnotations *CommentDatabase::annotations(u64 program_hash) const
+{
+	auto program = programs.find(program_hash);
+	if(program == programs.end() || program->second.annotations.empty()) {
+		return nullptr;
+	}
+	return &program->second.annotations;
+}
+
+void CommentDatabase::annotate(u64 program_hash, u32 begin, u32 end, MemoryType type)
+{
+	programs[program_hash].annotations.set(begin, end, type);
+	edited();
+}
+
+void CommentDatabase::edited()
+{
+	unsaved = true;
+	last_edit = std::chrono::steady_clock::now();
+}
+
+void CommentDatabase::update()
+{
+	if(save.valid() && save.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		finish_save();
+	}
+	if(unsaved && !save.valid() && loaded() && std::chrono::steady_clock::now() - last_edit >= SAVE_DELAY) {
+		start_save();
+	}
+}
+
+bool CommentDatabase::flush()
+{
+	if(save.valid()) {
+		finish_save();
+	}
+	if(unsaved && loaded()) {
+		start_save();
+		finish_save();
+	}
+	return error.empty();
+}
+
+std::string CommentDatabase::serialise() const
+{
+	std::string text = std::string(COMMENT_FILE_HEADER) + "\n";
+	char buffer[64];
+	for(const auto &[hash, program] : programs) {
+		if(program.comments.empty() && program.annotations.empty()) {
+			continue;
+		}
+		snprintf(buffer, sizeof(buffer), "program %016llx\n", (unsigned long long) hash);
+		text += buffer;
+		for(const auto &[address, comment] : program.comments) {
+			snprintf(buffer, sizeof(buffer), "%04x ", address);
+			text += buffer;
+			text += comment;
+			text += "\n";
+		}
+		for(const MemoryAnnotation &annotation : program.annotations.all()) {
+			snprintf(buffer, sizeof(buffer), "@%04x %04x %s\n", annotation.begin, annotation.end, memory_type_name(annotation.type));
+			text += buffer;
+		}
+	}
+	// Legacy comments that were never assigned to a program are written with
+	// a hash of zero, which load turns back into legacy comments.
+	if(!legacy.empty()) {
+		text += "program 0000000000000000\n";
+		for(const auto &[address, comment] : legacy) {
+			snprintf(buffer, sizeof(buffer), "%04x ", address);
+			text += buffer;
+			text += comment;
+			text += "\n";
+		}
+	}
+	return text;
+}
+
+// The comments are serialised on the calling thread, which is cheap, so the
+// background thread doesn't need to touch the database.
+void CommentDatabase::start_save()
+{
+	std::string path = file_path;
+	std::string text = serialise();
+	unsaved = false;
+	save = std::async(std::launch::async, [path, text]() {
+		std::string error;
+		write_file_atomic(path, text, error);
+		return error;
+	});
+}
+
+void CommentDatabase::finish_save()
+{
+	error = save.get();
+	if(!error.empty()) {
+		// Try again later.
+		unsaved = true;
+		last_edit = std::chrono::steady_clock::now();
+	}
+}
+
+bool write_file_atomic(const std::string &path, const std::string &text, std::string &error)
+{
+	std::string temp_path = path + ".tmp";
+	FILE *file = fopen(temp_path.c_str(), "wb");
+	if(file == nullptr) {
+		error = "Failed to open " + temp_path + " for writing.";
+		return false;
+	}
+	bool success = text.empty() || fwrite(text.data(), text.size(), 1, file) == 1;
+	success &= fclose(file) == 0;
+	if(!success) {
+		error = "Failed to write " + temp_path + ".";
+		remove(temp_path.c_str());
+		return false;
+	}
+	std::error_code rename_error;
+	std::filesystem::rename(temp_path, path, rename_error);
+	if(rename_error) {
+		error = "Failed to replace " + path + ": " + rename_error.message();
+		remove(temp_path.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,104 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMMENTS_H
+#define COMMENTS_H
+
+#include <map>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "pcsx2defs.h"
+#include "trace.h"
+#include "annotations.h"
+
+// Comments on the disassembly, keyed by the hash of the program they were
+// written for and the address of the instruction pair, so loading a trace
+// that ran a different program doesn't shift them onto the wrong lines. The
+// types assigned to ranges of VU memory are stored alongside them, also
+// keyed by program.
+//
+// Edits are saved after SAVE_DELAY has passed without any more of them. The
+// file is written on a background thread to a temporary file which is then
+// renamed over the original, so it's never left half written.
+//
+// The old format, one line per instruction pair with no program hash, can
+// still be read. Those comments are held back until assign_legacy is called
+// with the program they belong to, and the file is converted to the new
+// format the next time it's saved.
+class CommentDatabase
+{
+public:
+	static constexpr std::chrono::milliseconds SAVE_DELAY{1000};
+
+	CommentDatabase() = default;
+	~CommentDatabase() { flush(); }
+	CommentDatabase(const CommentDatabase&) = delete;
+	CommentDatabase &operator=(const CommentDatabase&) = delete;
+
+	// If the file doesn't exist yet, it's created on the first save.
+	bool load(const std::string &path, std::string &error);
+	void assign_legacy(u64 program_hash);
+
+	bool loaded() const { return !file_path.empty(); }
+	const std::string &path() const { return file_path; }
+	const std::string &get(u64 program_hash, u32 address) const;
+	// Setting a comment to the empty string removes it.
+	void set(u64 program_hash, u32 address, const std::string &text);
+	// Returns null if the program has no annotations.
+	const MemoryAnnotations *annotations(u64 program_hash) const;
+	void annotate(u64 program_hash, u32 begin, u32 end, MemoryType type);
+
+	// Should be called regularly e.g. every frame. Starts a save if the
+	// comments have been edited and SAVE_DELAY has passed since the last
+	// edit, and picks up the result of the last save.
+	void update();
+	// Wait for any save in progress, then write out any unsaved edits.
+	bool flush();
+	bool saving() const { return save.valid(); }
+	bool dirty() const { return unsaved; }
+
+	std::string error;
+
+private:
+	struct Program
+	{
+		std::map<u32, std::string> comments;
+		MemoryAnnotations annotations;
+	};
+
+	std::string serialise() const;
+	void start_save();
+	void finish_save();
+	void edited();
+
+	std::string file_path;
+	std::map<u64, Program> programs;
+	std::vector<std::pair<u32, std::string>> legacy;
+	bool unsaved = false;
+	std::chrono::steady_clock::time_point last_edit;
+	std::future<std::string> save; // Returns an error message.
+};
+
+// Write text to path + ".tmp" and rename it over path.
+bool write_file_atomic(const std::string &path, const std::string &text, std::string &error);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "coverage.h"
+
+#include "sessioncontainer.h"
+
+void ProgramCoverage::merge(const ProgramCoverage &other)
+{
+	program_hash = other.program_hash;
+	trace_paths.insert(trace_paths.end(), other.trace_paths.begin(), other.trace_paths.end());
+	for(u32 i = 0; i < BRANCH_SLOT_COUNT; i++) {
+		times_executed[i] += other.times_executed[i];
+		times_taken[i] += other.times_taken[i];
+		times_not_taken[i] += other.times_not_taken[i];
+	}
+}
+
+// Returns the paths of all the .bin files in a directory, sorted by name, or
+// of all the traces in a session container.
+std::vector<std::string> list_trace_files(const std::string &directory)
+{
+	std::vector<std::string> paths;
+	std::error_code error;
+	if(std::filesystem::is_regular_file(directory, error)) {
+		std::string container_error;
+		std::shared_ptr<const SessionContainer> container = open_session_container(directory, container_error);
+		for(std::size_t i = 0; container && i < container->traces.size(); i++) {
+			paths.push_back(container_trace_path(directory, i));
+		}
+		return paths;
+	}
+	for(const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+		if(entry.is_regular_file() && entry.path().extension() == ".bin") {
+			paths.push_back(entry.path().string());
+		}
+	}
+	std::sort(paths.begin(), paths.end());
+	return paths;
+}
+
+// Stream through a trace recording coverage. Only the current snapshot is
+// kept in memory. A branch's outcome is known two snapshots later, after its
+// delay slot has executed.
+bool scan_trace_coverage(ProgramCoverage &dest, TraceReader &reader, const std::string &path)
+{
+	if(!reader.open(path)) {
+		return false;
+	}
+	std::vector<u8> branch_slots;
+	u32 history[2] = {0, 0};
+	std::size_t count = 0;
+	while(reader.next_snapshot()) {
+		if(count == 0) {
+			const u8 *program = reader.snapshot().program;
+			branch_slots.resize(BRANCH_SLOT_COUNT);
+			for(u32 pc = 0; pc < VU1_PROGSIZE; pc += INSN_PAIR_SIZE) {
+				u32 opcode = lower_opcode(program, pc);
+				// B and BAL are unconditional, so we only care about IBxx.
+				branch_slots[pc / INSN_PAIR_SIZE] = is_branch(program, pc) && opcode >= 0x28;
+			}
+		}
+		u32 pc = reader.pc();
+		dest.times_executed[pc / INSN_PAIR_SIZE]++;
+		if(count >= 2) {
+			u32 branch_pc = history[0];
+			if(branch_slots[branch_pc / INSN_PAIR_SIZE]) {
+				if(pc != branch_pc + 2 * INSN_PAIR_SIZE) {
+					dest.times_taken[branch_pc / INSN_PAIR_SIZE]++;
+				} else {
+					dest.times_not_taken[branch_pc / INSN_PAIR_SIZE]++;
+				}
+			}
+		}
+		history[0] = history[1];
+		history[1] = pc;
+		count++;
+	}
+	if(!reader.error.empty()) {
+		return false;
+	}
+	dest.program_hash = hash_program(reader.snapshot().program);
+	dest.trace_paths.push_back(path);
+	return true;
+}
+
+// Scan all the traces on the thread pool, one trace per job, merging each
+// result into the database as it finishes.
+void aggregate_coverage(CoverageJob &job, const std::vector<std::string> &trace_paths, ThreadPool &pool)
+{
+	job.trace_count = trace_paths.size();
+	std::mutex mutex;
+	for(const std::string &path : trace_paths) {
+		pool.submit([&job, &mutex, path]() {
+			TraceReader reader;
+			ProgramCoverage coverage;
+			bool success = scan_trace_coverage(coverage, reader, path);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(success) {
+					job.result.programs[coverage.program_hash].merge(coverage);
+				} else {
+					job.result.errors.push_back(path + ": " + reader.error);
+				}
+			}
+			job.traces_done++;
+		});
+	}
+	pool.wait();
+	job.finished = true;
+}
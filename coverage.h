@@ -0,0 +1,68 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+#include "pcsx2defs.h"
+#include "trace.h"
+#include "branches.h"
+#include "profile.h"
+#include "threadpool.h"
+
+// Which instruction slots of a microprogram were executed, and which way
+// each branch went, over all the traces that ran it.
+struct ProgramCoverage
+{
+	u64 program_hash = 0;
+	std::vector<std::string> trace_paths;
+	std::vector<std::size_t> times_executed = std::vector<std::size_t>(BRANCH_SLOT_COUNT);
+	std::vector<std::size_t> times_taken = std::vector<std::size_t>(BRANCH_SLOT_COUNT);
+	std::vector<std::size_t> times_not_taken = std::vector<std::size_t>(BRANCH_SLOT_COUNT);
+
+	void merge(const ProgramCoverage &other);
+};
+
+struct CoverageDatabase
+{
+	std::map<u64, ProgramCoverage> programs;
+	std::vector<std::string> errors;
+};
+
+// Shared with the GUI so it can show progress while a scan is running.
+struct CoverageJob
+{
+	std::atomic<std::size_t> traces_done{0};
+	std::atomic<std::size_t> trace_count{0};
+	std::atomic<bool> finished{false};
+	CoverageDatabase result;
+};
+
+std::vector<std::string> list_trace_files(const std::string &directory);
+bool scan_trace_coverage(ProgramCoverage &dest, TraceReader &reader, const std::string &path);
+void aggregate_coverage(CoverageJob &job, const std::vector<std::string> &trace_paths, ThreadPool &pool);
+
+#endif
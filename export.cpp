@@ -0,0 +1,65 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Converts traces to the columnar format described in columnar.h, so they
+// can be loaded by analysis scripts without parsing the packet format.
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <filesystem>
+#include <stdio.h>
+
+#include "columnar.h"
+
+int main(int argc, char **argv)
+{
+	std::string output_path;
+	std::vector<std::string> paths;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			output_path = argv[++i];
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+	if(paths.empty() || (!output_path.empty() && paths.size() > 1)) {
+		fprintf(stderr, "usage: %s [--output <file>] <trace files...>\n", argv[0]);
+		fprintf(stderr, "Each trace is written next to itself with a .vucol extension, unless\n");
+		fprintf(stderr, "a single trace is given along with --output.\n");
+		return 1;
+	}
+
+	int result = 0;
+	for(const std::string &path : paths) {
+		std::string output = output_path;
+		if(output.empty()) {
+			output = std::filesystem::path(path).replace_extension(".vucol").string();
+		}
+		ColumnarStats stats;
+		std::string error;
+		if(!write_columnar_trace(stats, path, output, error)) {
+			fprintf(stderr, "Error: %s: %s\n", path.c_str(), error.c_str());
+			result = 1;
+			continue;
+		}
+		fprintf(stderr, "%s: %llu snapshots, %llu memory writes, %.1f MB\n", output.c_str(),
+			(unsigned long long) stats.rows, (unsigned long long) stats.events, stats.file_size / (1024.0 * 1024.0));
+	}
+	return result;
+}
@@ -0,0 +1,338 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+// Like tracewriter.h, this is meant to be included by the capture patch, so
+// it doesn't depend on pcsx2defs.h.
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tracewriter.h"
+
+// The conditions that make a FlightRecorder write out what it's holding.
+// Any of them firing is enough.
+struct FlightTrigger
+{
+	bool nan = false; // A VF register holds a NaN or an infinity.
+	std::vector<uint32_t> pcs; // An instruction at one of these addresses executes.
+	std::vector<uint32_t> kicks; // An XGKICK of one of these addresses.
+	std::vector<uint32_t> stores; // A store to the quadword containing one of these addresses.
+	uint32_t after = 0; // Instructions to record after the trigger before the trace is ready.
+
+	// Parse a list of options separated by spaces e.g.
+	// "nan pc=0x120,0x188 xgkick=0x3f00 store=0x1000 after=64".
+	bool parse(const std::string &text, std::string &error);
+};
+
+// Keeps the most recent instructions in a fixed amount of memory, so that
+// recording can be left on until something interesting happens, and only
+// then written to disk. The instructions are encoded the same way as in a
+// trace, as segments that each start with a keyframe (the whole program,
+// registers and memory) followed by deltas. When the ring is full, or the
+// segments after the oldest one hold at least keep_instructions
+// instructions, the oldest segment is dropped. A dump is a normal format
+// version 3 trace of all the segments that are left.
+class FlightRecorder
+{
+public:
+	FlightRecorder(std::size_t ring_size, uint64_t keep_instructions, uint32_t keyframe_interval = 256);
+	FlightRecorder(const FlightRecorder&) = delete;
+	FlightRecorder &operator=(const FlightRecorder&) = delete;
+
+	// Called when a microprogram is started, since the program can only be
+	// changed in between.
+	void begin_invocation() { encoder.program_changed(); }
+	void memory_read(uint32_t address, uint32_t size) { encoder.memory_read(address, size); }
+	void memory_write(uint32_t address, uint32_t size) { write_address = address; write_size = size; encoder.memory_write(address, size); }
+	// Record the state after an instruction has executed, see
+	// TraceWriter::instruction. Returns true once the trigger has fired and
+	// the instructions after it have been recorded, at which point dump
+	// should be called.
+	template <typename Registers>
+	bool instruction(const Registers &regs, const uint8_t *memory, const uint8_t *program);
+
+	// Write the recorded instructions out as a trace, then start recording
+	// from scratch again.
+	bool dump(const std::string &path, std::string &error);
+	void clear();
+
+	uint64_t instruction_count() const { return held_instructions; }
+	std::size_t bytes_used() const { return segments.empty() ? 0 : (std::size_t) (head - segments.front().start); }
+	// Why the trigger fired, and which snapshot of the dump it happened at.
+	const std::string &trigger_reason() const { return reason; }
+	uint64_t trigger_snapshot() const { return reason_snapshot; }
+
+	FlightTrigger trigger;
+
+private:
+	struct Segment
+	{
+		uint64_t start; // Position of the keyframe in the ring.
+		uint64_t instructions;
+	};
+
+	// Lets the encoder write straight into the ring.
+	struct RingOutput
+	{
+		FlightRecorder &recorder;
+		void put(const void *data, std::size_t size);
+	};
+
+	void make_room();
+	void drop_oldest();
+	template <typename Registers>
+	void check_trigger(const Registers &regs, const uint8_t *program);
+	void fire(const char *format, uint32_t value);
+
+	std::vector<uint8_t> buffer;
+	std::size_t mask;
+	uint64_t head = 0; // Bytes written since the ring was created.
+	std::deque<Segment> segments;
+	uint64_t held_instructions = 0;
+	uint64_t keep;
+	uint32_t interval;
+	TracePacketEncoder encoder;
+	uint32_t write_address = 0;
+	uint32_t write_size = 0;
+	bool triggered = false;
+	uint32_t remaining = 0;
+	std::string reason;
+	uint64_t reason_snapshot = 0;
+};
+
+inline bool FlightTrigger::parse(const std::string &text, std::string &error)
+{
+	std::stringstream stream(text);
+	std::string option;
+	while(stream >> option) {
+		std::size_t equals = option.find('=');
+		std::string key = option.substr(0, equals);
+		std::string value = equals == std::string::npos ? "" : option.substr(equals + 1);
+		std::vector<uint32_t> *list = nullptr;
+		bool valid = false;
+		if(key == "nan" && equals == std::string::npos) {
+			nan = true;
+			valid = true;
+		} else if(key == "pc") {
+			list = &pcs;
+		} else if(key == "xgkick") {
+			list = &kicks;
+		} else if(key == "store") {
+			list = &stores;
+		} else if(key == "after" && !value.empty()) {
+			char *end;
+			after = (uint32_t) strtoul(value.c_str(), &end, 0);
+			valid = *end == '\0';
+		}
+		if(list && !value.empty()) {
+			std::stringstream values(value);
+			std::string item;
+			valid = true;
+			while(std::getline(values, item, ',')) {
+				char *end;
+				list->push_back((uint32_t) strtoul(item.c_str(), &end, 0));
+				valid &= !item.empty() && *end == '\0';
+			}
+		}
+		if(!valid) {
+			error = "Bad trigger option '" + option + "'.";
+			return false;
+		}
+	}
+	return true;
+}
+
+inline FlightRecorder::FlightRecorder(std::size_t ring_size, uint64_t keep_instructions, uint32_t keyframe_interval)
+	: keep(keep_instructions)
+	, interval(std::max(keyframe_interval, 1u))
+{
+	// There always has to be room for a keyframe on top of the segment
+	// currently being recorded.
+	std::size_t size = 1;
+	while(size < std::max(ring_size, TracePacketEncoder::MAX_INSTRUCTION_SIZE * 4)) size <<= 1;
+	buffer.resize(size);
+	mask = size - 1;
+}
+
+template <typename Registers>
+bool FlightRecorder::instruction(const Registers &regs, const uint8_t *memory, const uint8_t *program)
+{
+	make_room();
+	const uint8_t *registers[TracePacketEncoder::REGISTER_COUNT];
+	TracePacketEncoder::register_pointers(registers, regs);
+	RingOutput output{*this};
+	encoder.encode(output, registers, memory, program);
+	segments.back().instructions++;
+	held_instructions++;
+
+	if(!triggered) {
+		check_trigger(regs, program);
+	} else if(remaining > 0) {
+		remaining--;
+	}
+	write_size = 0;
+	return triggered && remaining == 0;
+}
+
+inline bool FlightRecorder::dump(const std::string &path, std::string &error)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if(file == nullptr) {
+		error = "Failed to open " + path + " for writing.";
+		return false;
+	}
+	uint32_t version = TraceWriter::FORMAT_VERSION;
+	bool success = fwrite("VUTR", 4, 1, file) == 1 && fwrite(&version, 4, 1, file) == 1;
+	uint64_t position = segments.empty() ? head : segments.front().start;
+	while(success && position < head) {
+		std::size_t offset = position & mask;
+		std::size_t size = (std::size_t) std::min<uint64_t>(head - position, buffer.size() - offset);
+		success = fwrite(&buffer[offset], size, 1, file) == 1;
+		position += size;
+	}
+	success &= fclose(file) == 0;
+	if(!success) {
+		error = "Failed to write " + path + ".";
+	}
+	clear();
+	return success;
+}
+
+inline void FlightRecorder::clear()
+{
+	segments.clear();
+	held_instructions = 0;
+	triggered = false;
+	remaining = 0;
+	reason.clear();
+	reason_snapshot = 0;
+}
+
+inline void FlightRecorder::RingOutput::put(const void *data, std::size_t size)
+{
+	std::vector<uint8_t> &buffer = recorder.buffer;
+	std::size_t offset = recorder.head & recorder.mask;
+	std::size_t first = std::min(size, buffer.size() - offset);
+	memcpy(&buffer[offset], data, first);
+	memcpy(&buffer[0], (const uint8_t*) data + first, size - first);
+	recorder.head += size;
+}
+
+// Start a new segment if it's time for a keyframe, then drop the oldest
+// segments that either need to be overwritten to make room for the next
+// instruction or aren't needed to hold keep_instructions instructions.
+inline void FlightRecorder::make_room()
+{
+	auto full = [&]() {
+		return head + TracePacketEncoder::MAX_INSTRUCTION_SIZE - segments.front().start > buffer.size();
+	};
+	while(segments.size() > 1 && full()) {
+		drop_oldest();
+	}
+	// If the current segment fills the ring on its own, a new keyframe is
+	// needed so that it can be dropped.
+	if(segments.empty() || segments.back().instructions >= interval || full()) {
+		encoder.keyframe();
+		segments.push_back({head, 0});
+	}
+	while(segments.size() > 1 && full()) {
+		drop_oldest();
+	}
+	while(segments.size() > 1 && held_instructions - segments.front().instructions >= keep) {
+		drop_oldest();
+	}
+}
+
+inline void FlightRecorder::drop_oldest()
+{
+	uint64_t dropped = segments.front().instructions;
+	held_instructions -= dropped;
+	segments.pop_front();
+	// If the ring is too small to hold everything after the trigger, the
+	// instruction that fired it may be gone too.
+	reason_snapshot = reason_snapshot > dropped ? reason_snapshot - dropped : 0;
+}
+
+template <typename Registers>
+void FlightRecorder::check_trigger(const Registers &regs, const uint8_t *program)
+{
+	uint32_t pc;
+	memcpy(&pc, &regs.VI[26], 4); // TPC
+	for(uint32_t address : trigger.pcs) {
+		if(address == pc) {
+			fire("PC reached 0x%x", pc);
+			return;
+		}
+	}
+	if(!trigger.kicks.empty()) {
+		uint32_t lower;
+		memcpy(&lower, &program[pc % TracePacketEncoder::PROGRAM_SIZE], 4);
+		if((lower & 0x7ff) == 0x6fc && (lower >> 25) == 0x40) {
+			uint16_t is;
+			memcpy(&is, &regs.VI[(lower >> 11) & 0x1f], 2);
+			uint32_t address = (is * 16) % TracePacketEncoder::MEMORY_SIZE;
+			for(uint32_t kick : trigger.kicks) {
+				if(kick == address) {
+					fire("XGKICK of 0x%x", address);
+					return;
+				}
+			}
+		}
+	}
+	if(write_size > 0) {
+		for(uint32_t address : trigger.stores) {
+			if(address / 16 == write_address / 16) {
+				fire("Store to 0x%x", write_address);
+				return;
+			}
+		}
+	}
+	if(trigger.nan) {
+		uint32_t lanes[32 * 4];
+		memcpy(lanes, &regs.VF, sizeof(lanes));
+		bool found = false;
+		for(uint32_t lane : lanes) {
+			found |= (lane & 0x7f800000) == 0x7f800000;
+		}
+		if(found) {
+			fire("NaN or infinity in a VF register at PC 0x%x", pc);
+		}
+	}
+}
+
+inline void FlightRecorder::fire(const char *format, uint32_t value)
+{
+	char message[128];
+	snprintf(message, sizeof(message), format, value);
+	reason = message;
+	reason_snapshot = held_instructions - 1;
+	triggered = true;
+	remaining = trigger.after;
+}
+
+#endif
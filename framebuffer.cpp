@@ -0,0 +1,238 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "framebuffer.h"
+
+std::shared_ptr<const GsTexture> FramebufferCache::get(const std::string &path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto iter = entries.find(path);
+	if(iter != entries.end()) {
+		iter->second.last_used = ++clock;
+		return iter->second.image;
+	}
+
+	if(entries.size() >= capacity) {
+		auto oldest = entries.end();
+		for(auto entry = entries.begin(); entry != entries.end(); entry++) {
+			if(entry->second.image && (oldest == entries.end() || entry->second.last_used < oldest->second.last_used)) {
+				oldest = entry;
+			}
+		}
+		if(oldest != entries.end()) {
+			entries.erase(oldest);
+		}
+	}
+
+	entries[path].last_used = ++clock;
+	pool.submit([this, path]() {
+		std::shared_ptr<GsTexture> image = std::make_shared<GsTexture>();
+		std::string error;
+		if(!read_bmp(*image, path, error)) {
+			*image = GsTexture();
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		auto iter = entries.find(path);
+		if(iter != entries.end()) {
+			iter->second.image = image;
+			iter->second.error = error;
+		}
+	});
+	return nullptr;
+}
+
+std::string FramebufferCache::error(const std::string &path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto iter = entries.find(path);
+	return iter != entries.end() ? iter->second.error : std::string();
+}
+
+std::vector<FramebufferDump> list_framebuffer_dumps(const std::string &directory)
+{
+	std::vector<FramebufferDump> dumps;
+	std::error_code error;
+	for(const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+		std::string name = entry.path().filename().string();
+		int trace_index, buffer_index, length = 0;
+		if(sscanf(name.c_str(), "trace%d_buffer%d.bmp%n", &trace_index, &buffer_index, &length) == 2 && length == (int) name.size()) {
+			dumps.push_back({trace_index, buffer_index, entry.path().string()});
+		}
+	}
+	std::sort(dumps.begin(), dumps.end(), [](const FramebufferDump &l, const FramebufferDump &r) {
+		return l.trace_index != r.trace_index ? l.trace_index < r.trace_index : l.buffer_index < r.buffer_index;
+	});
+	return dumps;
+}
+
+// Reads uncompressed 24 or 32 bit BMP files, which is what GSdx writes.
+bool read_bmp(GsTexture &dest, const std::string &path, std::string &error)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if(file == nullptr) {
+		error = "Failed to open " + path + ".";
+		return false;
+	}
+	std::vector<u8> data;
+	fseek(file, 0, SEEK_END);
+	long file_size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if(file_size > 0) {
+		data.resize(file_size);
+		if(fread(data.data(), data.size(), 1, file) != 1) {
+			data.clear();
+		}
+	}
+	fclose(file);
+
+	auto read_u16 = [&](std::size_t offset) { u16 value; memcpy(&value, &data[offset], 2); return value; };
+	auto read_u32 = [&](std::size_t offset) { u32 value; memcpy(&value, &data[offset], 4); return value; };
+	if(data.size() < 54 || data[0] != 'B' || data[1] != 'M') {
+		error = path + " is not a BMP file.";
+		return false;
+	}
+	u32 pixel_offset = read_u32(10);
+	s32 width = (s32) read_u32(18);
+	s32 height = (s32) read_u32(22);
+	u16 bits = read_u16(28);
+	u32 compression = read_u32(30);
+	bool top_down = height < 0;
+	height = abs(height);
+	// BI_RGB or BI_BITFIELDS with the standard masks.
+	if((bits != 24 && bits != 32) || (compression != 0 && compression != 3) || width <= 0 || width > 8192 || height > 8192) {
+		error = path + " has an unsupported BMP format.";
+		return false;
+	}
+	std::size_t stride = ((std::size_t) width * (bits / 8) + 3) & ~3;
+	if(pixel_offset + stride * height > data.size()) {
+		error = path + " is truncated.";
+		return false;
+	}
+
+	dest.width = width;
+	dest.height = height;
+	dest.pixels.resize((std::size_t) width * height);
+	for(s32 y = 0; y < height; y++) {
+		const u8 *row = &data[pixel_offset + stride * (top_down ? y : height - y - 1)];
+		u32 *out = &dest.pixels[(std::size_t) y * width];
+		u32 bytes_per_pixel = bits / 8;
+		for(s32 x = 0; x < width; x++) {
+			const u8 *pixel = &row[x * bytes_per_pixel];
+			// BGR(A) to RGBA. The alpha channel holds the GS alpha value, which
+			// isn't useful for display, so the output is opaque.
+			out[x] = pixel[2] | (pixel[1] << 8) | (pixel[0] << 16) | 0xff000000;
+		}
+	}
+	return true;
+}
+
+// Frames that fail to decode are left empty and their errors are appended to
+// the errors list in order.
+void decode_framebuffers(std::vector<GsTexture> &dest, std::vector<std::string> &errors, const std::vector<FramebufferDump> &dumps, ThreadPool &pool)
+{
+	dest.clear();
+	dest.resize(dumps.size());
+	std::vector<std::string> frame_errors(dumps.size());
+	for(std::size_t i = 0; i < dumps.size(); i++) {
+		pool.submit([&dest, &frame_errors, &dumps, i]() {
+			if(!read_bmp(dest[i], dumps[i].path, frame_errors[i])) {
+				dest[i] = GsTexture();
+			}
+		});
+	}
+	pool.wait();
+	for(std::string &error : frame_errors) {
+		if(!error.empty()) {
+			errors.push_back(std::move(error));
+		}
+	}
+}
+
+// Arrange the frames in a grid, each one shrunk by the given factor.
+bool build_contact_sheet(GsTexture &dest, std::vector<std::string> &errors, const std::vector<FramebufferDump> &dumps, int columns, int scale, ThreadPool &pool)
+{
+	if(dumps.empty() || columns < 1 || scale < 1) {
+		return false;
+	}
+	std::vector<GsTexture> frames;
+	decode_framebuffers(frames, errors, dumps, pool);
+
+	int cell_width = 1, cell_height = 1;
+	for(const GsTexture &frame : frames) {
+		cell_width = std::max(cell_width, frame.width / scale);
+		cell_height = std::max(cell_height, frame.height / scale);
+	}
+	int rows = ((int) frames.size() + columns - 1) / columns;
+	dest.width = cell_width * std::min(columns, (int) frames.size());
+	dest.height = cell_height * rows;
+	dest.pixels.assign((std::size_t) dest.width * dest.height, 0xff000000);
+	for(std::size_t i = 0; i < frames.size(); i++) {
+		const GsTexture &frame = frames[i];
+		int left = (int) (i % columns) * cell_width;
+		int top = (int) (i / columns) * cell_height;
+		for(int y = 0; y < frame.height / scale; y++) {
+			for(int x = 0; x < frame.width / scale; x++) {
+				dest.pixels[(std::size_t) (top + y) * dest.width + left + x] =
+					frame.pixels[(std::size_t) y * scale * frame.width + x * scale];
+			}
+		}
+	}
+	return true;
+}
+
+// Write the frames as an uncompressed YUV4MPEG2 stream, which ffmpeg and
+// most other video tools can read from a pipe. Every frame is cropped or
+// padded to the size of the first one. Frames are decoded a batch at a time
+// so memory usage doesn't depend on the number of frames.
+bool write_y4m(FILE *file, std::vector<std::string> &errors, const std::vector<FramebufferDump> &dumps, int fps, ThreadPool &pool)
+{
+	std::size_t batch_size = pool.thread_count() * 2;
+	std::vector<GsTexture> frames;
+	int width = 0, height = 0;
+	std::vector<u8> planes;
+	for(std::size_t batch = 0; batch < dumps.size(); batch += batch_size) {
+		std::vector<FramebufferDump> batch_dumps(dumps.begin() + batch, dumps.begin() + std::min(batch + batch_size, dumps.size()));
+		decode_framebuffers(frames, errors, batch_dumps, pool);
+		for(const GsTexture &frame : frames) {
+			if(width == 0) {
+				if(frame.width == 0) continue;
+				width = frame.width;
+				height = frame.height;
+				fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+				planes.resize((std::size_t) width * height * 3);
+			}
+			std::size_t plane_size = (std::size_t) width * height;
+			for(int y = 0; y < height; y++) {
+				for(int x = 0; x < width; x++) {
+					u32 pixel = (x < frame.width && y < frame.height) ? frame.pixels[(std::size_t) y * frame.width + x] : 0;
+					int r = pixel & 0xff, g = (pixel >> 8) & 0xff, b = (pixel >> 16) & 0xff;
+					// BT.601 limited range.
+					std::size_t i = (std::size_t) y * width + x;
+					planes[i] = (u8) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+					planes[plane_size + i] = (u8) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+					planes[plane_size * 2 + i] = (u8) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+				}
+			}
+			fputs("FRAME\n", file);
+			if(fwrite(planes.data(), planes.size(), 1, file) != 1) {
+				return false;
+			}
+		}
+	}
+	return width != 0;
+}
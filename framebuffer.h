@@ -0,0 +1,80 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pcsx2defs.h"
+#include "gstexture.h"
+#include "threadpool.h"
+
+// The patched GSdx dumps the framebuffer after every draw to
+// traceNNNNNN_bufferN.bmp, where N counts the draws since the trace started.
+struct FramebufferDump
+{
+	int trace_index;
+	int buffer_index;
+	std::string path;
+};
+
+// Decodes dumps on background threads and keeps the most recently used ones.
+class FramebufferCache
+{
+public:
+	explicit FramebufferCache(std::size_t capacity = 32) : capacity(capacity), pool(2) {}
+
+	// Returns the decoded image if it's ready, otherwise queues it to be
+	// decoded and returns nullptr. Images that failed to decode are returned
+	// with a width of zero.
+	std::shared_ptr<const GsTexture> get(const std::string &path);
+	// Returns why the given image failed to decode.
+	std::string error(const std::string &path);
+
+private:
+	struct Entry
+	{
+		std::shared_ptr<const GsTexture> image;
+		std::string error;
+		u64 last_used = 0;
+	};
+
+	std::mutex mutex;
+	std::map<std::string, Entry> entries;
+	std::size_t capacity;
+	u64 clock = 0;
+	ThreadPool pool; // Must be destroyed first since the jobs use the map.
+};
+
+std::vector<FramebufferDump> list_framebuffer_dumps(const std::string &directory);
+bool read_bmp(GsTexture &dest, const std::string &path, std::string &error);
+void decode_framebuffers(std::vector<GsTexture> &dest, std::vector<std::string> &errors, const std::vector<FramebufferDump> &dumps, ThreadPool &pool);
+bool build_contact_sheet(GsTexture &dest, std::vector<std::string> &errors, const std::vector<FramebufferDump> &dumps, int columns, int scale, ThreadPool &pool);
+bool write_y4m(FILE *file, std::vector<std::string> &errors, const std::vector<FramebufferDump> &dumps, int fps, ThreadPool &pool);
+
+#endif
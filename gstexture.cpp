@@ -0,0 +1,373 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "gstexture.h"
+
+GsImageInfo read_image_info(const GsTransferRegisters &regs)
+{
+	GsImageInfo info;
+	info.dbp = bit_range64(regs.bitbltbuf, 32, 45);
+	info.dbw = bit_range64(regs.bitbltbuf, 48, 53);
+	info.dpsm = (GsPixelFormat) bit_range64(regs.bitbltbuf, 56, 61);
+	info.dsax = bit_range64(regs.trxpos, 32, 42);
+	info.dsay = bit_range64(regs.trxpos, 48, 58);
+	info.rrw = bit_range64(regs.trxreg, 0, 11);
+	info.rrh = bit_range64(regs.trxreg, 32, 43);
+	info.xdir = bit_range64(regs.trxdir, 0, 1);
+	return info;
+}
+
+GsClutInfo read_clut_info(u64 tex0, u64 texclut)
+{
+	GsClutInfo info;
+	info.cbp = bit_range64(tex0, 37, 50);
+	info.cpsm = (GsPixelFormat) bit_range64(tex0, 51, 54);
+	info.csm = bit_range64(tex0, 55, 55);
+	info.cbw = bit_range64(texclut, 0, 5);
+	info.cou = bit_range64(texclut, 6, 11);
+	info.cov = bit_range64(texclut, 12, 21);
+	return info;
+}
+
+bool is_indexed_format(GsPixelFormat psm)
+{
+	switch(psm) {
+		case GSPSM_T8: case GSPSM_T8H:
+		case GSPSM_T4: case GSPSM_T4HL: case GSPSM_T4HH:
+			return true;
+		default:
+			return false;
+	}
+}
+
+int bits_per_pixel(GsPixelFormat psm)
+{
+	switch(psm) {
+		case GSPSM_CT32: return 32;
+		case GSPSM_CT24: return 24;
+		case GSPSM_CT16: case GSPSM_CT16S: return 16;
+		case GSPSM_T8: case GSPSM_T8H: return 8;
+		case GSPSM_T4: case GSPSM_T4HL: case GSPSM_T4HH: return 4;
+		default: return 0;
+	}
+}
+
+const char *gs_pixel_format_name(GsPixelFormat psm)
+{
+	switch(psm) {
+		case GSPSM_CT32: return "PSMCT32";
+		case GSPSM_CT24: return "PSMCT24";
+		case GSPSM_CT16: return "PSMCT16";
+		case GSPSM_CT16S: return "PSMCT16S";
+		case GSPSM_T8: return "PSMT8";
+		case GSPSM_T4: return "PSMT4";
+		case GSPSM_T8H: return "PSMT8H";
+		case GSPSM_T4HL: return "PSMT4HL";
+		case GSPSM_T4HH: return "PSMT4HH";
+		default: return "ERR";
+	}
+}
+
+// Find the IMAGE primitive in the same packet that uploads the CLUT for the
+// given indexed image. The TEX0 register that references the CLUT is usually
+// written after both uploads, so the whole packet is searched for it.
+const GsPrimitive *find_clut(const GsPacket &packet, const GsPrimitive &image, GsClutInfo &clut)
+{
+	GsImageInfo info = read_image_info(image.image.registers);
+
+	u64 tex0 = 0;
+	u64 texclut = image.image.registers.texclut;
+	for(const GsPrimitive &prim : packet.primitives) {
+		for(const GsPackedData &item : prim.packed_data) {
+			if(item.reg != GSREG_AD) continue;
+			if(item.ad.addr == GIF_A_D_REG_TEXCLUT) {
+				texclut = item.ad.data;
+			}
+			if(item.ad.addr != GIF_A_D_REG_TEX0_1 && item.ad.addr != GIF_A_D_REG_TEX0_2) continue;
+			GsPixelFormat psm = (GsPixelFormat) bit_range64(item.ad.data, 20, 25);
+			int tbp0 = bit_range64(item.ad.data, 0, 13);
+			if(is_indexed_format(psm) && (tex0 == 0 || tbp0 == info.dbp)) {
+				tex0 = item.ad.data;
+			}
+		}
+	}
+	clut = read_clut_info(tex0, texclut);
+
+	const GsPrimitive *fallback = nullptr;
+	for(const GsPrimitive &prim : packet.primitives) {
+		if(prim.tag.flag != GIFFLAG_IMAGE || &prim == &image) continue;
+		GsImageInfo candidate = read_image_info(prim.image.registers);
+		if(is_indexed_format(candidate.dpsm)) continue;
+		if(tex0 != 0 && candidate.dbp == clut.cbp) {
+			return &prim;
+		}
+		// Without a TEX0, guess based on the usual CLUT dimensions.
+		bool is_t4_clut = candidate.rrw == 8 && candidate.rrh == 2;
+		bool is_t8_clut = candidate.rrw == 16 && candidate.rrh == 16;
+		if(fallback == nullptr && (bits_per_pixel(info.dpsm) == 4 ? is_t4_clut : is_t8_clut)) {
+			fallback = &prim;
+		}
+	}
+	if(fallback && tex0 == 0) {
+		clut.cpsm = read_image_info(fallback->image.registers).dpsm;
+		clut.csm = 0;
+	}
+	return fallback;
+}
+
+bool decode_gs_image(GsTexture &dest, const GsPacket &packet, const GsPrimitive &image)
+{
+	GsImageInfo info = read_image_info(image.image.registers);
+	int bpp = bits_per_pixel(info.dpsm);
+	if(bpp == 0 || info.rrw == 0 || info.xdir != 0) {
+		return false;
+	}
+
+	// A transfer may be split over multiple IMAGE primitives, so only decode
+	// the rows that are actually present.
+	size_t row_bits = (size_t) info.rrw * bpp;
+	size_t rows = (image.image.data.size() * 8) / row_bits;
+	if(rows > (size_t) info.rrh) rows = info.rrh;
+	if(rows == 0) {
+		return false;
+	}
+
+	dest.width = info.rrw;
+	dest.height = (int) rows;
+	dest.pixels.resize((size_t) dest.width * dest.height);
+	size_t count = dest.pixels.size();
+	const u8 *src = image.image.data.data();
+
+	switch(info.dpsm) {
+		case GSPSM_CT32: decode_ct32(dest.pixels.data(), src, count); return true;
+		case GSPSM_CT24: decode_ct24(dest.pixels.data(), src, count); return true;
+		case GSPSM_CT16:
+		case GSPSM_CT16S: decode_ct16(dest.pixels.data(), src, count); return true;
+		default: {}
+	}
+
+	// Indexed formats. Fall back to a greyscale ramp if there's no CLUT.
+	u32 palette[256];
+	int entries = bpp == 4 ? 16 : 256;
+	for(int i = 0; i < entries; i++) {
+		u32 grey = (i * 255) / (entries - 1);
+		palette[i] = grey | (grey << 8) | (grey << 16) | 0xff000000;
+	}
+
+	GsClutInfo clut;
+	const GsPrimitive *clut_prim = find_clut(packet, image, clut);
+	if(clut_prim) {
+		GsTexture clut_texture;
+		GsImageInfo clut_info = read_image_info(clut_prim->image.registers);
+		if(decode_gs_image(clut_texture, packet, *clut_prim)) {
+			for(int i = 0; i < entries; i++) {
+				size_t index;
+				if(clut.csm == 0) {
+					// CSM1: Entries 8-15 and 16-23 of each block of 32 are swapped
+					// for 256 colour CLUTs stored as PSMCT32.
+					index = i;
+					if(entries == 256 && clut.cpsm == GSPSM_CT32) {
+						index = (i & ~0x18) | ((i & 0x08) << 1) | ((i & 0x10) >> 1);
+					}
+				} else {
+					// CSM2: The CLUT is a single row at (COU * 16, COV).
+					int x = clut.cou * 16 + i - clut_info.dsax;
+					int y = clut.cov - clut_info.dsay;
+					if(x < 0 || y < 0 || x >= clut_texture.width) continue;
+					index = (size_t) y * clut_texture.width + x;
+				}
+				if(index < clut_texture.pixels.size()) {
+					palette[i] = clut_texture.pixels[index];
+				}
+			}
+		}
+	}
+
+	if(bpp == 8) {
+		decode_t8(dest.pixels.data(), src, count, palette);
+	} else {
+		decode_t4(dest.pixels.data(), src, count, palette);
+	}
+	return true;
+}
+
+// The pixel loops below are written without branches so that the compiler
+// can vectorise them. GS alpha values are in the range 0-0x80, so they're
+// rescaled to 0-0xff.
+
+void decode_ct32(u32 *dest, const u8 *src, size_t count)
+{
+	for(size_t i = 0; i < count; i++) {
+		u32 pixel;
+		memcpy(&pixel, &src[i * 4], 4);
+		u32 alpha = (pixel >> 24) * 2;
+		alpha = alpha > 0xff ? 0xff : alpha;
+		dest[i] = (pixel & 0x00ffffff) | (alpha << 24);
+	}
+}
+
+void decode_ct24(u32 *dest, const u8 *src, size_t count)
+{
+	for(size_t i = 0; i < count; i++) {
+		const u8 *p = &src[i * 3];
+		dest[i] = p[0] | (p[1] << 8) | (p[2] << 16) | 0xff000000;
+	}
+}
+
+void decode_ct16(u32 *dest, const u8 *src, size_t count)
+{
+	for(size_t i = 0; i < count; i++) {
+		u32 pixel = src[i * 2] | (src[i * 2 + 1] << 8);
+		u32 r = (pixel & 0x1f) << 3;
+		u32 g = ((pixel >> 5) & 0x1f) << 3;
+		u32 b = ((pixel >> 10) & 0x1f) << 3;
+		u32 a = (pixel >> 15) * 0xff;
+		dest[i] = r | (g << 8) | (b << 16) | (a << 24);
+	}
+}
+
+void decode_t8(u32 *dest, const u8 *src, size_t count, const u32 *palette)
+{
+	for(size_t i = 0; i < count; i++) {
+		dest[i] = palette[src[i]];
+	}
+}
+
+void decode_t4(u32 *dest, const u8 *src, size_t count, const u32 *palette)
+{
+	// The low nibble is the leftmost pixel.
+	for(size_t i = 0; i < count / 2; i++) {
+		dest[i * 2 + 0] = palette[src[i] & 0xf];
+		dest[i * 2 + 1] = palette[src[i] >> 4];
+	}
+	if(count % 2 == 1) {
+		dest[count - 1] = palette[src[count / 2] & 0xf];
+	}
+}
+
+bool write_ppm(const std::string &path, const GsTexture &texture)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if(file == nullptr) {
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", texture.width, texture.height);
+	std::vector<u8> row(texture.width * 3);
+	for(int y = 0; y < texture.height; y++) {
+		for(int x = 0; x < texture.width; x++) {
+			u32 pixel = texture.pixels[y * texture.width + x];
+			row[x * 3 + 0] = pixel & 0xff;
+			row[x * 3 + 1] = (pixel >> 8) & 0xff;
+			row[x * 3 + 2] = (pixel >> 16) & 0xff;
+		}
+		fwrite(row.data(), row.size(), 1, file);
+	}
+	fclose(file);
+	return true;
+}
+
+static u32 png_crc(const u8 *data, size_t size, u32 crc = 0xffffffff)
+{
+	static u32 table[256];
+	static bool table_built = false;
+	if(!table_built) {
+		for(u32 i = 0; i < 256; i++) {
+			u32 c = i;
+			for(int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			}
+			table[i] = c;
+		}
+		table_built = true;
+	}
+	for(size_t i = 0; i < size; i++) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void png_write_chunk(FILE *file, const char *type, const std::vector<u8> &data)
+{
+	u8 size_be[4] = {
+		(u8) (data.size() >> 24), (u8) (data.size() >> 16), (u8) (data.size() >> 8), (u8) data.size()
+	};
+	fwrite(size_be, 4, 1, file);
+	std::vector<u8> body(type, type + 4);
+	body.insert(body.end(), data.begin(), data.end());
+	fwrite(body.data(), body.size(), 1, file);
+	u32 crc = png_crc(body.data(), body.size()) ^ 0xffffffff;
+	u8 crc_be[4] = { (u8) (crc >> 24), (u8) (crc >> 16), (u8) (crc >> 8), (u8) crc };
+	fwrite(crc_be, 4, 1, file);
+}
+
+// Writes an RGBA PNG using uncompressed deflate blocks so we don't need zlib.
+bool write_png(const std::string &path, const GsTexture &texture)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if(file == nullptr) {
+		return false;
+	}
+
+	static const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite(signature, 8, 1, file);
+
+	auto push_be32 = [](std::vector<u8> &dest, u32 value) {
+		dest.push_back(value >> 24);
+		dest.push_back(value >> 16);
+		dest.push_back(value >> 8);
+		dest.push_back(value);
+	};
+
+	std::vector<u8> ihdr;
+	push_be32(ihdr, texture.width);
+	push_be32(ihdr, texture.height);
+	ihdr.insert(ihdr.end(), { 8, 6, 0, 0, 0 }); // 8-bit RGBA, no interlacing.
+	png_write_chunk(file, "IHDR", ihdr);
+
+	std::vector<u8> raw;
+	raw.reserve((texture.width * 4 + 1) * texture.height);
+	for(int y = 0; y < texture.height; y++) {
+		raw.push_back(0); // No filter.
+		const u8 *row = (const u8*) &texture.pixels[y * texture.width];
+		raw.insert(raw.end(), row, row + texture.width * 4);
+	}
+
+	std::vector<u8> idat = { 0x78, 0x01 };
+	for(size_t pos = 0; pos < raw.size() || pos == 0; pos += 0xffff) {
+		size_t block_size = std::min<size_t>(raw.size() - pos, 0xffff);
+		bool is_last = pos + block_size >= raw.size();
+		idat.push_back(is_last);
+		idat.push_back(block_size & 0xff);
+		idat.push_back(block_size >> 8);
+		idat.push_back(~block_size & 0xff);
+		idat.push_back((~block_size >> 8) & 0xff);
+		idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + block_size);
+		if(is_last) break;
+	}
+	u32 a = 1, b = 0;
+	for(u8 byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	push_be32(idat, (b << 16) | a);
+	png_write_chunk(file, "IDAT", idat);
+
+	png_write_chunk(file, "IEND", {});
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,91 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef GSTEXTURE_H
+#define GSTEXTURE_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdio.h>
+
+#include "pcsx2defs.h"
+#include "gif.h"
+
+enum GsPixelFormat
+{
+	GSPSM_CT32  = 0x00,
+	GSPSM_CT24  = 0x01,
+	GSPSM_CT16  = 0x02,
+	GSPSM_CT16S = 0x0a,
+	GSPSM_T8    = 0x13,
+	GSPSM_T4    = 0x14,
+	GSPSM_T8H   = 0x1b,
+	GSPSM_T4HL  = 0x24,
+	GSPSM_T4HH  = 0x2c
+};
+
+// Decoded fields of the registers that describe a host to local transfer.
+struct GsImageInfo
+{
+	int dbp;
+	int dbw;
+	GsPixelFormat dpsm;
+	int dsax;
+	int dsay;
+	int rrw;
+	int rrh;
+	int xdir;
+};
+
+// The subset of TEX0 and TEXCLUT needed to find and index a CLUT.
+struct GsClutInfo
+{
+	int cbp;
+	GsPixelFormat cpsm;
+	int csm;
+	int cbw;
+	int cou;
+	int cov;
+};
+
+// RGBA8 pixels, red in the least significant byte, ready for glTexImage2D.
+struct GsTexture
+{
+	int width = 0;
+	int height = 0;
+	std::vector<u32> pixels;
+};
+
+GsImageInfo read_image_info(const GsTransferRegisters &regs);
+GsClutInfo read_clut_info(u64 tex0, u64 texclut);
+bool is_indexed_format(GsPixelFormat psm);
+int bits_per_pixel(GsPixelFormat psm);
+const char *gs_pixel_format_name(GsPixelFormat psm);
+const GsPrimitive *find_clut(const GsPacket &packet, const GsPrimitive &image, GsClutInfo &clut);
+bool decode_gs_image(GsTexture &dest, const GsPacket &packet, const GsPrimitive &image);
+void decode_ct32(u32 *dest, const u8 *src, size_t count);
+void decode_ct24(u32 *dest, const u8 *src, size_t count);
+void decode_ct16(u32 *dest, const u8 *src, size_t count);
+void decode_t8(u32 *dest, const u8 *src, size_t count, const u32 *palette);
+void decode_t4(u32 *dest, const u8 *src, size_t count, const u32 *palette);
+bool write_ppm(const std::string &path, const GsTexture &texture);
+bool write_png(const std::string &path, const GsTexture &texture);
+
+#endif
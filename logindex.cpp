@@ -0,0 +1,231 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "logindex.h"
+
+#include <algorithm>
+
+bool LogIndex::open(const std::string &log_path)
+{
+	path = log_path;
+	entries.clear();
+	sections.clear();
+	if(!file.open(log_path)) {
+		error = file.error;
+		return false;
+	}
+
+	sections.push_back({INT_MIN, 0, 0});
+	const char *begin = (const char*) file.data();
+	const char *end = begin + file.size();
+	for(const char *line = begin; line < end;) {
+		const char *line_end = (const char*) memchr(line, '\n', end - line);
+		if(line_end == nullptr) {
+			line_end = end;
+		}
+		parse_line(line, line_end, line - begin);
+		line = line_end + 1;
+	}
+	sections.back().end_entry = (u32) entries.size();
+	if(sections.back().trace_index == INT_MIN) {
+		// Lines after the last marker don't lead into any trace.
+		sections.back().trace_index = sections.size() >= 2 ? sections[sections.size() - 2].trace_index + 1 : -1;
+	}
+	build_address_tables();
+	return true;
+}
+
+// Parse a number following the given key e.g. "madr=1234" or "madr = 0x1234".
+// Returns false if the key isn't present.
+bool parse_log_field(const char *line, const char *end, const char *key, int base, u32 &dest)
+{
+	std::string_view haystack(line, end - line);
+	std::size_t pos = haystack.find(key);
+	if(pos == std::string_view::npos) {
+		return false;
+	}
+	const char *p = line + pos + strlen(key);
+	while(p < end && (*p == ' ' || *p == '=' || *p == ':')) p++;
+	if(base == 16 && end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) p += 2;
+	// The line isn't null terminated so strtoul can't be used here.
+	u32 value = 0;
+	const char *digits = p;
+	for(; p < end; p++) {
+		int digit;
+		if(*p >= '0' && *p <= '9') digit = *p - '0';
+		else if(base == 16 && *p >= 'a' && *p <= 'f') digit = *p - 'a' + 10;
+		else if(base == 16 && *p >= 'A' && *p <= 'F') digit = *p - 'A' + 10;
+		else break;
+		value = value * base + digit;
+	}
+	if(p == digits) {
+		return false;
+	}
+	dest = value;
+	return true;
+}
+
+bool log_line_starts_with(const char *line, const char *end, const char *prefix, std::size_t size)
+{
+	return (std::size_t) (end - line) >= size && memcmp(line, prefix, size) == 0;
+}
+
+void LogIndex::parse_line(const char *line, const char *end, u64 offset)
+{
+	if(end > line && end[-1] == '\r') {
+		end--;
+	}
+	if(line == end) {
+		return;
+	}
+
+	LogEntry entry;
+	entry.offset = offset;
+	entry.length = (u32) (end - line);
+	entry.section = (u32) sections.size() - 1;
+
+	if(log_line_starts_with(line, end, "[VUTrace] ", 10)) {
+		// e.g. "[VUTrace] **** Tracing to vutrace_output/trace000123.bin ****"
+		std::string_view text(line, end - line);
+		std::size_t pos = text.rfind("trace");
+		if(text.find("Tracing to") != std::string_view::npos && pos != std::string_view::npos) {
+			int index = atoi(std::string(text.substr(pos + 5, 8)).c_str());
+			sections.back().trace_index = index;
+			sections.back().end_entry = (u32) entries.size();
+			sections.push_back({INT_MIN, (u32) entries.size(), 0});
+		}
+		return;
+	} else if(log_line_starts_with(line, end, "[DMA] ", 6)) {
+		entry.type = LOG_DMA;
+		parse_log_field(line, end, "madr", 16, entry.address);
+		parse_log_field(line, end, "tadr", 16, entry.tadr);
+		if(parse_log_field(line, end, "qwc", 16, entry.size)) entry.size *= 16;
+	} else if(log_line_starts_with(line, end, "[VIF] ", 6)) {
+		u32 command;
+		if(parse_log_field(line, end, "New VifCMD", 16, command)) {
+			entry.type = LOG_VIF_CODE;
+			entry.vif_command = (u8) command;
+		} else {
+			entry.type = LOG_DMA;
+			parse_log_field(line, end, "madr", 16, entry.address);
+			parse_log_field(line, end, "tadr", 16, entry.tadr);
+			if(parse_log_field(line, end, "size", 10, entry.size)) entry.size *= 16;
+		}
+	} else if(log_line_starts_with(line, end, "[VifCode] ", 10)) {
+		// e.g. "Unpack V4_32 (unmasked) @ 0x0120 (cl=4  wl=4  num=0x10)"
+		entry.type = LOG_VIF_CODE;
+		u32 num;
+		if(log_line_starts_with(line + 10, end, "Unpack", 6) && parse_log_field(line, end, "@", 16, entry.address)) {
+			entry.type = LOG_UNPACK;
+			entry.vif_command = VIF_UNPACK;
+			if(parse_log_field(line, end, "num", 16, num)) {
+				entry.size = (num == 0 ? 256 : num) * 16;
+			}
+		}
+	} else if(!entries.empty() && entries.back().offset + entries.back().length + 1 >= offset) {
+		// Some of PCSX2's log messages contain newlines, so lines without a
+		// prefix are treated as a continuation of the previous entry.
+		LogEntry &last = entries.back();
+		if(last.type == LOG_DMA) {
+			parse_log_field(line, end, "tadr", 16, last.tadr);
+		}
+		last.length = (u32) (offset + (end - line) - last.offset);
+		return;
+	} else {
+		entry.type = LOG_OTHER;
+	}
+	entries.push_back(entry);
+}
+
+std::string_view LogIndex::text(const LogEntry &entry) const
+{
+	return std::string_view((const char*) file.data() + entry.offset, entry.length);
+}
+
+const LogSection *LogIndex::find_section(int trace_index) const
+{
+	for(const LogSection &section : sections) {
+		if(section.trace_index == trace_index) {
+			return &section;
+		}
+	}
+	return nullptr;
+}
+
+std::vector<u32> LogIndex::search(u32 address, LogEntryType type) const
+{
+	std::vector<u32> results;
+	// Only entries that start at most max_size bytes before the address can
+	// overlap it.
+	const std::vector<std::pair<u32, u32>> &table = by_address[type];
+	u32 low = address >= max_size[type] ? address - max_size[type] + 1 : 0;
+	auto begin = std::lower_bound(table.begin(), table.end(), std::make_pair(low, 0u));
+	auto end = std::upper_bound(begin, table.end(), std::make_pair(address, UINT32_MAX));
+	for(auto iter = begin; iter < end; iter++) {
+		const LogEntry &entry = entries[iter->second];
+		u32 size = entry.size > 0 ? entry.size : 16;
+		if(address - entry.address < size) {
+			results.push_back(iter->second);
+		}
+	}
+	if(type == LOG_DMA && address != 0) {
+		auto first = std::lower_bound(by_tadr.begin(), by_tadr.end(), std::make_pair(address, 0u));
+		auto last = std::upper_bound(first, by_tadr.end(), std::make_pair(address, UINT32_MAX));
+		for(auto iter = first; iter < last; iter++) {
+			results.push_back(iter->second);
+		}
+	}
+	// Keep the results in the order they appear in the log.
+	std::sort(results.begin(), results.end());
+	results.erase(std::unique(results.begin(), results.end()), results.end());
+	return results;
+}
+
+void LogIndex::build_address_tables()
+{
+	for(auto &table : by_address) {
+		table.clear();
+	}
+	std::fill(std::begin(max_size), std::end(max_size), 0);
+	by_tadr.clear();
+	for(u32 i = 0; i < (u32) entries.size(); i++) {
+		const LogEntry &entry = entries[i];
+		by_address[entry.type].emplace_back(entry.address, i);
+		max_size[entry.type] = std::max(max_size[entry.type], entry.size > 0 ? entry.size : 16);
+		if(entry.type == LOG_DMA && entry.tadr != 0) {
+			by_tadr.emplace_back(entry.tadr, i);
+		}
+	}
+	for(auto &table : by_address) {
+		std::sort(table.begin(), table.end());
+	}
+	std::sort(by_tadr.begin(), by_tadr.end());
+}
+
+// The capture patch writes LOG.txt, but older versions used _log.txt.
+std::string find_log_file(const std::string &directory)
+{
+	for(const char *name : {"LOG.txt", "_log.txt", "log.txt"}) {
+		std::filesystem::path path = std::filesystem::path(directory) / name;
+		std::error_code error;
+		if(std::filesystem::is_regular_file(path, error)) {
+			return path.string();
+		}
+	}
+	return "";
+}
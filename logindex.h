@@ -0,0 +1,104 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <string>
+#include <vector>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+#include <utility>
+#include <stdlib.h>
+
+#include "pcsx2defs.h"
+#include "mappedfile.h"
+#include "vif.h"
+
+enum LogEntryType : u8
+{
+	LOG_DMA,      // [DMA] lines and VIF1 DMA tags.
+	LOG_VIF_CODE, // A VIF command being processed.
+	LOG_UNPACK,   // An UNPACK command, with its destination in VU memory.
+	LOG_OTHER
+};
+
+struct LogEntry
+{
+	u64 offset; // Position of the line in the log file.
+	u32 length;
+	u32 section;
+	LogEntryType type;
+	u8 vif_command = 0;
+	u32 address = 0; // MADR for DMA entries, the destination for UNPACKs.
+	u32 size = 0;    // Bytes transferred, if known.
+	u32 tadr = 0;
+};
+
+// The lines of the log between two "Tracing to" markers. The capture patch
+// starts a new trace each time a microprogram is called, so these are the
+// DMA transfers and VIF commands leading up to the call that began the trace
+// with trace_index.
+struct LogSection
+{
+	int trace_index;
+	u32 first_entry;
+	u32 end_entry;
+};
+
+// An index of the LOG.txt file written by the capture patch. The file is
+// memory mapped and kept open so the text of each line can be shown without
+// storing a copy of it.
+class LogIndex
+{
+public:
+	bool open(const std::string &path);
+
+	std::string_view text(const LogEntry &entry) const;
+	int trace_index(const LogEntry &entry) const { return sections[entry.section].trace_index; }
+	const LogSection *find_section(int trace_index) const;
+	// Find all the entries of a given type that reference an address i.e.
+	// DMA transfers from EE memory (LOG_DMA) or UNPACKs into VU memory
+	// (LOG_UNPACK) that overlap it.
+	std::vector<u32> search(u32 address, LogEntryType type) const;
+
+	std::string path;
+	std::vector<LogEntry> entries;
+	std::vector<LogSection> sections;
+	std::string error;
+
+private:
+	void parse_line(const char *line, const char *end, u64 offset);
+	void build_address_tables();
+
+	MappedFile file;
+	// (address, entry) pairs for each type of entry sorted by address, so
+	// that search can find the entries near an address by binary search.
+	std::vector<std::pair<u32, u32>> by_address[LOG_OTHER + 1];
+	u32 max_size[LOG_OTHER + 1] = {};
+	// (tadr, entry) pairs for the DMA entries that have one.
+	std::vector<std::pair<u32, u32>> by_tadr;
+};
+
+bool parse_log_field(const char *line, const char *end, const char *key, int base, u32 &dest);
+bool log_line_starts_with(const char *line, const char *end, const char *prefix, std::size_t size);
+std::string find_log_file(const std::string &directory);
+
+#endif
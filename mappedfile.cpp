@@ -0,0 +1,97 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "mappedfile.h"
+
+bool MappedFile::open(const std::string &path)
+{
+	close();
+	error.clear();
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(file == INVALID_HANDLE_VALUE) {
+		error = "Failed to open " + path + ".";
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if(!GetFileSizeEx(file, &file_size)) {
+		error = "Failed to get the size of " + path + ".";
+		close();
+		return false;
+	}
+	length = (std::size_t) file_size.QuadPart;
+	if(length == 0) {
+		return true;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mapping == nullptr) {
+		error = "Failed to map " + path + ".";
+		close();
+		return false;
+	}
+	begin = (const u8*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if(begin == nullptr) {
+		error = "Failed to map " + path + ".";
+		close();
+		return false;
+	}
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd == -1) {
+		error = "Failed to open " + path + ".";
+		return false;
+	}
+	struct stat info;
+	if(fstat(fd, &info) != 0) {
+		error = "Failed to get the size of " + path + ".";
+		::close(fd);
+		return false;
+	}
+	length = (std::size_t) info.st_size;
+	if(length == 0) {
+		::close(fd);
+		return true;
+	}
+	void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(address == MAP_FAILED) {
+		error = "Failed to map " + path + ".";
+		length = 0;
+		return false;
+	}
+	madvise(address, length, MADV_SEQUENTIAL);
+	begin = (const u8*) address;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if(begin) UnmapViewOfFile(begin);
+	if(mapping) CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if(begin) munmap((void*) begin, length);
+#endif
+	begin = nullptr;
+	length = 0;
+}
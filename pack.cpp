@@ -0,0 +1,117 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Packs the traces of a capture session into a single session container,
+// see sessioncontainer.h, and lists what's in one.
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <filesystem>
+#include <stdio.h>
+
+#include "session.h"
+#include "sessioncontainer.h"
+
+static int list_container(const std::string &path)
+{
+	SessionContainer container;
+	std::string error;
+	if(!read_session_container(container, path, error)) {
+		fprintf(stderr, "Error: %s\n", error.c_str());
+		return 1;
+	}
+	printf("%-8s %-24s %12s %8s %16s %6s %12s\n", "Index", "Name", "Instructions", "Kicks", "Program", "Entry", "Size");
+	for(std::size_t i = 0; i < container.traces.size(); i++) {
+		const ContainerTrace &trace = container.traces[i];
+		printf("%-8zu %-24s %12llu %8llu %016llx %6x %12llu\n", i, trace.name.c_str(),
+			(unsigned long long) trace.snapshot_count, (unsigned long long) trace.kick_count,
+			(unsigned long long) trace.program_hash, trace.entry_pc, (unsigned long long) trace.size);
+	}
+	printf("%zu traces, %zu distinct programs, %.1f MB\n", container.traces.size(),
+		container.program_hashes.size(), container.file_size / (1024.0 * 1024.0));
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	std::string output_path;
+	std::string list_path;
+	std::vector<std::string> inputs;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			output_path = argv[++i];
+		} else if(strcmp(argv[i], "--list") == 0 && i + 1 < argc) {
+			list_path = argv[++i];
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if(!list_path.empty() && output_path.empty() && inputs.empty()) {
+		return list_container(list_path);
+	}
+	if(output_path.empty() || inputs.empty()) {
+		fprintf(stderr, "usage: %s --output <session container> <trace files or vutrace_output directories...>\n", argv[0]);
+		fprintf(stderr, "       %s --list <session container>\n", argv[0]);
+		fprintf(stderr, "The traces are appended to the container, which is created if it doesn't\n");
+		fprintf(stderr, "exist. The traces in a directory are added in order of their number. Trace\n");
+		fprintf(stderr, "N of the container can then be opened by any of the tools as <container>#N.\n");
+		return 1;
+	}
+
+	// Each trace is added under its file name, so the log and framebuffer
+	// dumps can still be matched up with it by number.
+	std::vector<std::pair<std::string, std::string>> traces;
+	for(const std::string &input : inputs) {
+		if(!std::filesystem::is_directory(input)) {
+			traces.emplace_back(input, std::filesystem::path(input).filename().string());
+			continue;
+		}
+		Session session;
+		if(!open_session(session, input)) {
+			fprintf(stderr, "Error: Failed to open %s.\n", input.c_str());
+			return 1;
+		}
+		for(const std::unique_ptr<TraceInfo> &trace : session.traces) {
+			traces.emplace_back(trace->path, trace->name);
+		}
+	}
+
+	SessionContainerWriter writer;
+	if(!writer.open(output_path)) {
+		fprintf(stderr, "Error: %s\n", writer.error.c_str());
+		return 1;
+	}
+	std::size_t first = writer.container().traces.size();
+	int result = 0;
+	for(const auto &[path, name] : traces) {
+		if(!writer.add_trace(path, name)) {
+			fprintf(stderr, "Error: %s\n", writer.error.c_str());
+			result = 1;
+		}
+	}
+	if(!writer.close()) {
+		fprintf(stderr, "Error: %s\n", writer.error.c_str());
+		return 1;
+	}
+	const SessionContainer &container = writer.container();
+	fprintf(stderr, "Added %zu traces, reusing %zu stored programs. %s now has %zu traces, %zu distinct programs, %.1f MB.\n",
+		container.traces.size() - first, writer.programs_reused, output_path.c_str(), container.traces.size(),
+		container.program_hashes.size(), container.file_size / (1024.0 * 1024.0));
+	return result;
+}
@@ -0,0 +1,225 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "profile.h"
+
+InstructionTiming instruction_timing(const u8 *program, u32 pc)
+{
+	static const struct { const char *mnemonic; StallUnit unit; int latency; } units[] = {
+		{"DIV", STALLUNIT_FDIV, 7}, {"SQRT", STALLUNIT_FDIV, 7}, {"RSQRT", STALLUNIT_FDIV, 13},
+		{"EATAN", STALLUNIT_EFU, 54}, {"EATANxy", STALLUNIT_EFU, 54}, {"EATANxz", STALLUNIT_EFU, 54},
+		{"EEXP", STALLUNIT_EFU, 44}, {"ELENG", STALLUNIT_EFU, 18}, {"ERCPR", STALLUNIT_EFU, 12},
+		{"ERLENG", STALLUNIT_EFU, 24}, {"ERSADD", STALLUNIT_EFU, 18}, {"ERSQRT", STALLUNIT_EFU, 18},
+		{"ESADD", STALLUNIT_EFU, 11}, {"ESIN", STALLUNIT_EFU, 29}, {"ESQRT", STALLUNIT_EFU, 12},
+		{"ESUM", STALLUNIT_EFU, 12}
+	};
+
+	InstructionTiming timing;
+	u32 lower, upper;
+	memcpy(&lower, &program[pc], 4);
+	memcpy(&upper, &program[pc + 4], 4);
+	if(upper & I_BIT) {
+		return timing;
+	}
+	std::string disassembly = disassemble_lower(lower, pc);
+	std::string mnemonic = disassembly.substr(0, disassembly.find(' '));
+	for(const auto &unit : units) {
+		if(mnemonic == unit.mnemonic) {
+			timing.produces = unit.unit;
+			timing.latency = unit.latency;
+			timing.waits_for = unit.unit; // The unit must be free before issuing.
+		}
+	}
+	if(mnemonic == "WAITQ") timing.waits_for = STALLUNIT_FDIV;
+	if(mnemonic == "WAITP") timing.waits_for = STALLUNIT_EFU;
+	return timing;
+}
+
+bool is_branch(const u8 *program, u32 pc)
+{
+	switch(lower_opcode(program, pc)) {
+		case VULOWER_B: case VULOWER_BAL: case VULOWER_JR: case VULOWER_JALR:
+		case 0x28: case 0x29: case 0x2c: case 0x2d: case 0x2e: case 0x2f: // IBxx
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Each instruction pair is counted as one cycle, plus any time spent waiting
+// for the FDIV or EFU units to finish, either explicitly via WAITQ/WAITP or
+// by issuing another operation to a unit that is still busy. FMAC hazards
+// and XGKICK stalls are not modelled.
+void accumulate_profile(ProgramProfile &profile, const u32 *pcs, std::size_t count, const u8 *program)
+{
+	if(profile.program.empty()) {
+		profile.program.assign(program, program + VU1_PROGSIZE);
+		profile.program_hash = hash_program(program);
+		profile.times_executed.resize(BRANCH_SLOT_COUNT);
+		profile.cycles.resize(BRANCH_SLOT_COUNT);
+		profile.is_entry_point.resize(BRANCH_SLOT_COUNT);
+	}
+	profile.trace_count++;
+	profile.snapshot_count += count;
+	if(count == 0) {
+		return;
+	}
+	// The PC of a snapshot is that of the next instruction, so the program was
+	// entered one pair before the first one.
+	profile.is_entry_point[((pcs[0] - INSN_PAIR_SIZE) % VU1_PROGSIZE) / INSN_PAIR_SIZE] = true;
+
+	std::vector<InstructionTiming> timings(BRANCH_SLOT_COUNT);
+	for(u32 pc = 0; pc < VU1_PROGSIZE; pc += INSN_PAIR_SIZE) {
+		timings[pc / INSN_PAIR_SIZE] = instruction_timing(program, pc);
+	}
+
+	std::size_t time = 0;
+	std::size_t ready[3] = {0, 0, 0};
+	for(std::size_t i = 0; i < count; i++) {
+		u32 slot = pcs[i] / INSN_PAIR_SIZE;
+		const InstructionTiming &timing = timings[slot];
+		std::size_t stall = 0;
+		if(timing.waits_for != STALLUNIT_NONE && ready[timing.waits_for] > time) {
+			stall = ready[timing.waits_for] - time;
+		}
+		if(timing.produces != STALLUNIT_NONE) {
+			ready[timing.produces] = time + stall + timing.latency;
+		}
+		profile.cycles[slot] += 1 + stall;
+		time += 1 + stall;
+	}
+	profile.total_cycles += time;
+
+	BranchStatistics stats = compute_branch_statistics(pcs, count);
+	for(u32 i = 0; i < BRANCH_SLOT_COUNT; i++) {
+		profile.times_executed[i] += stats.times_executed[i];
+	}
+	for(const BranchEdge &edge : stats.edges_by_source) {
+		profile.edges.increment(edge.from, edge.to, edge.times);
+	}
+}
+
+ProfileReport build_profile_report(const ProgramProfile &profile)
+{
+	ProfileReport report;
+	if(profile.program.empty()) {
+		return report;
+	}
+	const u8 *program = profile.program.data();
+	std::vector<BranchEdge> edges = profile.edges.edges();
+
+	for(u32 i = 0; i < BRANCH_SLOT_COUNT; i++) {
+		if(profile.times_executed[i] > 0) {
+			report.instructions.push_back({i * INSN_PAIR_SIZE, (i + 1) * INSN_PAIR_SIZE, profile.times_executed[i], profile.cycles[i]});
+		}
+	}
+
+	// A basic block starts at an entry point, a branch target, or after the
+	// delay slot of a branch or an instruction with the E bit set.
+	std::vector<u8> is_leader = profile.is_entry_point;
+	for(const BranchEdge &edge : edges) {
+		is_leader[edge.to / INSN_PAIR_SIZE] = true;
+	}
+	for(u32 pc = 0; pc + 2 * INSN_PAIR_SIZE < VU1_PROGSIZE; pc += INSN_PAIR_SIZE) {
+		u32 upper;
+		memcpy(&upper, &program[pc + 4], 4);
+		if(is_branch(program, pc) || (upper & E_BIT)) {
+			is_leader[pc / INSN_PAIR_SIZE + 2] = true;
+		}
+	}
+	for(u32 i = 0; i < BRANCH_SLOT_COUNT;) {
+		u32 end = i + 1;
+		while(end < BRANCH_SLOT_COUNT && !is_leader[end]) end++;
+		ProfileEntry block = {i * INSN_PAIR_SIZE, end * INSN_PAIR_SIZE, profile.times_executed[i], 0};
+		for(u32 j = i; j < end; j++) {
+			block.cycles += profile.cycles[j];
+		}
+		if(block.cycles > 0) {
+			report.blocks.push_back(block);
+		}
+		i = end;
+	}
+
+	// Every backwards branch is treated as closing a loop. An edge goes from
+	// the delay slot, so the branch itself is the pair before it. Edges that
+	// don't come from a branch (e.g. where the program ends and is called
+	// again) are skipped, as are BAL, JR and JALR since they're almost always
+	// subroutine calls/returns.
+	for(const BranchEdge &edge : edges) {
+		if(edge.from < INSN_PAIR_SIZE) continue;
+		u32 branch = edge.from - INSN_PAIR_SIZE;
+		u32 opcode = lower_opcode(program, branch);
+		if(edge.to > branch || !is_branch(program, branch) || opcode == VULOWER_BAL || opcode == VULOWER_JR || opcode == VULOWER_JALR) continue;
+		u32 end = std::min<u32>(edge.from + INSN_PAIR_SIZE, VU1_PROGSIZE);
+		ProfileEntry loop = {edge.to, end, edge.times, 0};
+		for(u32 pc = edge.to; pc < end; pc += INSN_PAIR_SIZE) {
+			loop.cycles += profile.cycles[pc / INSN_PAIR_SIZE];
+		}
+		report.loops.push_back(loop);
+	}
+
+	auto by_cycles = [](const ProfileEntry &l, const ProfileEntry &r) {
+		return l.cycles != r.cycles ? l.cycles > r.cycles : l.begin < r.begin;
+	};
+	std::sort(report.instructions.begin(), report.instructions.end(), by_cycles);
+	std::sort(report.blocks.begin(), report.blocks.end(), by_cycles);
+	std::sort(report.loops.begin(), report.loops.end(), by_cycles);
+	return report;
+}
+
+void write_profile_csv(FILE *file, const ProgramProfile &profile, const ProfileReport &report)
+{
+	auto write_rows = [&](const char *kind, const std::vector<ProfileEntry> &entries) {
+		for(const ProfileEntry &entry : entries) {
+			fprintf(file, "%016llx,%s,%04x,%04x,%zu,%zu,",
+				(unsigned long long) profile.program_hash, kind, entry.begin, entry.end, entry.count, entry.cycles);
+			if(entry.end - entry.begin == INSN_PAIR_SIZE) {
+				std::string disassembly = disassemble((u8*) &profile.program[entry.begin], entry.begin);
+				while(!disassembly.empty() && disassembly.back() == ' ') disassembly.pop_back();
+				fputc('"', file);
+				for(char c : disassembly) {
+					if(c == '"') fputc('"', file);
+					fputc(c, file);
+				}
+				fputc('"', file);
+			}
+			fputc('\n', file);
+		}
+	};
+	write_rows("instruction", report.instructions);
+	write_rows("block", report.blocks);
+	write_rows("loop", report.loops);
+}
+
+void print_profile_report(FILE *file, const ProgramProfile &profile, const ProfileReport &report, std::size_t top)
+{
+	fprintf(file, "Program %016llx: %zu traces, %zu instructions, ~%zu cycles\n",
+		(unsigned long long) profile.program_hash, profile.trace_count, profile.snapshot_count, profile.total_cycles);
+	auto print_entries = [&](const char *title, const std::vector<ProfileEntry> &entries) {
+		fprintf(file, "  %s:\n", title);
+		for(std::size_t i = 0; i < std::min(top, entries.size()); i++) {
+			const ProfileEntry &entry = entries[i];
+			double percent = profile.total_cycles > 0 ? (entry.cycles * 100.0) / profile.total_cycles : 0.0;
+			fprintf(file, "    %04x-%04x %10zu times %12zu cycles (%5.1f%%)\n",
+				entry.begin, entry.end, entry.count, entry.cycles, percent);
+		}
+	};
+	print_entries("Instructions", report.instructions);
+	print_entries("Basic Blocks", report.blocks);
+	print_entries("Loops", report.loops);
+}
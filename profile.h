@@ -0,0 +1,88 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdio.h>
+
+#include "pcsx2defs.h"
+#include "pcsx2disassemble.h"
+#include "trace.h"
+#include "branches.h"
+#include "callstack.h"
+
+enum StallUnit
+{
+	STALLUNIT_NONE,
+	STALLUNIT_FDIV, // Q register.
+	STALLUNIT_EFU   // P register.
+};
+
+// How an instruction pair interacts with the FDIV and EFU units, which are
+// the main source of stalls we can estimate from a trace.
+struct InstructionTiming
+{
+	StallUnit produces = STALLUNIT_NONE;
+	int latency = 0;
+	StallUnit waits_for = STALLUNIT_NONE;
+};
+
+// Execution counts and estimated cycles for a microprogram, accumulated over
+// any number of traces that ran it.
+struct ProgramProfile
+{
+	u64 program_hash = 0;
+	std::vector<u8> program;
+	std::size_t trace_count = 0;
+	std::size_t snapshot_count = 0;
+	std::size_t total_cycles = 0;
+	std::vector<std::size_t> times_executed; // Indexed by pc / 8.
+	std::vector<std::size_t> cycles;         // Indexed by pc / 8.
+	std::vector<u8> is_entry_point;          // Indexed by pc / 8.
+	BranchEdgeTable edges;
+};
+
+struct ProfileEntry
+{
+	u32 begin;
+	u32 end; // Exclusive.
+	std::size_t count;
+	std::size_t cycles;
+};
+
+// Instructions, basic blocks and loops, each sorted by estimated cycles.
+struct ProfileReport
+{
+	std::vector<ProfileEntry> instructions;
+	std::vector<ProfileEntry> blocks;
+	std::vector<ProfileEntry> loops;
+};
+
+InstructionTiming instruction_timing(const u8 *program, u32 pc);
+bool is_branch(const u8 *program, u32 pc);
+void accumulate_profile(ProgramProfile &profile, const u32 *pcs, std::size_t count, const u8 *program);
+ProfileReport build_profile_report(const ProgramProfile &profile);
+void write_profile_csv(FILE *file, const ProgramProfile &profile, const ProfileReport &report);
+void print_profile_report(FILE *file, const ProgramProfile &profile, const ProfileReport &report, std::size_t top);
+
+#endif
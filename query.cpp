@@ -0,0 +1,502 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Runs queries over traces without opening a window, for scripting. Each
+// trace is read once to build a TraceIndex, which the queries are answered
+// from, and which is saved next to the trace so later runs can skip that
+// step. Only the queries that need the full state of a snapshot read the
+// trace again, and then only up to the last snapshot they need.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pcsx2defs.h"
+#include "pcsx2disassemble.h"
+#include "trace.h"
+#include "traceindex.h"
+#include "gif.h"
+#include "session.h"
+#include "comments.h"
+#include "snapshotstore.h"
+#include "valuesearch.h"
+
+enum QueryType
+{
+	QUERY_INFO,
+	QUERY_PC,
+	QUERY_STATE,
+	QUERY_ACCESS,
+	QUERY_GS,
+	QUERY_DISASSEMBLY,
+	QUERY_FIND
+};
+
+struct Query
+{
+	QueryType type = QUERY_INFO;
+	u32 argument = 0;
+	bool all = false; // For QUERY_GS, print every packet kicked.
+	std::string text = {}; // For QUERY_FIND, the value to search for.
+	ValueSearch search = {};
+};
+
+struct QueryOptions
+{
+	bool json = false;
+	bool memory = false;
+	bool cache_index = false;
+	std::unique_ptr<CommentDatabase> comments;
+};
+
+bool run_query(FILE *out, const TraceIndex &index, const Query &query, const QueryOptions &options, std::string &error);
+void print_info(FILE *out, const TraceIndex &index, const QueryOptions &options);
+void print_pc(FILE *out, const TraceIndex &index, u32 pc, const QueryOptions &options);
+void print_accesses(FILE *out, const TraceIndex &index, u32 address, const QueryOptions &options);
+void print_state(FILE *out, const TraceIndex &index, u32 snapshot, const Snapshot &snap, const QueryOptions &options);
+void print_gs_packet(FILE *out, const TraceIndex &index, u32 snapshot, const Snapshot &snap, bool first, const QueryOptions &options);
+void print_disassembly(FILE *out, const TraceIndex &index, const QueryOptions &options);
+bool print_value_matches(FILE *out, const TraceIndex &index, const Query &query, const QueryOptions &options, std::string &error);
+const char *query_name(QueryType type);
+std::string json_escape(const std::string &string);
+
+int main(int argc, char **argv)
+{
+	QueryOptions options;
+	std::vector<Query> queries;
+	std::vector<std::string> paths;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--json") == 0) {
+			options.json = true;
+		} else if(strcmp(argv[i], "--memory") == 0) {
+			options.memory = true;
+		} else if(strcmp(argv[i], "--cache-index") == 0) {
+			options.cache_index = true;
+		} else if(strcmp(argv[i], "--comments") == 0 && i + 1 < argc) {
+			std::string error;
+			options.comments = std::make_unique<CommentDatabase>();
+			if(!options.comments->load(argv[++i], error)) {
+				fprintf(stderr, "Error: %s\n", error.c_str());
+				return 1;
+			}
+		} else if(strcmp(argv[i], "--info") == 0) {
+			queries.push_back({QUERY_INFO});
+		} else if(strcmp(argv[i], "--pc") == 0 && i + 1 < argc) {
+			queries.push_back({QUERY_PC, (u32) strtoul(argv[++i], nullptr, 16)});
+		} else if(strcmp(argv[i], "--state") == 0 && i + 1 < argc) {
+			queries.push_back({QUERY_STATE, (u32) strtoul(argv[++i], nullptr, 10)});
+		} else if(strcmp(argv[i], "--access") == 0 && i + 1 < argc) {
+			queries.push_back({QUERY_ACCESS, (u32) strtoul(argv[++i], nullptr, 16)});
+		} else if(strcmp(argv[i], "--gs") == 0 && i + 1 < argc) {
+			i++;
+			bool all = strcmp(argv[i], "all") == 0;
+			queries.push_back({QUERY_GS, all ? 0 : (u32) strtoul(argv[i], nullptr, 10), all});
+		} else if(strcmp(argv[i], "--disassembly") == 0) {
+			queries.push_back({QUERY_DISASSEMBLY});
+		} else if(strcmp(argv[i], "--find") == 0 && i + 1 < argc) {
+			Query &query = queries.emplace_back();
+			query.type = QUERY_FIND;
+			query.text = argv[++i];
+			std::string error;
+			if(!parse_value_search(query.search, query.text, error)) {
+				fprintf(stderr, "Error: %s\n", error.c_str());
+				return 1;
+			}
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+	if(queries.empty() || paths.empty()) {
+		fprintf(stderr, "usage: %s [--json] [--memory] [--comments <file>] [--cache-index] <queries...> <trace files...>\n", argv[0]);
+		fprintf(stderr, "queries:\n");
+		fprintf(stderr, "  --info               Print the format version, snapshot count and program hash.\n");
+		fprintf(stderr, "  --pc <address>       List the snapshots where the PC is equal to a hex address.\n");
+		fprintf(stderr, "  --state <snapshot>   Print the registers at a snapshot, and VU memory with --memory,\n");
+		fprintf(stderr, "                       shown as the types it's annotated with in --comments.\n");
+		fprintf(stderr, "  --access <address>   List the loads and stores that touch a hex address.\n");
+		fprintf(stderr, "  --gs <snapshot|all>  Dump the GS packet kicked at a snapshot, or every packet kicked.\n");
+		fprintf(stderr, "  --disassembly        Print the disassembly, with comments from --comments.\n");
+		fprintf(stderr, "  --find <value>       List where a value appears in and disappears from VU memory.\n");
+		fprintf(stderr, "                       e.g. \"float 1.5 0.001\", \"vec4 0 0 0 1 0.001\", \"int16 -8 8\", \"int32 0 255\",\n");
+		fprintf(stderr, "                       \"bytes 0a0b0c0d\" or \"giftag eop=1 nreg=3\".\n");
+		fprintf(stderr, "With --cache-index, the index built for each trace is saved as <trace>.vuidx,\n");
+		fprintf(stderr, "and reused until the trace changes.\n");
+		return 1;
+	}
+
+	FILE *out = stdout;
+	int result = 0;
+	if(options.json) fprintf(out, "[\n");
+	for(std::size_t i = 0; i < paths.size(); i++) {
+		TraceIndex index;
+		std::string error;
+		bool success = options.cache_index && load_trace_index(index, paths[i]);
+		if(!success) {
+			success = build_trace_index(index, paths[i], error);
+			// Not being able to save the index e.g. because the directory is
+			// read only shouldn't stop the queries from running.
+			std::string save_error;
+			if(success && options.cache_index && !save_trace_index(index, save_error)) {
+				fprintf(stderr, "Warning: %s\n", save_error.c_str());
+			}
+		}
+		if(options.json) {
+			fprintf(out, "\t{\n\t\t\"path\": \"%s\",\n\t\t\"queries\": [", json_escape(paths[i]).c_str());
+		}
+		for(std::size_t j = 0; success && j < queries.size(); j++) {
+			if(options.json) {
+				fprintf(out, "%s\n\t\t\t{\"query\": \"%s\", ", j == 0 ? "" : ",", query_name(queries[j].type));
+			}
+			success = run_query(out, index, queries[j], options, error);
+			if(options.json) fprintf(out, "}");
+		}
+		if(options.json) {
+			fprintf(out, "\n\t\t]");
+			if(!success) fprintf(out, ",\n\t\t\"error\": \"%s\"", json_escape(error).c_str());
+			fprintf(out, "\n\t}%s\n", i + 1 < paths.size() ? "," : "");
+		}
+		if(!success) {
+			fprintf(stderr, "Error: %s: %s\n", paths[i].c_str(), error.c_str());
+			result = 1;
+		}
+	}
+	if(options.json) fprintf(out, "]\n");
+	return result;
+}
+
+bool run_query(FILE *out, const TraceIndex &index, const Query &query, const QueryOptions &options, std::string &error)
+{
+	switch(query.type) {
+		case QUERY_INFO: {
+			print_info(out, index, options);
+			break;
+		}
+		case QUERY_PC: {
+			print_pc(out, index, query.argument, options);
+			break;
+		}
+		case QUERY_STATE: {
+			if(options.json) fprintf(out, "\"snapshot\": %u, \"state\": ", query.argument);
+			std::vector<u32> snapshots = {query.argument};
+			bool found = false;
+			bool success = visit_snapshots(index, snapshots, error, [&](u32 snapshot, const Snapshot &snap) {
+				print_state(out, index, snapshot, snap, options);
+				found = true;
+			});
+			if(!found && options.json) fprintf(out, "null");
+			return success;
+		}
+		case QUERY_ACCESS: {
+			print_accesses(out, index, query.argument, options);
+			break;
+		}
+		case QUERY_GS: {
+			std::vector<u32> snapshots;
+			if(query.all) {
+				snapshots = index.kicks;
+			} else {
+				snapshots = {query.argument};
+			}
+			if(options.json) fprintf(out, "\"packets\": [");
+			bool first = true;
+			bool success = visit_snapshots(index, snapshots, error, [&](u32 snapshot, const Snapshot &snap) {
+				print_gs_packet(out, index, snapshot, snap, first, options);
+				first = false;
+			});
+			if(options.json) fprintf(out, "]");
+			return success;
+		}
+		case QUERY_DISASSEMBLY: {
+			print_disassembly(out, index, options);
+			break;
+		}
+		case QUERY_FIND: {
+			return print_value_matches(out, index, query, options, error);
+		}
+	}
+	return true;
+}
+
+void print_info(FILE *out, const TraceIndex &index, const QueryOptions &options)
+{
+	if(options.json) {
+		fprintf(out, "\"version\": %u, \"snapshots\": %zu, \"program_hash\": \"%016llx\", \"accesses\": %zu, \"kicks\": %zu",
+			index.version, index.snapshot_count, (unsigned long long) index.program_hash, index.accesses.size(), index.kicks.size());
+	} else {
+		fprintf(out, "%s: version %u, %zu snapshots, program %016llx, %zu loads/stores, %zu kicks\n",
+			index.path.c_str(), index.version, index.snapshot_count, (unsigned long long) index.program_hash,
+			index.accesses.size(), index.kicks.size());
+	}
+}
+
+void print_pc(FILE *out, const TraceIndex &index, u32 pc, const QueryOptions &options)
+{
+	auto [begin, end] = find_pc_snapshots(index, pc);
+	if(options.json) {
+		fprintf(out, "\"pc\": %u, \"snapshots\": [", pc);
+		for(const u32 *snapshot = begin; snapshot < end; snapshot++) {
+			fprintf(out, "%s%u", snapshot == begin ? "" : ", ", *snapshot);
+		}
+		fprintf(out, "]");
+	} else {
+		for(const u32 *snapshot = begin; snapshot < end; snapshot++) {
+			fprintf(out, "%s:%u\n", index.path.c_str(), *snapshot);
+		}
+	}
+}
+
+void print_accesses(FILE *out, const TraceIndex &index, u32 address, const QueryOptions &options)
+{
+	auto [begin, end] = find_accesses(index, address);
+	if(options.json) {
+		fprintf(out, "\"address\": %u, \"accesses\": [", address);
+		for(const MemoryAccess *access = begin; access < end; access++) {
+			fprintf(out, "%s{\"snapshot\": %u, \"pc\": %u, \"type\": \"%s\", \"address\": %u, \"size\": %u}",
+				access == begin ? "" : ", ", access->snapshot, index.pcs[access->snapshot],
+				access->write ? "store" : "load", access->address, access->size);
+		}
+		fprintf(out, "]");
+	} else {
+		for(const MemoryAccess *access = begin; access < end; access++) {
+			fprintf(out, "%s:%u: pc %04x %s %04x size %u\n", index.path.c_str(), access->snapshot,
+				index.pcs[access->snapshot], access->write ? "store" : "load", access->address, access->size);
+		}
+	}
+}
+
+void print_state(FILE *out, const TraceIndex &index, u32 snapshot, const Snapshot &snap, const QueryOptions &options)
+{
+	const VURegs &regs = snap.registers;
+	if(options.json) {
+		fprintf(out, "{\"pc\": %u, \"vf\": [", index.pcs[snapshot]);
+		for(int i = 0; i < 32; i++) {
+			fprintf(out, "%s[%u, %u, %u, %u]", i == 0 ? "" : ", ", regs.VF[i].UL[0], regs.VF[i].UL[1], regs.VF[i].UL[2], regs.VF[i].UL[3]);
+		}
+		fprintf(out, "], \"vi\": [");
+		for(int i = 0; i < 32; i++) {
+			fprintf(out, "%s%u", i == 0 ? "" : ", ", regs.VI[i].UL);
+		}
+		fprintf(out, "], \"acc\": [%u, %u, %u, %u], \"q\": %u, \"p\": %u",
+			regs.ACC.UL[0], regs.ACC.UL[1], regs.ACC.UL[2], regs.ACC.UL[3], regs.q.UL, regs.p.UL);
+		if(snap.read_size > 0) fprintf(out, ", \"load\": {\"address\": %u, \"size\": %u}", snap.read_addr, snap.read_size);
+		if(snap.write_size > 0) fprintf(out, ", \"store\": {\"address\": %u, \"size\": %u}", snap.write_addr, snap.write_size);
+		if(options.memory) {
+			fprintf(out, ", \"memory\": \"");
+			for(u32 i = 0; i < VU1_MEMSIZE; i++) {
+				fprintf(out, "%02x", snap.memory[i]);
+			}
+			fprintf(out, "\"");
+		}
+		fprintf(out, "}");
+		return;
+	}
+
+	fprintf(out, "%s:%u: pc %04x\n", index.path.c_str(), snapshot, index.pcs[snapshot]);
+	for(int i = 0; i < 32; i++) {
+		const VECTOR &vf = regs.VF[i];
+		fprintf(out, "vf%02d %08x %08x %08x %08x (%g, %g, %g, %g)\n", i,
+			vf.UL[0], vf.UL[1], vf.UL[2], vf.UL[3], vf.F[0], vf.F[1], vf.F[2], vf.F[3]);
+	}
+	for(int i = 0; i < 32; i++) {
+		fprintf(out, "vi%02d %08x\n", i, regs.VI[i].UL);
+	}
+	fprintf(out, "acc  %08x %08x %08x %08x\n", regs.ACC.UL[0], regs.ACC.UL[1], regs.ACC.UL[2], regs.ACC.UL[3]);
+	fprintf(out, "q    %08x\np    %08x\n", regs.q.UL, regs.p.UL);
+	if(snap.read_size > 0) fprintf(out, "load %04x size %u\n", snap.read_addr, snap.read_size);
+	if(snap.write_size > 0) fprintf(out, "store %04x size %u\n", snap.write_addr, snap.write_size);
+	if(options.memory) {
+		const MemoryAnnotations *annotations = options.comments ? options.comments->annotations(index.program_hash) : nullptr;
+		for(u32 i = 0; i < VU1_MEMSIZE; i += 0x10) {
+			fprintf(out, "%04x:", i);
+			for(u32 j = 0; j < 0x10; j++) {
+				fprintf(out, " %02x", snap.memory[i + j]);
+			}
+			MemoryType type = annotations ? annotations->find(i) : MEMTYPE_NONE;
+			if(type != MEMTYPE_NONE) {
+				fprintf(out, "  %s %s", memory_type_name(type), format_qword(type, &snap.memory[i]).c_str());
+			}
+			fprintf(out, "\n");
+		}
+	}
+}
+
+void print_gs_packet(FILE *out, const TraceIndex &index, u32 snapshot, const Snapshot &snap, bool first, const QueryOptions &options)
+{
+	u32 pc = index.pcs[snapshot];
+	u32 lower;
+	memcpy(&lower, &snap.program[pc], 4);
+	if(!is_xgkick(lower)) {
+		if(options.json) {
+			fprintf(out, "%s{\"snapshot\": %u, \"error\": \"Not an XGKICK instruction.\"}", first ? "" : ", ", snapshot);
+		} else {
+			fprintf(out, "%s:%u: not an XGKICK instruction\n", index.path.c_str(), snapshot);
+		}
+		return;
+	}
+	u32 address = (snap.registers.VI[bit_range(lower, 11, 15)].UL * 0x10) % VU1_MEMSIZE;
+	GsPacket packet = read_gs_packet(&snap.memory[address], VU1_MEMSIZE - address);
+
+	if(options.json) {
+		fprintf(out, "%s{\"snapshot\": %u, \"address\": %u, \"primitives\": [", first ? "" : ", ", snapshot, address);
+		for(std::size_t i = 0; i < packet.primitives.size(); i++) {
+			const GifTag &tag = packet.primitives[i].tag;
+			fprintf(out, "%s{\"nloop\": %d, \"eop\": %d, \"pre\": %d, \"flag\": \"%s\", \"prim\": \"%s\", \"regs\": [",
+				i == 0 ? "" : ", ", tag.nloop, tag.eop, tag.pre, gif_flag_name(tag.flag), gs_primitive_type_name(tag.prim.prim));
+			for(std::size_t j = 0; j < tag.regs.size(); j++) {
+				fprintf(out, "%s\"%s\"", j == 0 ? "" : ", ", gs_register_name(tag.regs[j]));
+			}
+			fprintf(out, "], \"packed\": [");
+			const std::vector<GsPackedData> &packed = packet.primitives[i].packed_data;
+			for(std::size_t j = 0; j < packed.size(); j++) {
+				u64 low, high;
+				memcpy(&low, &packed[j].buffer[0], 8);
+				memcpy(&high, &packed[j].buffer[8], 8);
+				fprintf(out, "%s{\"address\": %d, \"reg\": \"%s\", \"data\": \"%016llx%016llx\"}", j == 0 ? "" : ", ",
+					packed[j].source_address, gs_register_name(packed[j].reg), (unsigned long long) high, (unsigned long long) low);
+			}
+			fprintf(out, "]}");
+		}
+		fprintf(out, "]");
+		if(!packet.error.empty()) fprintf(out, ", \"error\": \"%s\"", json_escape(packet.error).c_str());
+		fprintf(out, "}");
+		return;
+	}
+
+	fprintf(out, "%s:%u: XGKICK %04x, %zu primitives\n", index.path.c_str(), snapshot, address, packet.primitives.size());
+	for(std::size_t i = 0; i < packet.primitives.size(); i++) {
+		const GsPrimitive &prim = packet.primitives[i];
+		const GifTag &tag = prim.tag;
+		fprintf(out, "  %zu: NLOOP=%x, EOP=%x, PRE=%x, FLAG=%s, PRIM=%s, NREG=%zx\n", i,
+			tag.nloop, tag.eop, tag.pre, gif_flag_name(tag.flag), gs_primitive_type_name(tag.prim.prim), tag.regs.size());
+		for(const GsPackedData &item : prim.packed_data) {
+			if(item.reg == GSREG_AD) {
+				fprintf(out, "    %04x: %s <- %llx\n", item.source_address, gif_ad_register_name(item.ad.addr),
+					(unsigned long long) item.ad.data);
+			} else {
+				u64 low, high;
+				memcpy(&low, &item.buffer[0], 8);
+				memcpy(&high, &item.buffer[8], 8);
+				fprintf(out, "    %04x: %6s %016llx%016llx\n", item.source_address, gs_register_name(item.reg),
+					(unsigned long long) high, (unsigned long long) low);
+			}
+		}
+		for(const GsRegListData &item : prim.reglist_data) {
+			fprintf(out, "    %04x: %016llx\n", item.source_address, (unsigned long long) item.value);
+		}
+		if(!prim.image.data.empty()) {
+			fprintf(out, "    %04x: %zu bytes of image data\n", prim.image.source_address, prim.image.data.size());
+		}
+	}
+	if(!packet.error.empty()) {
+		fprintf(out, "  %s\n", packet.error.c_str());
+	}
+}
+
+void print_disassembly(FILE *out, const TraceIndex &index, const QueryOptions &options)
+{
+	// Comments from an old style comment file are assumed to be for the
+	// first program disassembled.
+	if(options.comments) {
+		options.comments->assign_legacy(index.program_hash);
+	}
+	if(options.json) fprintf(out, "\"lines\": [");
+	for(u32 i = 0; i < VU1_PROGSIZE; i += INSN_PAIR_SIZE) {
+		std::string line = disassemble(&index.program[i], i);
+		std::string comment;
+		if(options.comments) {
+			comment = options.comments->get(index.program_hash, i);
+		}
+		if(options.json) {
+			auto [begin, end] = find_pc_snapshots(index, i);
+			fprintf(out, "%s\n\t\t\t\t{\"address\": %u, \"text\": \"%s\", \"comment\": \"%s\", \"executions\": %zu}", i == 0 ? "" : ",",
+				i, json_escape(line).c_str(), json_escape(comment).c_str(), (std::size_t) (end - begin));
+		} else {
+			fprintf(out, "%s%s%s\n", line.c_str(), comment.empty() ? "" : "; ", comment.c_str());
+		}
+	}
+	if(options.json) fprintf(out, "\n\t\t\t]");
+}
+
+// The index doesn't have the contents of memory, so the trace is loaded
+// again into a snapshot store to search it.
+bool print_value_matches(FILE *out, const TraceIndex &index, const Query &query, const QueryOptions &options, std::string &error)
+{
+	SnapshotStore store;
+	if(!store.load(index.path, error)) {
+		return false;
+	}
+	ThreadPool pool;
+	ValueSearchResult result;
+	search_values(result, store, query.search, pool);
+	if(!result.error.empty()) {
+		error = result.error;
+		return false;
+	}
+	if(options.json) {
+		fprintf(out, "\"value\": \"%s\", \"truncated\": %s, \"matches\": [", json_escape(query.text).c_str(), result.truncated ? "true" : "false");
+		for(std::size_t i = 0; i < result.matches.size(); i++) {
+			const ValueMatch &match = result.matches[i];
+			fprintf(out, "%s{\"address\": %u, \"first\": %u, \"end\": %u}", i == 0 ? "" : ", ",
+				match.address, match.first_snapshot, match.end_snapshot);
+		}
+		fprintf(out, "]");
+	} else {
+		for(const ValueMatch &match : result.matches) {
+			fprintf(out, "%s:%u-%u: %04x\n", index.path.c_str(), match.first_snapshot, match.end_snapshot, match.address);
+		}
+		if(result.truncated) {
+			fprintf(out, "%s: too many matches, stopped early\n", index.path.c_str());
+		}
+	}
+	return true;
+}
+
+const char *query_name(QueryType type)
+{
+	switch(type) {
+		case QUERY_INFO: return "info";
+		case QUERY_PC: return "pc";
+		case QUERY_STATE: return "state";
+		case QUERY_ACCESS: return "access";
+		case QUERY_GS: return "gs";
+		case QUERY_DISASSEMBLY: return "disassembly";
+		case QUERY_FIND: return "find";
+	}
+	return "";
+}
+
+std::string json_escape(const std::string &string)
+{
+	std::string result;
+	for(char c : string) {
+		if(c == '"' || c == '\\') {
+			result += '\\';
+			result += c;
+		} else if((u8) c < 0x20) {
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+			result += escape;
+		} else {
+			result += c;
+		}
+	}
+	return result;
+}
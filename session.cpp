@@ -0,0 +1,175 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "session.h"
+
+#include "sessioncontainer.h"
+
+bool is_xgkick(u32 lower)
+{
+	return bit_range(lower, 0, 10) == 0b11011111100;
+}
+
+// Returns N for a path like vutrace_output/traceN.bin, or for a trace in a
+// session container that was packed from traceN.bin, or -1.
+int parse_trace_index(const std::string &path)
+{
+	std::string container_path;
+	std::size_t trace;
+	if(split_container_path(path, container_path, trace)) {
+		std::string error;
+		std::shared_ptr<const SessionContainer> container = open_session_container(container_path, error);
+		if(!container || trace >= container->traces.size()) {
+			return -1;
+		}
+		return parse_trace_index(container->traces[trace].name);
+	}
+	std::string stem = std::filesystem::path(path).stem().string();
+	if(stem.rfind("trace", 0) == 0 && stem.size() > 5) {
+		char *end = nullptr;
+		long index = strtol(stem.c_str() + 5, &end, 10);
+		if(*end == '\0') {
+			return (int) index;
+		}
+	}
+	return -1;
+}
+
+// The path of trace N of the same session as the given trace, which is either
+// next to it or in the same session container. Returns an empty string if
+// the container doesn't have it.
+std::string session_trace_path(const std::string &trace_path, int trace_index)
+{
+	std::string container_path;
+	std::size_t trace;
+	if(split_container_path(trace_path, container_path, trace)) {
+		std::string error;
+		std::shared_ptr<const SessionContainer> container = open_session_container(container_path, error);
+		for(std::size_t i = 0; container && i < container->traces.size(); i++) {
+			if(parse_trace_index(container->traces[i].name) == trace_index) {
+				return container_trace_path(container_path, i);
+			}
+		}
+		return "";
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "trace%06d.bin", trace_index);
+	return (std::filesystem::path(trace_path).parent_path() / name).string();
+}
+
+// List the traces in a directory. This only stats the files, the contents
+// are read later by scan_session. A session container has the summaries in
+// its index already, so they don't need to be scanned.
+bool open_session(Session &session, const std::string &directory)
+{
+	session.directory = directory;
+	session.traces.clear();
+	session.traces_scanned = 0;
+	std::error_code error;
+	if(std::filesystem::is_regular_file(directory, error)) {
+		std::string container_error;
+		std::shared_ptr<const SessionContainer> container = open_session_container(directory, container_error);
+		if(!container) {
+			return false;
+		}
+		for(std::size_t i = 0; i < container->traces.size(); i++) {
+			const ContainerTrace &trace = container->traces[i];
+			std::unique_ptr<TraceInfo> info = std::make_unique<TraceInfo>();
+			info->path = container_trace_path(directory, i);
+			info->name = trace.name;
+			info->index = parse_trace_index(trace.name);
+			info->file_size = (std::size_t) trace.size;
+			info->version = 3;
+			info->snapshot_count = (std::size_t) trace.snapshot_count;
+			info->kick_count = (std::size_t) trace.kick_count;
+			info->program_hash = trace.program_hash;
+			info->entry_pc = trace.entry_pc;
+			info->scanned = true;
+			session.traces.emplace_back(std::move(info));
+		}
+		session.traces_scanned = session.traces.size();
+		return true;
+	}
+	std::filesystem::directory_iterator iter(directory, error);
+	if(error) {
+		return false;
+	}
+	for(const auto &entry : iter) {
+		if(!entry.is_regular_file() || entry.path().extension() != ".bin") {
+			continue;
+		}
+		std::unique_ptr<TraceInfo> info = std::make_unique<TraceInfo>();
+		info->path = entry.path().string();
+		info->name = entry.path().filename().string();
+		info->index = parse_trace_index(info->path);
+		info->file_size = entry.file_size(error);
+		session.traces.emplace_back(std::move(info));
+	}
+	std::sort(session.traces.begin(), session.traces.end(), [](auto &l, auto &r) {
+		if(l->index != r->index) {
+			return (u32) l->index < (u32) r->index; // Unnumbered traces go last.
+		}
+		return l->name < r->name;
+	});
+	return true;
+}
+
+// Stream through a trace counting snapshots and XGKICKs. The program is
+// hashed as of the last snapshot, the same as when the trace is opened, so
+// the hash shown matches the one comments and coverage are keyed by.
+void scan_trace_info(TraceInfo &info)
+{
+	TraceReader reader;
+	if(reader.open(info.path)) {
+		info.version = reader.version;
+		while(reader.next_snapshot()) {
+			const Snapshot &snapshot = reader.snapshot();
+			if(reader.snapshot_count == 1) {
+				// The PC of a snapshot is that of the next instruction.
+				info.entry_pc = (reader.pc() - INSN_PAIR_SIZE) % VU1_PROGSIZE;
+			}
+			u32 lower;
+			memcpy(&lower, &snapshot.program[reader.pc()], 4);
+			if(is_xgkick(lower)) {
+				info.kick_count++;
+			}
+		}
+		info.snapshot_count = reader.snapshot_count;
+		if(info.snapshot_count > 0) {
+			info.program_hash = hash_program(reader.snapshot().program);
+		}
+	}
+	info.error = reader.error;
+	info.scanned = true;
+}
+
+// Scan all the traces in parallel. Each job only writes to its own TraceInfo
+// so no locking is needed, the GUI checks the scanned flag before reading.
+void scan_session(Session &session, ThreadPool &pool)
+{
+	for(std::unique_ptr<TraceInfo> &info : session.traces) {
+		if(info->scanned) {
+			continue;
+		}
+		TraceInfo *trace = info.get();
+		pool.submit([&session, trace]() {
+			scan_trace_info(*trace);
+			session.traces_scanned++;
+		});
+	}
+}
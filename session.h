@@ -0,0 +1,69 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <memory>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <stdlib.h>
+
+#include "pcsx2defs.h"
+#include "trace.h"
+#include "gif.h"
+#include "threadpool.h"
+
+// Summary of a trace file, filled in by a background scan so the session
+// browser can list the traces without loading any of them.
+struct TraceInfo
+{
+	std::string path;
+	std::string name;
+	int index = -1; // N in traceN.bin, or -1 if the name doesn't match.
+	std::size_t file_size = 0;
+	std::atomic<bool> scanned{false};
+	// Only valid once scanned is set.
+	u32 version = 0;
+	std::size_t snapshot_count = 0;
+	std::size_t kick_count = 0;
+	u64 program_hash = 0; // Of the program at the last snapshot.
+	u32 entry_pc = 0; // The address of the first instruction executed.
+	std::string error;
+};
+
+// A capture session i.e. the contents of a vutrace_output directory or a
+// session container.
+struct Session
+{
+	std::string directory; // Or the path of the container.
+	std::vector<std::unique_ptr<TraceInfo>> traces; // Sorted by index.
+	std::atomic<std::size_t> traces_scanned{0};
+};
+
+bool is_xgkick(u32 lower);
+int parse_trace_index(const std::string &path);
+std::string session_trace_path(const std::string &trace_path, int trace_index);
+bool open_session(Session &session, const std::string &directory);
+void scan_trace_info(TraceInfo &info);
+void scan_session(Session &session, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,389 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "sessioncontainer.h"
+
+#include <mutex>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+
+#include "session.h"
+
+static const std::size_t TRAILER_SIZE = 12; // u64 index offset, "VUSE".
+
+bool SessionContainerWriter::open(const std::string &path)
+{
+	close();
+	error.clear();
+	index = SessionContainer();
+	programs.clear();
+	programs_reused = 0;
+	write_failed = false;
+
+	std::error_code ec;
+	if(std::filesystem::exists(path, ec)) {
+		if(!is_session_container(path)) {
+			error = path + " already exists and isn't a session container.";
+			return false;
+		}
+		if(!read_session_container(index, path, error)) {
+			return false;
+		}
+		for(u32 i = 0; i < (u32) index.program_hashes.size(); i++) {
+			programs.emplace(index.program_hashes[i], i);
+		}
+		file = fopen(path.c_str(), "ab");
+		position = index.file_size;
+	} else {
+		index.path = path;
+		file = fopen(path.c_str(), "wb");
+		position = 0;
+	}
+	if(file == nullptr) {
+		error = "Failed to open " + path + " for writing.";
+		return false;
+	}
+	setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+	if(position == 0) {
+		u32 version = SessionContainer::FORMAT_VERSION;
+		return write("VUSC", 4) && write(&version, 4);
+	}
+	return true;
+}
+
+// Copy the packets of the trace across one at a time, looking at just enough
+// of them to fill in the summary for the index.
+bool SessionContainerWriter::add_trace(const std::string &trace_path, const std::string &name)
+{
+	if(file == nullptr || write_failed) {
+		return false;
+	}
+	error.clear();
+	FILE *input = fopen(trace_path.c_str(), "rb");
+	if(input == nullptr) {
+		error = "Failed to open " + trace_path + ".";
+		return false;
+	}
+	setvbuf(input, nullptr, _IOFBF, 1024 * 1024);
+
+	ContainerTrace trace;
+	trace.name = name;
+	trace.offset = position;
+	std::size_t program_count = index.program_hashes.size();
+	std::size_t reused = programs_reused;
+	std::vector<u8> buffer(std::max<std::size_t>(VU1_PROGSIZE, VU1_MEMSIZE));
+	std::vector<u8> program(VU1_PROGSIZE);
+	u32 pc = 0;
+
+	bool success = copy(input, buffer.data(), 8, trace_path);
+	if(success && (memcmp(buffer.data(), "VUTR", 4) != 0 || memcmp(&buffer[4], "\x03\0\0\0", 4) != 0)) {
+		error = trace_path + " isn't a version 3 trace. Older traces can be converted with vutrace-slice.";
+		success = false;
+	}
+	success = success && write(buffer.data(), 8);
+	int type;
+	while(success && (type = fgetc(input)) != EOF) {
+		u8 packet_type = (u8) type;
+		switch(packet_type) {
+			case VUTRACE_PUSHSNAPSHOT: {
+				if(trace.snapshot_count++ == 0) {
+					// The PC of a snapshot is that of the next instruction.
+					trace.entry_pc = (pc - INSN_PAIR_SIZE) % VU1_PROGSIZE;
+				}
+				u32 lower = 0;
+				if(pc <= VU1_PROGSIZE - 4) {
+					memcpy(&lower, &program[pc], 4);
+				}
+				if(is_xgkick(lower)) {
+					trace.kick_count++;
+				}
+				success = write(&packet_type, 1);
+				break;
+			}
+			case VUTRACE_SETREGISTERS: {
+				success = copy(input, buffer.data(), sizeof(VURegs), trace_path) && write(&packet_type, 1) && write(buffer.data(), sizeof(VURegs));
+				memcpy(&pc, &buffer[offsetof(VURegs, VI) + TPC * 16], 4);
+				break;
+			}
+			case VUTRACE_SETMEMORY: {
+				success = copy(input, buffer.data(), VU1_MEMSIZE, trace_path) && write(&packet_type, 1) && write(buffer.data(), VU1_MEMSIZE);
+				break;
+			}
+			case VUTRACE_SETINSTRUCTIONS: {
+				if(!copy(input, program.data(), VU1_PROGSIZE, trace_path)) {
+					success = false;
+					break;
+				}
+				u64 hash = hash_program(program.data());
+				auto iter = programs.find(hash);
+				if(iter != programs.end()) {
+					u8 packet[5] = {VUTRACE_PROGRAMINDEX};
+					memcpy(&packet[1], &iter->second, 4);
+					success = write(packet, sizeof(packet));
+					programs_reused++;
+				} else {
+					programs.emplace(hash, (u32) index.program_hashes.size());
+					index.program_hashes.push_back(hash);
+					index.program_offsets.push_back(position + 1);
+					success = write(&packet_type, 1) && write(program.data(), VU1_PROGSIZE);
+				}
+				break;
+			}
+			case VUTRACE_LOADOP:
+			case VUTRACE_STOREOP: {
+				success = copy(input, buffer.data(), 8, trace_path) && write(&packet_type, 1) && write(buffer.data(), 8);
+				break;
+			}
+			case VUTRACE_PATCHREGISTER: {
+				success = copy(input, buffer.data(), 17, trace_path) && write(&packet_type, 1) && write(buffer.data(), 17);
+				if(buffer[0] == 32 + TPC) {
+					memcpy(&pc, &buffer[1], 4);
+				}
+				break;
+			}
+			case VUTRACE_PATCHMEMORY: {
+				success = copy(input, buffer.data(), 6, trace_path) && write(&packet_type, 1) && write(buffer.data(), 6);
+				break;
+			}
+			default: {
+				char message[128];
+				snprintf(message, sizeof(message), "Invalid packet type 0x%x in %s.", packet_type, trace_path.c_str());
+				error = message;
+				success = false;
+			}
+		}
+	}
+	fclose(input);
+	// Like scan_trace_info, the program is hashed as of the last snapshot.
+	if(trace.snapshot_count > 0) {
+		trace.program_hash = hash_program(program.data());
+	}
+
+	if(!success) {
+		// Whatever was written of this trace is left in the file, but since
+		// nothing in the index refers to it, it's never read.
+		for(std::size_t i = program_count; i < index.program_hashes.size(); i++) {
+			programs.erase(index.program_hashes[i]);
+		}
+		index.program_hashes.resize(program_count);
+		index.program_offsets.resize(program_count);
+		programs_reused = reused;
+		return false;
+	}
+	trace.size = position - trace.offset;
+	index.traces.emplace_back(std::move(trace));
+	return true;
+}
+
+bool SessionContainerWriter::close()
+{
+	if(file == nullptr) {
+		return !write_failed;
+	}
+	// Don't write an index if something went wrong writing the file, so that
+	// the last good one is still used.
+	if(!write_failed) {
+		index.index_offset = position;
+		u32 counts[2] = {(u32) index.traces.size(), (u32) index.program_hashes.size()};
+		bool success = write("VUSI", 4) && write(counts, sizeof(counts));
+		for(std::size_t i = 0; success && i < index.program_hashes.size(); i++) {
+			success = write(&index.program_hashes[i], 8) && write(&index.program_offsets[i], 8);
+		}
+		for(std::size_t i = 0; success && i < index.traces.size(); i++) {
+			const ContainerTrace &trace = index.traces[i];
+			u64 fields[5] = {trace.offset, trace.size, trace.snapshot_count, trace.kick_count, trace.program_hash};
+			u32 name_size = (u32) trace.name.size();
+			success = write(fields, sizeof(fields)) && write(&trace.entry_pc, 4)
+				&& write(&name_size, 4) && write(trace.name.data(), name_size);
+		}
+		if(success && write(&index.index_offset, 8) && write("VUSE", 4)) {
+			index.file_size = position;
+		}
+	}
+	if(fclose(file) != 0 && !write_failed) {
+		error = "Failed to write " + index.path + ".";
+		write_failed = true;
+	}
+	file = nullptr;
+	return !write_failed;
+}
+
+bool SessionContainerWriter::copy(FILE *input, void *buffer, std::size_t size, const std::string &input_path)
+{
+	if(fread(buffer, size, 1, input) != 1) {
+		error = "Unexpected end of " + input_path + ".";
+		return false;
+	}
+	return true;
+}
+
+bool SessionContainerWriter::write(const void *data, std::size_t size)
+{
+	if(fwrite(data, size, 1, file) != 1) {
+		error = "Failed to write " + index.path + ".";
+		write_failed = true;
+		return false;
+	}
+	position += size;
+	return true;
+}
+
+bool is_session_container(const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if(file == nullptr) {
+		return false;
+	}
+	char magic[4];
+	bool result = fread(magic, 4, 1, file) == 1 && memcmp(magic, "VUSC", 4) == 0;
+	fclose(file);
+	return result;
+}
+
+// Check the header, then read the trailer to find the index and read that
+// in one go.
+bool read_session_container(SessionContainer &dest, const std::string &path, std::string &error)
+{
+	dest = SessionContainer();
+	dest.path = path;
+	std::error_code ec;
+	dest.file_size = std::filesystem::file_size(path, ec);
+	FILE *file = fopen(path.c_str(), "rb");
+	if(ec || file == nullptr) {
+		if(file) fclose(file);
+		error = "Failed to open " + path + ".";
+		return false;
+	}
+	u8 header[8];
+	u8 trailer[TRAILER_SIZE];
+	bool success = fread(header, sizeof(header), 1, file) == 1 && memcmp(header, "VUSC", 4) == 0
+		&& dest.file_size >= sizeof(header) + TRAILER_SIZE
+		&& seek_file(file, dest.file_size - TRAILER_SIZE)
+		&& fread(trailer, sizeof(trailer), 1, file) == 1 && memcmp(&trailer[8], "VUSE", 4) == 0;
+	if(!success) {
+		fclose(file);
+		error = path + " isn't a session container, or wasn't closed properly.";
+		return false;
+	}
+	u32 version;
+	memcpy(&version, &header[4], 4);
+	if(version > SessionContainer::FORMAT_VERSION) {
+		fclose(file);
+		error = "Session container format version too new!";
+		return false;
+	}
+	memcpy(&dest.index_offset, trailer, 8);
+	std::vector<u8> data;
+	if(dest.index_offset >= sizeof(header) && dest.index_offset <= dest.file_size - TRAILER_SIZE) {
+		data.resize(dest.file_size - TRAILER_SIZE - dest.index_offset);
+		success = seek_file(file, dest.index_offset) && (data.empty() || fread(data.data(), data.size(), 1, file) == 1);
+	} else {
+		success = false;
+	}
+	fclose(file);
+
+	std::size_t offset = 0;
+	auto read = [&](void *value, std::size_t size) {
+		if(!success || size > data.size() - offset) {
+			success = false;
+			return false;
+		}
+		memcpy(value, &data[offset], size);
+		offset += size;
+		return true;
+	};
+	char magic[4];
+	u32 counts[2] = {0, 0};
+	success = read(magic, 4) && memcmp(magic, "VUSI", 4) == 0 && read(counts, sizeof(counts));
+	for(u32 i = 0; success && i < counts[1]; i++) {
+		u64 hash, program_offset;
+		if(read(&hash, 8) && read(&program_offset, 8)) {
+			dest.program_hashes.push_back(hash);
+			dest.program_offsets.push_back(program_offset);
+		}
+	}
+	for(u32 i = 0; success && i < counts[0]; i++) {
+		ContainerTrace trace;
+		u64 fields[5];
+		u32 name_size = 0;
+		if(read(fields, sizeof(fields)) && read(&trace.entry_pc, 4) && read(&name_size, 4)) {
+			trace.name.resize(name_size);
+			read(trace.name.data(), name_size);
+		}
+		trace.offset = fields[0];
+		trace.size = fields[1];
+		trace.snapshot_count = fields[2];
+		trace.kick_count = fields[3];
+		trace.program_hash = fields[4];
+		if(trace.offset > dest.index_offset || trace.size > dest.index_offset - trace.offset) {
+			success = false;
+		}
+		dest.traces.emplace_back(std::move(trace));
+	}
+	if(!success) {
+		error = "The index of " + path + " is corrupted.";
+		return false;
+	}
+	return true;
+}
+
+std::shared_ptr<const SessionContainer> open_session_container(const std::string &path, std::string &error)
+{
+	static std::mutex mutex;
+	static std::map<std::string, std::shared_ptr<const SessionContainer>> cache;
+
+	std::error_code ec;
+	u64 file_size = std::filesystem::file_size(path, ec);
+	std::lock_guard<std::mutex> lock(mutex);
+	auto iter = cache.find(path);
+	if(!ec && iter != cache.end() && iter->second->file_size == file_size) {
+		return iter->second;
+	}
+	std::shared_ptr<SessionContainer> container = std::make_shared<SessionContainer>();
+	if(!read_session_container(*container, path, error)) {
+		return nullptr;
+	}
+	cache[path] = container;
+	return container;
+}
+
+bool split_container_path(const std::string &path, std::string &container, std::size_t &trace)
+{
+	std::size_t hash = path.rfind('#');
+	if(hash == std::string::npos || hash + 1 == path.size()) {
+		return false;
+	}
+	for(std::size_t i = hash + 1; i < path.size(); i++) {
+		if(path[i] < '0' || path[i] > '9') {
+			return false;
+		}
+	}
+	std::error_code ec;
+	if(std::filesystem::exists(path, ec)) {
+		return false;
+	}
+	container = path.substr(0, hash);
+	trace = (std::size_t) strtoull(path.c_str() + hash + 1, nullptr, 10);
+	return true;
+}
+
+std::string container_trace_path(const std::string &container, std::size_t trace)
+{
+	return container + "#" + std::to_string(trace);
+}
@@ -0,0 +1,112 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SESSIONCONTAINER_H
+#define SESSIONCONTAINER_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+#include "pcsx2defs.h"
+
+// A whole capture session packed into one file, so that tools don't have to
+// list a directory and open hundreds of files. Each trace is stored as a
+// segment holding a complete version 3 trace, except that the second and
+// later times a program appears in the container (by hash) the 'I' packet is
+// replaced by an 'i' packet that refers to the copy already stored. The
+// index at the end of the file lists the segments and programs, along with
+// the summary the session browser shows for each trace.
+//
+// A trace inside a container is opened with a path of the form
+// session.vus#12, where 12 is its position in the index. The index is read
+// once per process and shared, so opening one of its traces only takes a
+// single seek.
+struct ContainerTrace
+{
+	std::string name; // The file the trace was packed from e.g. trace000012.bin.
+	u64 offset = 0; // The start of the segment i.e. its "VUTR" header.
+	u64 size = 0;
+	u64 snapshot_count = 0;
+	u64 kick_count = 0;
+	u64 program_hash = 0; // Of the program at the last snapshot.
+	u32 entry_pc = 0; // The address of the first instruction executed.
+};
+
+struct SessionContainer
+{
+	static constexpr u32 FORMAT_VERSION = 1;
+
+	std::string path;
+	u64 file_size = 0;
+	u64 index_offset = 0;
+	std::vector<ContainerTrace> traces;
+	std::vector<u64> program_hashes;
+	// Where the data of each program's 'I' packet is, inside the segment of
+	// the first trace that used it.
+	std::vector<u64> program_offsets;
+};
+
+// Appends traces to a container, creating it if it doesn't exist yet. The
+// new index is written after the new traces by close(), and the old one is
+// left where it was, so the file is only ever appended to.
+class SessionContainerWriter
+{
+public:
+	SessionContainerWriter() = default;
+	~SessionContainerWriter() { close(); }
+	SessionContainerWriter(const SessionContainerWriter&) = delete;
+	SessionContainerWriter &operator=(const SessionContainerWriter&) = delete;
+
+	bool open(const std::string &path);
+	// Copy a version 3 trace into the container as a new segment. If the
+	// trace can't be read, error is set and more traces can still be added.
+	bool add_trace(const std::string &trace_path, const std::string &name);
+	// Write the index. Returns false if anything couldn't be written.
+	bool close();
+
+	const SessionContainer &container() const { return index; }
+	std::size_t programs_reused = 0; // 'I' packets replaced by 'i' packets.
+	std::string error;
+
+private:
+	bool copy(FILE *input, void *buffer, std::size_t size, const std::string &input_path);
+	bool write(const void *data, std::size_t size);
+
+	FILE *file = nullptr;
+	SessionContainer index;
+	std::map<u64, u32> programs; // Hash to index in the program table.
+	u64 position = 0;
+	bool write_failed = false;
+};
+
+// Returns whether the file at path starts with the container magic.
+bool is_session_container(const std::string &path);
+bool read_session_container(SessionContainer &dest, const std::string &path, std::string &error);
+// Read the index of a container, or return the copy read earlier if the
+// file hasn't changed size since. Safe to call from several threads.
+std::shared_ptr<const SessionContainer> open_session_container(const std::string &path, std::string &error);
+// Split a path like session.vus#12 into the container and the trace index.
+// Returns false for anything else, including files that happen to have a #
+// in their name.
+bool split_container_path(const std::string &path, std::string &container, std::size_t &trace);
+std::string container_trace_path(const std::string &container, std::size_t trace);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Cuts a range of snapshots out of a trace, or joins traces together, so
+// the interesting part of a long capture can be passed around on its own.
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "traceedit.h"
+#include "session.h"
+#include "sessioncontainer.h"
+
+int main(int argc, char **argv)
+{
+	std::string output_path;
+	bool concat = false;
+	bool has_range = false;
+	std::size_t first = 0, last = SIZE_MAX;
+	std::vector<std::string> inputs;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			output_path = argv[++i];
+		} else if(strcmp(argv[i], "--range") == 0 && i + 2 < argc) {
+			first = strtoull(argv[++i], nullptr, 10);
+			last = strtoull(argv[++i], nullptr, 10);
+			has_range = true;
+		} else if(strcmp(argv[i], "--concat") == 0) {
+			concat = true;
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if(output_path.empty() || inputs.empty() || (!concat && (!has_range || inputs.size() != 1))) {
+		fprintf(stderr, "usage: %s --range <first> <last> --output <output file> <trace file>\n", argv[0]);
+		fprintf(stderr, "       %s --concat [--range <first> <last>] --output <output file> <trace files, vutrace_output directory or session container>\n", argv[0]);
+		fprintf(stderr, "--range copies snapshots first to last inclusive into a new trace.\n");
+		fprintf(stderr, "--concat joins traces together in the order given. For a directory or a\n");
+		fprintf(stderr, "session container, the traces are joined in order and --range selects the\n");
+		fprintf(stderr, "traces by number.\n");
+		return 1;
+	}
+
+	TraceEditStats stats;
+	std::string error;
+	bool success;
+	if(concat) {
+		std::vector<std::string> paths;
+		for(const std::string &input : inputs) {
+			if(!std::filesystem::is_directory(input) && !is_session_container(input)) {
+				paths.push_back(input);
+				continue;
+			}
+			Session session;
+			if(!open_session(session, input)) {
+				fprintf(stderr, "Error: Failed to open %s.\n", input.c_str());
+				return 1;
+			}
+			for(const std::unique_ptr<TraceInfo> &trace : session.traces) {
+				if(!has_range || (trace->index >= 0 && (std::size_t) trace->index >= first && (std::size_t) trace->index <= last)) {
+					paths.push_back(trace->path);
+				}
+			}
+		}
+		if(paths.empty()) {
+			fprintf(stderr, "Error: No traces to concatenate.\n");
+			return 1;
+		}
+		success = concatenate_traces(stats, paths, output_path, error);
+		if(success) {
+			fprintf(stderr, "Concatenated %zu traces.\n", paths.size());
+		}
+	} else {
+		success = slice_trace(stats, inputs[0], first, last, output_path, error);
+	}
+	if(!success) {
+		fprintf(stderr, "Error: %s\n", error.c_str());
+		return 1;
+	}
+	fprintf(stderr, "Wrote %zu snapshots to %s.\n", stats.snapshots_written, output_path.c_str());
+	return 0;
+}
@@ -0,0 +1,401 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "snapshotstore.h"
+
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+#include "session.h"
+
+static const std::size_t RECENT_COUNT = 8;
+// Scans over the per-snapshot arrays check this many snapshots at a time
+// without stopping early, so the comparisons can be vectorised.
+static const std::size_t SCAN_BLOCK = 64;
+
+bool SnapshotStore::load(const std::string &path, std::string &error)
+{
+	clear();
+	TraceReader reader;
+	if(!reader.open(path)) {
+		error = reader.error;
+		return false;
+	}
+	while(reader.next_snapshot()) {
+		add_snapshot(reader.snapshot(), reader.pc());
+	}
+	close_block();
+	if(!reader.error.empty()) {
+		error = reader.error;
+		clear();
+		return false;
+	}
+	if(pc_list.empty()) {
+		error = path + " contains no snapshots.";
+		return false;
+	}
+	last_program.assign(reader.snapshot().program, reader.snapshot().program + VU1_PROGSIZE);
+	return true;
+}
+
+void SnapshotStore::follow(const std::string &path)
+{
+	clear();
+	follow_reader = std::make_unique<TraceReader>();
+	follow_reader->follow = true;
+	follow_path = path;
+}
+
+std::size_t SnapshotStore::poll(std::size_t max_count)
+{
+	if(!follow_reader) {
+		return 0;
+	}
+	// Wait until at least the header has been written.
+	std::error_code error_code;
+	u64 file_size = std::filesystem::file_size(follow_path, error_code);
+	if(error_code || file_size < 8) {
+		return 0;
+	}
+	if(follow_reader->version == 0 && !follow_reader->open(follow_path)) {
+		error = follow_reader->error;
+		follow_reader.reset();
+		return 0;
+	}
+	if(file_size < follow_reader->position()) {
+		error = follow_path + " got shorter while it was being followed.";
+		follow_reader.reset();
+		return 0;
+	}
+	std::size_t count = 0;
+	while(count < max_count && follow_reader->next_snapshot()) {
+		add_snapshot(follow_reader->snapshot(), follow_reader->pc());
+		count++;
+	}
+	if(count > 0) {
+		const u8 *program = follow_reader->snapshot().program;
+		last_program.assign(program, program + VU1_PROGSIZE);
+	}
+	if(!follow_reader->error.empty()) {
+		error = follow_reader->error;
+		follow_reader.reset();
+	}
+	return count;
+}
+
+void SnapshotStore::clear()
+{
+	follow_reader.reset();
+	follow_path.clear();
+	pc_list = std::vector<u32>();
+	instruction_list = std::vector<u64>();
+	read_addr_list = std::vector<u32>();
+	read_size_list = std::vector<u32>();
+	write_addr_list = std::vector<u32>();
+	write_size_list = std::vector<u32>();
+	flag_list = std::vector<u8>();
+	last_program.clear();
+	blocks = std::vector<Block>();
+	block_open = false;
+	resident = 0;
+	clock = 0;
+	if(spill) {
+		fclose(spill);
+		spill = nullptr;
+	}
+	spill_size = 0;
+	spill_read_failed = false;
+	spill_write_failed = false;
+	cursor_valid = false;
+	recent.clear();
+	error.clear();
+}
+
+std::shared_ptr<const Snapshot> SnapshotStore::get(std::size_t snapshot)
+{
+	for(auto &[index, decoded] : recent) {
+		if(index == snapshot) {
+			return decoded;
+		}
+	}
+	std::size_t block = snapshot / KEYFRAME_INTERVAL;
+	std::lock_guard<std::mutex> lock(block_mutex);
+	if(snapshot >= size() || !page_in(block)) {
+		return std::make_shared<Snapshot>();
+	}
+	if(!cursor) {
+		cursor.reset(new Snapshot);
+	}
+
+	const u8 *data = blocks[block].data.data();
+	std::size_t index, offset;
+	if(cursor_valid && cursor_index / KEYFRAME_INTERVAL == block && cursor_index <= snapshot) {
+		index = cursor_index;
+		offset = cursor_offset;
+	} else {
+		index = block * KEYFRAME_INTERVAL;
+		offset = decode_snapshot(*cursor, data, 0);
+	}
+	for(; index < snapshot; index++) {
+		offset = decode_snapshot(*cursor, data, offset);
+	}
+	cursor_index = snapshot;
+	cursor_offset = offset;
+	cursor_valid = true;
+
+	std::shared_ptr<Snapshot> result = std::make_shared<Snapshot>(*cursor);
+	result->read_addr = read_addr_list[snapshot];
+	result->read_size = read_size_list[snapshot];
+	result->write_addr = write_addr_list[snapshot];
+	result->write_size = write_size_list[snapshot];
+	if(recent.size() >= RECENT_COUNT) {
+		recent.pop_back();
+	}
+	recent.emplace(recent.begin(), snapshot, result);
+	return result;
+}
+
+bool SnapshotStore::read_block(std::size_t block, std::vector<u8> &dest)
+{
+	std::lock_guard<std::mutex> lock(block_mutex);
+	if(block >= blocks.size() || !page_in(block)) {
+		return false;
+	}
+	dest = blocks[block].data;
+	return true;
+}
+
+void SnapshotStore::set_budget(std::size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(block_mutex);
+	budget_bytes = bytes;
+	evict(SIZE_MAX);
+}
+
+const char *SnapshotStore::spill_error() const
+{
+	if(spill_write_failed) {
+		return "Failed to write to the snapshot spill file.";
+	}
+	if(spill_read_failed) {
+		return "Failed to read from the snapshot spill file.";
+	}
+	return nullptr;
+}
+
+void SnapshotStore::add_snapshot(const Snapshot &snapshot, u32 pc)
+{
+	std::lock_guard<std::mutex> lock(block_mutex);
+	if(pc_list.size() % KEYFRAME_INTERVAL == 0) {
+		close_block();
+		if(!encoder) {
+			encoder = std::make_unique<SnapshotEncoder>();
+		}
+		encoder->reset();
+		blocks.emplace_back();
+		block_open = true;
+	}
+	Block &block = blocks.back();
+	BlockOutput output{block.data};
+	encoder->encode(output, snapshot);
+	resident += block.data.size() - block.size;
+	block.size = block.data.size();
+	block.last_used = ++clock;
+
+	u64 instruction;
+	memcpy(&instruction, &snapshot.program[pc], INSN_PAIR_SIZE);
+	u8 flags = 0;
+	if(snapshot.read_size > 0) flags |= SNAPSHOT_LOAD;
+	if(snapshot.write_size > 0) flags |= SNAPSHOT_STORE;
+	if(is_xgkick((u32) instruction)) flags |= SNAPSHOT_XGKICK;
+	pc_list.push_back(pc);
+	instruction_list.push_back(instruction);
+	read_addr_list.push_back(snapshot.read_addr);
+	read_size_list.push_back(snapshot.read_size);
+	write_addr_list.push_back(snapshot.write_addr);
+	write_size_list.push_back(snapshot.write_size);
+	flag_list.push_back(flags);
+}
+
+// Called once the last block is full, or there are no more snapshots.
+void SnapshotStore::close_block()
+{
+	if(!block_open) {
+		return;
+	}
+	block_open = false;
+	blocks.back().data.shrink_to_fit();
+	evict(blocks.size() - 1);
+}
+
+bool SnapshotStore::page_in(std::size_t index)
+{
+	Block &block = blocks[index];
+	block.last_used = ++clock;
+	if(!block.data.empty()) {
+		return true;
+	}
+	block.data.resize(block.size);
+	if(!seek_file(spill, block.spill_offset) || fread(block.data.data(), block.size, 1, spill) != 1) {
+		spill_read_failed = true;
+		block.data = std::vector<u8>();
+		return false;
+	}
+	resident += block.size;
+	evict(index);
+	return true;
+}
+
+// Free the least recently used blocks, other than the one at index keep,
+// until the budget is met. Blocks are only written to the spill file the
+// first time they're evicted since they never change.
+void SnapshotStore::evict(std::size_t keep)
+{
+	while(resident > budget_bytes && !spill_write_failed) {
+		std::size_t oldest = SIZE_MAX;
+		for(std::size_t i = 0; i < blocks.size(); i++) {
+			bool is_open = block_open && i == blocks.size() - 1;
+			if(i != keep && !is_open && !blocks[i].data.empty() && (oldest == SIZE_MAX || blocks[i].last_used < blocks[oldest].last_used)) {
+				oldest = i;
+			}
+		}
+		if(oldest == SIZE_MAX) {
+			return;
+		}
+		Block &block = blocks[oldest];
+		if(!block.spilled) {
+			if(spill == nullptr) {
+				spill = tmpfile();
+			}
+			if(spill == nullptr || !seek_file(spill, spill_size) || fwrite(block.data.data(), block.size, 1, spill) != 1) {
+				spill_write_failed = true;
+				return;
+			}
+			block.spill_offset = spill_size;
+			block.spilled = true;
+			spill_size += block.size;
+		}
+		block.data = std::vector<u8>();
+		resident -= block.size;
+	}
+}
+
+// Returns the first index in [begin, end) for which match returns true, or
+// end if there isn't one.
+template <typename Match>
+static std::size_t scan_forward(std::size_t begin, std::size_t end, Match match)
+{
+	std::size_t index = begin;
+	for(; index + SCAN_BLOCK <= end; index += SCAN_BLOCK) {
+		bool found = false;
+		for(std::size_t i = index; i < index + SCAN_BLOCK; i++) {
+			found |= match(i);
+		}
+		if(found) {
+			break;
+		}
+	}
+	for(; index < end; index++) {
+		if(match(index)) {
+			return index;
+		}
+	}
+	return end;
+}
+
+// Returns the last index in [begin, end) for which match returns true, or
+// SIZE_MAX if there isn't one.
+template <typename Match>
+static std::size_t scan_backward(std::size_t begin, std::size_t end, Match match)
+{
+	std::size_t index = end;
+	for(; index >= begin + SCAN_BLOCK; index -= SCAN_BLOCK) {
+		bool found = false;
+		for(std::size_t i = index - SCAN_BLOCK; i < index; i++) {
+			found |= match(i);
+		}
+		if(found) {
+			break;
+		}
+	}
+	for(; index > begin; index--) {
+		if(match(index - 1)) {
+			return index - 1;
+		}
+	}
+	return SIZE_MAX;
+}
+
+// Step through the snapshots step at a time from the given one until one with
+// the target PC is found, and set snapshot to it. Only the PC array is looked
+// at, so no snapshots are decoded.
+bool find_pc(const SnapshotStore &store, std::size_t &snapshot, u32 target_pc, int step)
+{
+	const u32 *pcs = store.pcs().data();
+	auto match = [&](std::size_t i) { return pcs[i] == target_pc; };
+	std::size_t index;
+	if(step == 1) {
+		index = scan_forward(snapshot + 1, store.size(), match);
+		if(index == store.size()) {
+			return false;
+		}
+	} else if(step == -1) {
+		index = scan_backward(0, std::min(snapshot, store.size()), match);
+		if(index == SIZE_MAX) {
+			return false;
+		}
+	} else {
+		index = snapshot;
+		do {
+			if(-step > (int) index || index + step >= store.size()) {
+				return false;
+			}
+			index += step;
+		} while(pcs[index] != target_pc);
+	}
+	snapshot = index;
+	return true;
+}
+
+bool find_memory_access(const SnapshotStore &store, std::size_t &snapshot, u32 address)
+{
+	if(store.empty()) {
+		return false;
+	}
+	const u8 *flags = store.flags().data();
+	const u32 *read_addrs = store.read_addrs().data();
+	const u32 *write_addrs = store.write_addrs().data();
+	u32 qword = address / 0x10;
+	auto match = [&](std::size_t i) {
+		bool is_load = (flags[i] & SNAPSHOT_LOAD) != 0;
+		bool is_store = (flags[i] & SNAPSHOT_STORE) != 0;
+		return (is_load & (read_addrs[i] / 0x10 == qword)) | (is_store & (write_addrs[i] / 0x10 == qword));
+	};
+	std::size_t start = std::min(snapshot + 1, store.size());
+	std::size_t index = scan_forward(start, store.size(), match);
+	if(index == store.size()) {
+		// Wrap around, ending on the snapshot that was passed in.
+		index = scan_forward(0, start, match);
+		if(index == start) {
+			return false;
+		}
+	}
+	snapshot = index;
+	return true;
+}
@@ -0,0 +1,182 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SNAPSHOTSTORE_H
+#define SNAPSHOTSTORE_H
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdio.h>
+
+#include "pcsx2defs.h"
+#include "trace.h"
+#include "traceedit.h"
+
+// Bits set in SnapshotStore::flags for each snapshot.
+enum SnapshotFlags : u8
+{
+	SNAPSHOT_LOAD = 1 << 0, // read_size is non-zero.
+	SNAPSHOT_STORE = 1 << 1, // write_size is non-zero.
+	SNAPSHOT_XGKICK = 1 << 2 // The lower instruction at the PC is an XGKICK.
+};
+
+// Holds the snapshots of a trace as a full keyframe every KEYFRAME_INTERVAL
+// snapshots followed by the registers and words of memory that changed for
+// each of the snapshots after it. A keyframe and its deltas make up a block,
+// which is encoded as trace packets by a SnapshotEncoder and read back with
+// decode_snapshot. When the blocks in memory exceed the budget, the least recently
+// used ones are written to a temporary spill file and freed, and read back
+// when a snapshot in them is needed again.
+//
+// The parts of each snapshot that are needed to draw the snapshot list and to
+// search a trace are kept in memory separately, as one array per field, so
+// that a scan over one of them only touches a few bytes per snapshot.
+class SnapshotStore
+{
+public:
+	static constexpr std::size_t KEYFRAME_INTERVAL = 256;
+	static constexpr std::size_t DEFAULT_BUDGET = (std::size_t) 1024 * 1024 * 1024;
+
+	SnapshotStore() = default;
+	~SnapshotStore() { clear(); }
+	SnapshotStore(const SnapshotStore&) = delete;
+	SnapshotStore &operator=(const SnapshotStore&) = delete;
+
+	bool load(const std::string &path, std::string &error);
+	// Start following a trace that's still being written. The store starts
+	// out empty, and each call to poll() adds the snapshots that have been
+	// written since the last one. The file doesn't have to exist yet. If
+	// something goes wrong, error is set and the store stops following.
+	void follow(const std::string &path);
+	// Returns the number of snapshots added, which is at most max_count so
+	// that catching up with a long trace doesn't hold up the caller.
+	std::size_t poll(std::size_t max_count = SIZE_MAX);
+	bool following() const { return follow_reader != nullptr; }
+	void clear();
+
+	std::size_t size() const { return pc_list.size(); }
+	bool empty() const { return pc_list.empty(); }
+	u32 pc(std::size_t snapshot) const { return pc_list[snapshot]; }
+	// The instruction pair at the PC.
+	const u8 *instruction(std::size_t snapshot) const { return (const u8*) &instruction_list[snapshot]; }
+	u32 read_addr(std::size_t snapshot) const { return read_addr_list[snapshot]; }
+	u32 read_size(std::size_t snapshot) const { return read_size_list[snapshot]; }
+	u32 write_addr(std::size_t snapshot) const { return write_addr_list[snapshot]; }
+	u32 write_size(std::size_t snapshot) const { return write_size_list[snapshot]; }
+	u8 flags(std::size_t snapshot) const { return flag_list[snapshot]; }
+	const std::vector<u32> &pcs() const { return pc_list; }
+	const std::vector<u64> &instructions() const { return instruction_list; }
+	const std::vector<u32> &read_addrs() const { return read_addr_list; }
+	const std::vector<u32> &write_addrs() const { return write_addr_list; }
+	const std::vector<u8> &flags() const { return flag_list; }
+	// The program as of the last snapshot.
+	const u8 *program() const { return last_program.data(); }
+
+	// Decode a snapshot. Stepping forwards through a block only applies the
+	// deltas in between, so scanning snapshots in order is cheap. If the
+	// spill file can't be read, spill_error() is set and a zeroed snapshot
+	// is returned.
+	std::shared_ptr<const Snapshot> get(std::size_t snapshot);
+	// Copy the encoded data of a block, which holds snapshots
+	// block * KEYFRAME_INTERVAL onwards, reading it back in from the spill
+	// file if needed. Can be called from several threads at once, and at the
+	// same time as get(), but not while snapshots are being added.
+	bool read_block(std::size_t block, std::vector<u8> &dest);
+
+	void set_budget(std::size_t bytes);
+	std::size_t budget() const { return budget_bytes; }
+	std::size_t resident_bytes() const { return resident; }
+	std::size_t spilled_bytes() const { return spill_size; }
+	std::size_t block_count() const { return blocks.size(); }
+	// Set if a block couldn't be written to or read back from the spill file,
+	// otherwise null. Unlike error, this can be set by read_block() on
+	// another thread, so it's kept separately. If writing fails, blocks stop
+	// being evicted and the budget is ignored.
+	const char *spill_error() const;
+
+	// Set if loading or following the trace failed.
+	std::string error;
+
+private:
+	struct Block
+	{
+		std::vector<u8> data;
+		std::size_t size = 0;
+		u64 spill_offset = 0;
+		bool spilled = false; // The spill file has a copy of the data.
+		u64 last_used = 0;
+	};
+	struct BlockOutput
+	{
+		std::vector<u8> &data;
+		void put(const void *bytes, std::size_t size) { data.insert(data.end(), (const u8*) bytes, (const u8*) bytes + size); }
+	};
+
+	void add_snapshot(const Snapshot &snapshot, u32 pc);
+	void close_block();
+	bool page_in(std::size_t block);
+	void evict(std::size_t keep);
+
+	std::vector<u32> pc_list;
+	std::vector<u64> instruction_list;
+	std::vector<u32> read_addr_list;
+	std::vector<u32> read_size_list;
+	std::vector<u32> write_addr_list;
+	std::vector<u32> write_size_list;
+	std::vector<u8> flag_list;
+	std::vector<u8> last_program;
+	std::vector<Block> blocks;
+	std::size_t budget_bytes = DEFAULT_BUDGET;
+	// Read by the GUI while a search is paging blocks in on another thread.
+	std::atomic<std::size_t> resident{0};
+	u64 clock = 0;
+	FILE *spill = nullptr;
+	std::atomic<std::size_t> spill_size{0};
+	// Written while block_mutex is held, read by spill_error() without it.
+	std::atomic<bool> spill_read_failed{false};
+	std::atomic<bool> spill_write_failed{false};
+	// Held while the blocks are read or changed, so get() and read_block()
+	// can be called from different threads.
+	std::mutex block_mutex;
+	// Holds the last snapshot added, which the next one is encoded relative
+	// to.
+	std::unique_ptr<SnapshotEncoder> encoder;
+	// Snapshots can still be added to the last block, so it can't be evicted.
+	bool block_open = false;
+	std::unique_ptr<TraceReader> follow_reader;
+	std::string follow_path;
+
+	// The last snapshot decoded, so the next one can be decoded from it.
+	std::unique_ptr<Snapshot> cursor;
+	std::size_t cursor_index = 0;
+	std::size_t cursor_offset = 0; // Where the next delta starts in its block.
+	bool cursor_valid = false;
+	// Most of the GUI looks at the same few snapshots every frame.
+	std::vector<std::pair<std::size_t, std::shared_ptr<const Snapshot>>> recent;
+};
+
+bool find_pc(const SnapshotStore &store, std::size_t &snapshot, u32 target_pc, int step);
+// Find the next snapshot after the given one that loads from or stores to the
+// quadword containing address, wrapping around at the end of the trace.
+bool find_memory_access(const SnapshotStore &store, std::size_t &snapshot, u32 address);
+
+#endif
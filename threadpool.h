@@ -0,0 +1,117 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+// A fixed set of worker threads pulling jobs from a queue. Since each worker
+// only runs one job at a time, the number of workers also bounds how many
+// traces are being read at once.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(std::size_t thread_count = 0)
+	{
+		if(thread_count == 0) {
+			thread_count = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for(std::size_t i = 0; i < thread_count; i++) {
+			workers.emplace_back([this]() { worker(); });
+		}
+	}
+
+	// Jobs that haven't started yet are dropped.
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			pending -= jobs.size();
+			jobs.clear();
+		}
+		job_available.notify_all();
+		// Wake up any wait() that was only waiting on the jobs dropped above.
+		all_done.notify_all();
+		for(std::thread &thread : workers) {
+			thread.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool &operator=(const ThreadPool&) = delete;
+
+	void submit(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(std::move(job));
+			pending++;
+		}
+		job_available.notify_one();
+	}
+
+	// Block until every job submitted so far has finished.
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		all_done.wait(lock, [this]() { return pending == 0; });
+	}
+
+	std::size_t thread_count() const { return workers.size(); }
+
+private:
+	void worker()
+	{
+		for(;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				job_available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				if(jobs.empty()) {
+					return;
+				}
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending--;
+			}
+			all_done.notify_all();
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable job_available;
+	std::condition_variable all_done;
+	std::deque<std::function<void()>> jobs;
+	std::vector<std::thread> workers;
+	std::size_t pending = 0;
+	bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,287 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "trace.h"
+
+#include "sessioncontainer.h"
+
+bool TraceReader::open(const std::string &path)
+{
+	close();
+	*current = Snapshot();
+	snapshot_count = 0;
+	error.clear();
+	container.reset();
+	offset = 0;
+	end = UINT64_MAX;
+
+	std::string file_path = path;
+	std::size_t trace;
+	if(split_container_path(path, file_path, trace)) {
+		container = open_session_container(file_path, error);
+		if(!container) {
+			return false;
+		}
+		if(trace >= container->traces.size()) {
+			error = path + " doesn't exist, the container only has " + std::to_string(container->traces.size()) + " traces.";
+			return false;
+		}
+		offset = container->traces[trace].offset;
+		end = offset + container->traces[trace].size;
+	}
+
+	file = fopen(file_path.c_str(), "rb");
+	if(file == nullptr) {
+		error = "Failed to open " + file_path + ".";
+		return false;
+	}
+	setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+	u64 start = offset;
+	if(start > 0 && !seek_file(file, start)) {
+		error = "Failed to seek in " + file_path + ".";
+		return false;
+	}
+
+	char magic[4];
+	if(!read(magic, 4)) {
+		return false;
+	}
+	if(memcmp(magic, "VUTR", 4) == 0) {
+		if(!read(&version, 4)) {
+			return false;
+		}
+	} else {
+		version = 1;
+		offset = start;
+		seek_file(file, start);
+	}
+
+	if(version > 3) {
+		error = "Format version too new!";
+		return false;
+	}
+
+	return true;
+}
+
+void TraceReader::close()
+{
+	if(file) {
+		fclose(file);
+		file = nullptr;
+	}
+}
+
+bool TraceReader::next_snapshot()
+{
+	if(file == nullptr || !error.empty()) {
+		return false;
+	}
+	if(!follow) {
+		return read_snapshot();
+	}
+	u64 start = position();
+	if(read_snapshot()) {
+		return true;
+	}
+	if(feof(file)) {
+		// The rest of the snapshot hasn't been written yet.
+		error.clear();
+		clearerr(file);
+		offset = start;
+		if(!seek_file(file, start)) {
+			error = "Failed to seek in trace file.";
+		}
+	}
+	return false;
+}
+
+u64 TraceReader::position() const
+{
+	return file ? offset : 0;
+}
+
+bool TraceReader::read_snapshot()
+{
+	Snapshot &state = *current;
+	state.read_addr = 0;
+	state.read_size = 0;
+	state.write_addr = 0;
+	state.write_size = 0;
+
+	u8 packet_type = VUTRACE_NULLPACKET;
+	while(offset < end && fread(&packet_type, 1, 1, file) == 1) {
+		offset++;
+		switch(packet_type) {
+			case VUTRACE_PUSHSNAPSHOT: {
+				if(pc() >= VU1_PROGSIZE || pc() % INSN_PAIR_SIZE != 0) {
+					error = "Bad program counter value.";
+					return false;
+				}
+				snapshot_count++;
+				return true;
+			}
+			case VUTRACE_SETREGISTERS: {
+				if(version == 1) {
+					old_pcsx2_structs_v1::VURegs old_regs = {};
+					if(!read(&old_regs, sizeof(old_regs))) return false;
+					memcpy(state.registers.VF, old_regs.VF, sizeof(state.registers.VF));
+					memcpy(state.registers.VI, old_regs.VI, sizeof(state.registers.VI));
+					state.registers.ACC = old_regs.ACC;
+					state.registers.q = old_regs.q;
+					state.registers.p = old_regs.p;
+				} else if(version == 2) {
+					old_pcsx2_structs_v2::VURegs old_regs = {};
+					if(!read(&old_regs, sizeof(old_regs))) return false;
+					memcpy(state.registers.VF, old_regs.VF, sizeof(state.registers.VF));
+					memcpy(state.registers.VI, old_regs.VI, sizeof(state.registers.VI));
+					state.registers.ACC = old_regs.ACC;
+					state.registers.q = old_regs.q;
+					state.registers.p = old_regs.p;
+				} else {
+					if(!read(&state.registers.VF, sizeof(state.registers.VF))) return false;
+					if(!read(&state.registers.VI, sizeof(state.registers.VI))) return false;
+					if(!read(&state.registers.ACC, sizeof(state.registers.ACC))) return false;
+					if(!read(&state.registers.q, sizeof(state.registers.q))) return false;
+					if(!read(&state.registers.p, sizeof(state.registers.p))) return false;
+				}
+				break;
+			}
+			case VUTRACE_SETMEMORY: {
+				if(!read(state.memory, VU1_MEMSIZE)) return false;
+				break;
+			}
+			case VUTRACE_SETINSTRUCTIONS: {
+				if(!read(state.program, VU1_PROGSIZE)) return false;
+				break;
+			}
+			case VUTRACE_PROGRAMINDEX: {
+				u32 program = 0;
+				if(!read(&program, sizeof(u32))) return false;
+				if(!read_program(program)) return false;
+				break;
+			}
+			case VUTRACE_LOADOP: {
+				if(!read(&state.read_addr, sizeof(u32))) return false;
+				if(!read(&state.read_size, sizeof(u32))) return false;
+				break;
+			}
+			case VUTRACE_STOREOP: {
+				if(!read(&state.write_addr, sizeof(u32))) return false;
+				if(!read(&state.write_size, sizeof(u32))) return false;
+				break;
+			}
+			case VUTRACE_PATCHREGISTER: {
+				u8 index = 0;
+				u128 data = {};
+				if(!read(&index, sizeof(u8))) return false;
+				if(!read(&data, sizeof(u128))) return false;
+				if(index < 32) {
+					memcpy(&state.registers.VF[index], &data, 16);
+				} else if(index < 64) {
+					memcpy(&state.registers.VI[index - 32], &data, 16);
+				} else if(index == 64) {
+					memcpy(&state.registers.ACC, &data, 16);
+				} else if(index == 65) {
+					memcpy(&state.registers.q, &data, 16);
+				} else if(index == 66) {
+					memcpy(&state.registers.p, &data, 16);
+				} else {
+					error = "'r' packet has bad register index.";
+					return false;
+				}
+				break;
+			}
+			case VUTRACE_PATCHMEMORY: {
+				u16 address = 0;
+				u32 data = 0;
+				if(!read(&address, sizeof(u16))) return false;
+				if(!read(&data, sizeof(u32))) return false;
+				if(address <= VU1_MEMSIZE - 4) {
+					memcpy(&state.memory[address], &data, sizeof(data));
+				} else {
+					error = "'m' packet has address that is too big.";
+					return false;
+				}
+				break;
+			}
+			default: {
+				char message[128];
+				snprintf(message, sizeof(message), "Invalid packet type 0x%x in trace file at 0x%llx!",
+					packet_type, (unsigned long long) offset);
+				error = message;
+				return false;
+			}
+		}
+	}
+	if(offset < end && !feof(file)) {
+		error = "Failed to read trace!";
+	}
+	return false;
+}
+
+bool TraceReader::read(void *dest, std::size_t size)
+{
+	if(size > end - offset || fread(dest, size, 1, file) != 1) {
+		error = "Unexpected end of file.";
+		return false;
+	}
+	offset += size;
+	return true;
+}
+
+// Programs in a session container are only stored the first time they're
+// used, and referred to by index after that.
+bool TraceReader::read_program(u32 program)
+{
+	if(!container) {
+		error = "'i' packet outside of a session container.";
+		return false;
+	}
+	if(program >= container->program_offsets.size()) {
+		error = "'i' packet has bad program index.";
+		return false;
+	}
+	if(!seek_file(file, container->program_offsets[program])
+		|| fread(current->program, VU1_PROGSIZE, 1, file) != 1
+		|| !seek_file(file, offset)) {
+		error = "Failed to read program from session container.";
+		return false;
+	}
+	return true;
+}
+
+// 64-bit FNV-1a. Used to identify microprograms across traces.
+u64 hash_program(const u8 *program)
+{
+	u64 hash = 0xcbf29ce484222325;
+	for(u32 i = 0; i < VU1_PROGSIZE; i++) {
+		hash ^= program[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+bool seek_file(FILE *file, u64 offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, (s64) offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
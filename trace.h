@@ -0,0 +1,112 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdio.h>
+
+#include "pcsx2defs.h"
+
+struct SessionContainer;
+
+static const int INSN_PAIR_SIZE = 8;
+
+enum VUTracePacketType {
+	VUTRACE_NULLPACKET = 0,
+	VUTRACE_PUSHSNAPSHOT = 'P',
+	VUTRACE_SETREGISTERS = 'R',
+	VUTRACE_SETMEMORY = 'M',
+	VUTRACE_SETINSTRUCTIONS = 'I',
+	VUTRACE_LOADOP = 'L',
+	VUTRACE_STOREOP = 'S',
+	VUTRACE_PATCHREGISTER = 'r',
+	VUTRACE_PATCHMEMORY = 'm',
+	VUTRACE_PROGRAMINDEX = 'i' // Only in session containers, see sessioncontainer.h.
+};
+
+struct Snapshot
+{
+	VURegs registers = {};
+	u8 memory[VU1_MEMSIZE];
+	u8 program[VU1_PROGSIZE];
+	u32 read_addr = 0;
+	u32 read_size = 0;
+	u32 write_addr = 0;
+	u32 write_size = 0;
+};
+
+// Reads a trace file one snapshot at a time. The reader owns the current
+// state, which the packets of each snapshot are applied to in turn, so
+// tools that only need to look at each snapshot once (and not keep them all
+// around) can stream through a trace in constant memory.
+class TraceReader
+{
+public:
+	TraceReader() : current(new Snapshot) {}
+	~TraceReader() { close(); delete current; }
+	TraceReader(const TraceReader&) = delete;
+	TraceReader &operator=(const TraceReader&) = delete;
+
+	// The path can also refer to a trace inside a session container e.g.
+	// session.vus#12, see sessioncontainer.h.
+	bool open(const std::string &path);
+	void close();
+
+	// Apply packets up to and including the next 'P' packet. Returns false at
+	// the end of the file, or if an error occurred in which case error will
+	// be set.
+	bool next_snapshot();
+	// The offset of the next packet to be read.
+	u64 position() const;
+
+	const Snapshot &snapshot() const { return *current; }
+	u32 pc() const { return current->registers.VI[TPC].UL; }
+
+	u32 version = 0;
+	std::size_t snapshot_count = 0;
+	std::string error;
+	// For traces that are still being written. If the end of the file is
+	// reached part way through a snapshot, the reader goes back to the start
+	// of it instead of failing, so that next_snapshot can be called again
+	// once more of the file has been written. This works because every
+	// packet overwrites part of the state rather than modifying it, so
+	// applying the packets of a snapshot a second time has no effect.
+	bool follow = false;
+
+private:
+	bool read_snapshot();
+	bool read(void *dest, std::size_t size);
+	bool read_program(u32 program);
+
+	FILE *file = nullptr;
+	Snapshot *current;
+	u64 offset = 0;
+	u64 end = UINT64_MAX; // The end of the segment for a trace in a container.
+	std::shared_ptr<const SessionContainer> container;
+};
+
+u64 hash_program(const u8 *program);
+// Seek to an absolute offset, which can be past 2 GB on Windows too.
+bool seek_file(FILE *file, u64 offset);
+
+#endif
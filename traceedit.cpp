@@ -0,0 +1,243 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "traceedit.h"
+
+#include <filesystem>
+
+#include "sessioncontainer.h"
+
+std::size_t decode_snapshot(Snapshot &dest, const u8 *data, std::size_t offset, std::vector<u16> *changed_qwords)
+{
+	dest.read_size = 0;
+	dest.write_size = 0;
+	for(;;) {
+		switch(data[offset++]) {
+			case VUTRACE_PUSHSNAPSHOT: {
+				return offset;
+			}
+			case VUTRACE_SETREGISTERS: {
+				memcpy(&dest.registers, &data[offset], sizeof(VURegs));
+				offset += sizeof(VURegs);
+				break;
+			}
+			case VUTRACE_SETMEMORY: {
+				memcpy(dest.memory, &data[offset], VU1_MEMSIZE);
+				offset += VU1_MEMSIZE;
+				break;
+			}
+			case VUTRACE_SETINSTRUCTIONS: {
+				memcpy(dest.program, &data[offset], VU1_PROGSIZE);
+				offset += VU1_PROGSIZE;
+				break;
+			}
+			case VUTRACE_LOADOP: {
+				memcpy(&dest.read_addr, &data[offset], 4);
+				memcpy(&dest.read_size, &data[offset + 4], 4);
+				offset += 8;
+				break;
+			}
+			case VUTRACE_STOREOP: {
+				memcpy(&dest.write_addr, &data[offset], 4);
+				memcpy(&dest.write_size, &data[offset + 4], 4);
+				offset += 8;
+				break;
+			}
+			case VUTRACE_PATCHREGISTER: {
+				memcpy((u8*) &dest.registers + data[offset] * 16, &data[offset + 1], 16);
+				offset += 17;
+				break;
+			}
+			case VUTRACE_PATCHMEMORY: {
+				u16 address;
+				memcpy(&address, &data[offset], 2);
+				memcpy(&dest.memory[address], &data[offset + 2], 4);
+				// The words are in order, so the same quadword can only come
+				// up several times in a row.
+				if(changed_qwords && (changed_qwords->empty() || changed_qwords->back() != address / 16)) {
+					changed_qwords->push_back(address / 16);
+				}
+				offset += 6;
+				break;
+			}
+		}
+	}
+}
+
+bool TraceEncoder::open(const std::string &path)
+{
+	close();
+	error.clear();
+	snapshot_count = 0;
+	file_path = path;
+	file = fopen(path.c_str(), "wb");
+	if(file == nullptr) {
+		error = "Failed to open " + path + " for writing.";
+		return false;
+	}
+	setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+	encoder = std::make_unique<SnapshotEncoder>();
+	u32 version = 3;
+	return write("VUTR", 4) && write(&version, 4);
+}
+
+bool TraceEncoder::push(const Snapshot &snapshot)
+{
+	if(file == nullptr || !error.empty()) {
+		return false;
+	}
+	FileOutput output{*this};
+	encoder->encode(output, snapshot);
+	if(!error.empty()) {
+		return false;
+	}
+	snapshot_count++;
+	return true;
+}
+
+bool TraceEncoder::close()
+{
+	if(file != nullptr) {
+		if(fclose(file) != 0 && error.empty()) {
+			error = "Failed to write " + file_path + ".";
+		}
+		file = nullptr;
+	}
+	encoder.reset();
+	return error.empty();
+}
+
+bool TraceEncoder::write(const void *data, std::size_t size)
+{
+	// Once a write has failed, the rest of the snapshot is dropped.
+	if(!error.empty()) {
+		return false;
+	}
+	if(fwrite(data, size, 1, file) != 1) {
+		error = "Failed to write " + file_path + ".";
+		return false;
+	}
+	return true;
+}
+
+// Writing over one of the inputs would truncate it before it's read.
+static bool check_output_path(const std::vector<std::string> &input_paths, const std::string &output_path, std::string &error)
+{
+	for(const std::string &input_path : input_paths) {
+		std::string file_path = input_path;
+		std::size_t trace;
+		split_container_path(input_path, file_path, trace);
+		std::error_code ec;
+		if(std::filesystem::equivalent(file_path, output_path, ec)) {
+			error = "The output would overwrite " + input_path + ".";
+			return false;
+		}
+	}
+	return true;
+}
+
+// Delete the output if anything went wrong so a partial trace isn't left
+// lying around.
+static bool finish(TraceEncoder &encoder, const std::string &output_path, bool success, std::string &error)
+{
+	if(!encoder.close() && success) {
+		error = encoder.error;
+		success = false;
+	}
+	if(!success) {
+		remove(output_path.c_str());
+	}
+	return success;
+}
+
+bool slice_trace(TraceEditStats &stats, const std::string &input_path, std::size_t first, std::size_t last, const std::string &output_path, std::string &error)
+{
+	stats = TraceEditStats();
+	if(first > last) {
+		error = "The first snapshot is after the last snapshot.";
+		return false;
+	}
+	if(!check_output_path({input_path}, output_path, error)) {
+		return false;
+	}
+	TraceReader reader;
+	if(!reader.open(input_path)) {
+		error = reader.error;
+		return false;
+	}
+	TraceEncoder encoder;
+	if(!encoder.open(output_path)) {
+		error = encoder.error;
+		return false;
+	}
+	bool success = true;
+	while(stats.snapshots_read <= last && reader.next_snapshot()) {
+		if(stats.snapshots_read >= first && !encoder.push(reader.snapshot())) {
+			error = encoder.error;
+			success = false;
+			break;
+		}
+		stats.snapshots_read++;
+	}
+	stats.snapshots_written = encoder.snapshot_count;
+	if(success && !reader.error.empty()) {
+		error = input_path + ": " + reader.error;
+		success = false;
+	}
+	if(success && stats.snapshots_written == 0) {
+		error = input_path + " only has " + std::to_string(stats.snapshots_read) + " snapshots.";
+		success = false;
+	}
+	return finish(encoder, output_path, success, error);
+}
+
+bool concatenate_traces(TraceEditStats &stats, const std::vector<std::string> &input_paths, const std::string &output_path, std::string &error)
+{
+	stats = TraceEditStats();
+	if(!check_output_path(input_paths, output_path, error)) {
+		return false;
+	}
+	TraceEncoder encoder;
+	if(!encoder.open(output_path)) {
+		error = encoder.error;
+		return false;
+	}
+	bool success = true;
+	for(std::size_t i = 0; success && i < input_paths.size(); i++) {
+		TraceReader reader;
+		if(!reader.open(input_paths[i])) {
+			error = reader.error;
+			success = false;
+			break;
+		}
+		while(reader.next_snapshot()) {
+			stats.snapshots_read++;
+			if(!encoder.push(reader.snapshot())) {
+				error = encoder.error;
+				success = false;
+				break;
+			}
+		}
+		if(success && !reader.error.empty()) {
+			error = input_paths[i] + ": " + reader.error;
+			success = false;
+		}
+	}
+	stats.snapshots_written = encoder.snapshot_count;
+	return finish(encoder, output_path, success, error);
+}
@@ -0,0 +1,128 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACEEDIT_H
+#define TRACEEDIT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+#include "pcsx2defs.h"
+#include "trace.h"
+#include "tracewriter.h"
+
+static_assert(sizeof(VURegs) == TracePacketEncoder::REGISTER_COUNT * 16, "VURegs should be made up of 67 quadwords.");
+
+// Encodes snapshots as trace packets using the same TracePacketEncoder as
+// the capture, including the loads and stores, and writes the program out
+// again whenever it changes. Used both to write traces and to hold the
+// snapshots of a SnapshotStore in memory, so the encoding only lives in one
+// place.
+class SnapshotEncoder
+{
+public:
+	// Write the whole program, registers and memory out with the next
+	// snapshot.
+	void reset()
+	{
+		packets.reset();
+		has_program = false;
+	}
+	// Output must have a put(const void *data, std::size_t size) function.
+	template <typename Output>
+	void encode(Output &out, const Snapshot &snapshot);
+
+private:
+	TracePacketEncoder packets;
+	u8 program[VU1_PROGSIZE];
+	bool has_program = false;
+};
+
+// Apply the packets of a single snapshot written by a SnapshotEncoder to
+// dest, up to and including its 'P' packet, and return the offset after it.
+// If changed_qwords isn't null, the indices of the quadwords of memory that
+// 'm' packets overwrite are appended to it.
+std::size_t decode_snapshot(Snapshot &dest, const u8 *data, std::size_t offset, std::vector<u16> *changed_qwords = nullptr);
+
+// Writes a trace in format version 3 one snapshot at a time with a
+// SnapshotEncoder. Unlike TraceWriter this runs on the calling thread, and
+// writes the program out again if it changes part way through e.g. when
+// traces that ran different programs are concatenated.
+class TraceEncoder
+{
+public:
+	TraceEncoder() = default;
+	~TraceEncoder() { close(); }
+	TraceEncoder(const TraceEncoder&) = delete;
+	TraceEncoder &operator=(const TraceEncoder&) = delete;
+
+	bool open(const std::string &path);
+	bool push(const Snapshot &snapshot);
+	bool close();
+
+	std::size_t snapshot_count = 0;
+	std::string error;
+
+private:
+	struct FileOutput
+	{
+		TraceEncoder &encoder;
+		void put(const void *data, std::size_t size) { encoder.write(data, size); }
+	};
+
+	bool write(const void *data, std::size_t size);
+
+	FILE *file = nullptr;
+	std::string file_path;
+	std::unique_ptr<SnapshotEncoder> encoder;
+};
+
+struct TraceEditStats
+{
+	std::size_t snapshots_read = 0;
+	std::size_t snapshots_written = 0;
+};
+
+template <typename Output>
+void SnapshotEncoder::encode(Output &out, const Snapshot &snapshot)
+{
+	if(!has_program || memcmp(program, snapshot.program, VU1_PROGSIZE) != 0) {
+		memcpy(program, snapshot.program, VU1_PROGSIZE);
+		packets.program_changed();
+		has_program = true;
+	}
+	if(snapshot.read_size > 0) {
+		packets.memory_read(snapshot.read_addr, snapshot.read_size);
+	}
+	if(snapshot.write_size > 0) {
+		packets.memory_write(snapshot.write_addr, snapshot.write_size);
+	}
+	const u8 *registers[TracePacketEncoder::REGISTER_COUNT];
+	TracePacketEncoder::register_pointers(registers, snapshot.registers);
+	packets.encode(out, registers, snapshot.memory, snapshot.program);
+}
+
+// Copy snapshots first to last inclusive into a new trace. Stops reading the
+// input once last has been written.
+bool slice_trace(TraceEditStats &stats, const std::string &input_path, std::size_t first, std::size_t last, const std::string &output_path, std::string &error);
+// Write the snapshots of each trace in turn into a single trace.
+bool concatenate_traces(TraceEditStats &stats, const std::vector<std::string> &input_paths, const std::string &output_path, std::string &error);
+
+#endif
@@ -0,0 +1,579 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Generates synthetic traces without needing a patched emulator. It builds a
+// real VU1 microprogram (nested loops with loads, stores, a data dependent
+// branch and XGKICKs), runs it on a small interpreter that understands just
+// the instructions it emits, and writes every step out in the requested
+// format version. The output only depends on the options and the seed.
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pcsx2defs.h"
+#include "trace.h"
+#include "tracewriter.h"
+#include "flightrecorder.h"
+
+struct GenOptions
+{
+	u32 version = 3;
+	u32 snapshots = 100000;
+	u64 seed = 1;
+	u32 body = 8;            // Instruction pairs in the inner loop body.
+	u32 loads = 2;           // LQs in the body.
+	u32 stores = 1;          // SQs in the body.
+	u32 stride = 1;          // Quadwords the data pointer advances per iteration.
+	u32 taken_percent = 50;  // How often the branch in the loop body is taken.
+	u32 kick_interval = 16;  // Inner loop iterations per XGKICK, or 0 for none.
+	u32 filler = 2;          // Pairs skipped when the branch is taken.
+	u32 rate = 0;            // Snapshots written per second, or 0 for no limit.
+	u32 flight_recorder = 0; // Instructions a FlightRecorder keeps, or 0 to write everything.
+	std::string trigger;     // Passed to FlightTrigger::parse.
+};
+
+// Where things live in VU memory, in quadwords.
+static const u32 GEN_DATA_QWORDS = 256; // Loaded from, must be a power of two.
+static const u32 GEN_STORE_BASE = 256;  // Stores go to this offset from the data pointer.
+static const u32 GEN_GIF_PACKET = 0x3f0;
+
+struct GenState
+{
+	VURegs regs;
+	u8 memory[VU1_MEMSIZE];
+	u8 program[VU1_PROGSIZE];
+	u32 pc = 0;
+	s32 branch_target = -1; // Taken after the delay slot.
+	bool ending = false;    // An E bit was seen, stop after the delay slot.
+	u32 read_address, read_size, write_address, write_size;
+	u64 rng;
+};
+
+// Writes snapshots in one of the trace format versions. Supporting a new
+// version only needs a new implementation of this.
+class GenTraceFormat
+{
+public:
+	virtual ~GenTraceFormat() {}
+	virtual bool begin(const std::string &path) = 0;
+	virtual void snapshot(const GenState &state) = 0;
+	virtual bool end() = 0;
+};
+
+// Versions 1 and 2 store the whole register file and memory every snapshot,
+// using the VURegs layout of the PCSX2 version the patch was made for.
+template <typename OldVURegs>
+class FullStateFormat : public GenTraceFormat
+{
+public:
+	explicit FullStateFormat(u32 version) : version(version) {}
+	bool begin(const std::string &path) override;
+	void snapshot(const GenState &state) override;
+	bool end() override;
+
+private:
+	u32 version;
+	OldVURegs regs = {};
+	FILE *file = nullptr;
+	bool has_output_instructions = false;
+};
+
+// Version 3 stores diffs, which is exactly what the capture-side writer does.
+class DiffFormat : public GenTraceFormat
+{
+public:
+	bool begin(const std::string &path) override { writer.begin_trace(path); return true; }
+	void snapshot(const GenState &state) override;
+	bool end() override;
+
+private:
+	TraceWriter writer{16 * 1024 * 1024};
+};
+
+// Runs the trace through a FlightRecorder, and writes out what it holds each
+// time the trigger fires as <trace>_dumpNNN.bin. Whatever is left after a
+// trigger when the trace ends is dumped too.
+class RecorderFormat : public GenTraceFormat
+{
+public:
+	RecorderFormat(const GenOptions &options);
+	bool begin(const std::string &path) override;
+	void snapshot(const GenState &state) override;
+	bool end() override;
+
+private:
+	bool dump();
+
+	FlightRecorder recorder;
+	std::string stem;
+	u32 dump_count = 0;
+	u64 snapshot_count = 0;
+	bool failed = false;
+};
+
+u32 gen_random(GenState &state);
+void gen_program(GenState &state, const GenOptions &options);
+void gen_memory(GenState &state, const GenOptions &options);
+void gen_step(GenState &state);
+bool gen_trace(const std::string &path, const GenOptions &options, u64 seed);
+void write_pair(u8 *program, u32 &pc, u32 lower, u32 upper);
+std::unique_ptr<GenTraceFormat> make_trace_format(const GenOptions &options);
+
+// Instruction encodings, see the VU User's Manual chapter 8.
+static const u32 GEN_NOP_UPPER = 0x000002ff;
+static const u32 GEN_NOP_LOWER = 0x8000033c;
+static const u32 GEN_E_BIT = 1u << 30;
+static u32 gen_lq(u32 ft, u32 is, s32 imm) { return (0x00 << 25) | (0xf << 21) | (ft << 16) | (is << 11) | (imm & 0x7ff); }
+static u32 gen_sq(u32 fs, u32 it, s32 imm) { return (0x01 << 25) | (0xf << 21) | (it << 16) | (fs << 11) | (imm & 0x7ff); }
+static u32 gen_ilw_x(u32 it, u32 is, s32 imm) { return (0x04 << 25) | (0x8 << 21) | (it << 16) | (is << 11) | (imm & 0x7ff); }
+static u32 gen_iaddiu(u32 it, u32 is, u32 imm) { return (0x08 << 25) | ((imm >> 11) << 21) | (it << 16) | (is << 11) | (imm & 0x7ff); }
+static u32 gen_isubiu(u32 it, u32 is, u32 imm) { return (0x09 << 25) | ((imm >> 11) << 21) | (it << 16) | (is << 11) | (imm & 0x7ff); }
+static u32 gen_ibeq(u32 it, u32 is, s32 offset) { return (0x28 << 25) | (it << 16) | (is << 11) | (offset & 0x7ff); }
+static u32 gen_ibne(u32 it, u32 is, s32 offset) { return (0x29 << 25) | (it << 16) | (is << 11) | (offset & 0x7ff); }
+static u32 gen_iand(u32 id, u32 is, u32 it) { return 0x80000000 | (it << 16) | (is << 11) | (id << 6) | 0x34; }
+static u32 gen_xgkick(u32 is) { return 0x80000000 | (is << 11) | 0x6fc; }
+static u32 gen_add(u32 fd, u32 fs, u32 ft) { return (0xf << 21) | (ft << 16) | (fs << 11) | (fd << 6) | 0x28; }
+static u32 gen_mul(u32 fd, u32 fs, u32 ft) { return (0xf << 21) | (ft << 16) | (fs << 11) | (fd << 6) | 0x2a; }
+
+int main(int argc, char **argv)
+{
+	GenOptions options;
+	std::string output;
+	u32 count = 1;
+	for(int i = 1; i < argc; i++) {
+		auto arg = [&](const char *name) { return strcmp(argv[i], name) == 0 && i + 1 < argc; };
+		auto value = [&]() { return (u32) strtoul(argv[++i], nullptr, 0); };
+		if(arg("-o") || arg("--output")) output = argv[++i];
+		else if(arg("--count")) count = value();
+		else if(arg("--version")) options.version = value();
+		else if(arg("--snapshots")) options.snapshots = value();
+		else if(arg("--seed")) options.seed = strtoull(argv[++i], nullptr, 0);
+		else if(arg("--body")) options.body = value();
+		else if(arg("--loads")) options.loads = value();
+		else if(arg("--stores")) options.stores = value();
+		else if(arg("--stride")) options.stride = value();
+		else if(arg("--taken")) options.taken_percent = value();
+		else if(arg("--kick-interval")) options.kick_interval = value();
+		else if(arg("--filler")) options.filler = value();
+		else if(arg("--rate")) options.rate = value();
+		else if(arg("--flight-recorder")) options.flight_recorder = value();
+		else if(arg("--trigger")) options.trigger = argv[++i];
+		else {
+			output.clear();
+			break;
+		}
+	}
+	if(output.empty()) {
+		fprintf(stderr, "usage: %s -o <trace file or directory> [options]\n", argv[0]);
+		fprintf(stderr, "  --count <n>          Write n traces named traceNNNNNN.bin into the output directory.\n");
+		fprintf(stderr, "  --version <1-3>      Trace format version (default 3).\n");
+		fprintf(stderr, "  --snapshots <n>      Instructions per trace (default 100000).\n");
+		fprintf(stderr, "  --seed <n>           Trace i of a batch uses seed + i (default 1).\n");
+		fprintf(stderr, "  --body <n>           Instruction pairs in the inner loop (default 8).\n");
+		fprintf(stderr, "  --loads <n>          LQ instructions in the inner loop (default 2).\n");
+		fprintf(stderr, "  --stores <n>         SQ instructions in the inner loop (default 1).\n");
+		fprintf(stderr, "  --stride <n>         Quadwords the data pointer moves per iteration (default 1).\n");
+		fprintf(stderr, "  --taken <percent>    How often the branch in the inner loop is taken (default 50).\n");
+		fprintf(stderr, "  --filler <n>         Instruction pairs the branch skips over (default 2).\n");
+		fprintf(stderr, "  --kick-interval <n>  Inner loop iterations per XGKICK, 0 for none (default 16).\n");
+		fprintf(stderr, "  --rate <n>           Write at most n snapshots per second, to test vutrace --follow.\n");
+		fprintf(stderr, "  --flight-recorder <n>\n");
+		fprintf(stderr, "                       Only keep the last n instructions, and write them out as\n");
+		fprintf(stderr, "                       <trace>_dumpNNN.bin each time the trigger fires.\n");
+		fprintf(stderr, "  --trigger <options>  When to dump e.g. \"nan pc=0x120 xgkick=0x3f00 after=64\".\n");
+		return 1;
+	}
+	if(options.version < 1 || options.version > 3) {
+		fprintf(stderr, "Error: Unsupported format version %u.\n", options.version);
+		return 1;
+	}
+	if(options.flight_recorder > 0 || !options.trigger.empty()) {
+		FlightTrigger trigger;
+		std::string error;
+		if(!trigger.parse(options.trigger, error)) {
+			fprintf(stderr, "Error: %s\n", error.c_str());
+			return 1;
+		}
+		if(options.flight_recorder == 0 || options.version != 3) {
+			fprintf(stderr, "Error: --trigger needs --flight-recorder, which only writes format version 3.\n");
+			return 1;
+		}
+	}
+	if(options.loads + options.stores > options.body || options.body + options.filler > 1900) {
+		fprintf(stderr, "Error: The loop body must have room for the loads and stores, and fit in VU1 program memory.\n");
+		return 1;
+	}
+
+	if(count == 1 && std::filesystem::path(output).has_extension()) {
+		return gen_trace(output, options, options.seed) ? 0 : 1;
+	}
+	std::error_code error;
+	std::filesystem::create_directories(output, error);
+	for(u32 i = 0; i < count; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "trace%06u.bin", i);
+		if(!gen_trace((std::filesystem::path(output) / name).string(), options, options.seed + i)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+bool gen_trace(const std::string &path, const GenOptions &options, u64 seed)
+{
+	std::unique_ptr<GenState> state = std::make_unique<GenState>();
+	state->regs = {};
+	state->rng = seed * 0x9e3779b97f4a7c15 + 1;
+	gen_program(*state, options);
+	gen_memory(*state, options);
+
+	std::unique_ptr<GenTraceFormat> format = make_trace_format(options);
+	if(!format->begin(path)) {
+		return false;
+	}
+	auto start = std::chrono::steady_clock::now();
+	for(u32 i = 0; i < options.snapshots; i++) {
+		gen_step(*state);
+		format->snapshot(*state);
+		if(options.rate > 0 && i % 64 == 63) {
+			std::this_thread::sleep_until(start + std::chrono::microseconds((u64) (i + 1) * 1000000 / options.rate));
+		}
+	}
+	return format->end();
+}
+
+// xorshift64*
+u32 gen_random(GenState &state)
+{
+	state.rng ^= state.rng >> 12;
+	state.rng ^= state.rng << 25;
+	state.rng ^= state.rng >> 27;
+	return (u32) ((state.rng * 0x2545f4914f6cdd1d) >> 32);
+}
+
+// Register usage: vi01 outer loop counter, vi02 data pointer, vi03 branch
+// condition, vi04 data pointer mask, vi05 inner loop counter, vi06 GIF packet.
+void gen_program(GenState &state, const GenOptions &options)
+{
+	u8 *program = state.program;
+	memset(program, 0, VU1_PROGSIZE);
+	u32 inner_count = options.kick_interval > 0 ? options.kick_interval : 16;
+	u32 inner_size = 1 + options.body + 2 + options.filler + 5;
+	u32 outer_count = options.snapshots / (inner_count * inner_size + 5) + 1;
+	outer_count = std::min(outer_count, 0x7fffu);
+
+	u32 pc = 0;
+	write_pair(program, pc, gen_iaddiu(1, 0, outer_count), GEN_NOP_UPPER);
+	write_pair(program, pc, gen_iaddiu(2, 0, 0), GEN_NOP_UPPER);
+	write_pair(program, pc, gen_iaddiu(4, 0, GEN_DATA_QWORDS - 1), GEN_NOP_UPPER);
+	write_pair(program, pc, gen_iaddiu(6, 0, GEN_GIF_PACKET), GEN_NOP_UPPER);
+	u32 outer = pc;
+	write_pair(program, pc, gen_iaddiu(5, 0, inner_count), GEN_NOP_UPPER);
+	u32 inner = pc;
+	write_pair(program, pc, gen_ilw_x(3, 2, 0), GEN_NOP_UPPER);
+	for(u32 i = 0; i < options.body; i++) {
+		u32 lower = GEN_NOP_LOWER;
+		if(i < options.loads) {
+			lower = gen_lq(1 + i % 8, 2, 0);
+		} else if(i < options.loads + options.stores) {
+			u32 store = i - options.loads;
+			lower = gen_sq(9 + store % 8, 2, GEN_STORE_BASE + (store % 2) * GEN_DATA_QWORDS);
+		}
+		u32 upper = (i % 2 == 0)
+			? gen_add(9 + i % 8, 1 + i % 8, 9 + (i + 1) % 8)
+			: gen_mul(9 + i % 8, 9 + i % 8, 1 + (i + 1) % 8);
+		write_pair(program, pc, lower, upper);
+	}
+	// Skip the filler if the value loaded by the ILW is zero.
+	write_pair(program, pc, gen_ibeq(3, 0, 1 + (s32) options.filler), GEN_NOP_UPPER);
+	write_pair(program, pc, GEN_NOP_LOWER, GEN_NOP_UPPER);
+	for(u32 i = 0; i < options.filler; i++) {
+		write_pair(program, pc, GEN_NOP_LOWER, gen_mul(17 + i % 8, 9 + i % 8, 1 + i % 8));
+	}
+	write_pair(program, pc, gen_iaddiu(2, 2, options.stride), GEN_NOP_UPPER);
+	write_pair(program, pc, gen_iand(2, 2, 4), GEN_NOP_UPPER);
+	write_pair(program, pc, gen_isubiu(5, 5, 1), GEN_NOP_UPPER);
+	write_pair(program, pc, gen_ibne(5, 0, (s32) (inner - (pc + 8)) / 8), GEN_NOP_UPPER);
+	write_pair(program, pc, GEN_NOP_LOWER, GEN_NOP_UPPER);
+	if(options.kick_interval > 0) {
+		write_pair(program, pc, gen_xgkick(6), GEN_NOP_UPPER);
+	}
+	write_pair(program, pc, gen_isubiu(1, 1, 1), GEN_NOP_UPPER);
+	write_pair(program, pc, gen_ibne(1, 0, (s32) (outer - (pc + 8)) / 8), GEN_NOP_UPPER);
+	write_pair(program, pc, GEN_NOP_LOWER, GEN_NOP_UPPER);
+	write_pair(program, pc, GEN_NOP_LOWER, GEN_NOP_UPPER | GEN_E_BIT);
+	write_pair(program, pc, GEN_NOP_LOWER, GEN_NOP_UPPER);
+}
+
+void write_pair(u8 *program, u32 &pc, u32 lower, u32 upper)
+{
+	memcpy(&program[pc], &lower, 4);
+	memcpy(&program[pc + 4], &upper, 4);
+	pc += 8;
+}
+
+// Fill the data the loop loads with small floats, except the X components
+// which are read by the ILW and decide whether the branch is taken.
+void gen_memory(GenState &state, const GenOptions &options)
+{
+	for(u32 i = 0; i < VU1_MEMSIZE; i += 4) {
+		float value = (float) (s32) (gen_random(state) % 2001 - 1000) / 1000.f;
+		memcpy(&state.memory[i], &value, 4);
+	}
+	for(u32 i = 0; i < GEN_DATA_QWORDS; i++) {
+		u32 condition = gen_random(state) % 100 < options.taken_percent ? 0 : 1 + gen_random(state) % 0x7fff;
+		memcpy(&state.memory[i * 16], &condition, 4);
+	}
+	// A GIF tag with one A+D write to PRIM.
+	u64 packet[4] = {
+		1 | (1ull << 15) | (1ull << 60), 0xe,
+		0, 0x00
+	};
+	memcpy(&state.memory[GEN_GIF_PACKET * 16], packet, sizeof(packet));
+}
+
+// Execute one instruction pair, for the handful of instructions gen_program
+// emits.
+void gen_step(GenState &state)
+{
+	VURegs &regs = state.regs;
+	u32 pc = state.pc;
+	u32 lower, upper;
+	memcpy(&lower, &state.program[pc], 4);
+	memcpy(&upper, &state.program[pc + 4], 4);
+	state.read_size = 0;
+	state.write_size = 0;
+
+	u32 fd = (upper >> 6) & 0x1f, fs = (upper >> 11) & 0x1f, ft = (upper >> 16) & 0x1f;
+	if((upper & 0x3f) == 0x28 && fd != 0) {
+		for(int i = 0; i < 4; i++) regs.VF[fd].F[i] = regs.VF[fs].F[i] + regs.VF[ft].F[i];
+	} else if((upper & 0x3f) == 0x2a && fd != 0) {
+		for(int i = 0; i < 4; i++) regs.VF[fd].F[i] = regs.VF[fs].F[i] * regs.VF[ft].F[i];
+	}
+
+	u32 opcode = lower >> 25;
+	u32 it = (lower >> 16) & 0xf, is = (lower >> 11) & 0xf;
+	u32 lower_ft = (lower >> 16) & 0x1f, lower_fs = (lower >> 11) & 0x1f;
+	s32 imm11 = (lower & 0x400) ? (s32) (lower | 0xfffff800) : (s32) (lower & 0x7ff);
+	u32 imm15 = ((lower >> 10) & 0x7800) | (lower & 0x7ff);
+	auto address = [&]() { return ((regs.VI[is].UL + imm11) * 16) & (VU1_MEMSIZE - 1); };
+	s32 branch_target = (s32) ((pc + 8 + imm11 * 8) & (VU1_PROGSIZE - 1));
+	s32 next_branch = -1;
+	switch(opcode) {
+		case 0x00: { // LQ
+			state.read_address = address();
+			state.read_size = 16;
+			if(lower_ft != 0) memcpy(&regs.VF[lower_ft], &state.memory[state.read_address], 16);
+			break;
+		}
+		case 0x01: { // SQ
+			u32 sq_address = ((regs.VI[it].UL + imm11) * 16) & (VU1_MEMSIZE - 1);
+			state.write_address = sq_address;
+			state.write_size = 16;
+			memcpy(&state.memory[sq_address], &regs.VF[lower_fs], 16);
+			break;
+		}
+		case 0x04: { // ILW
+			state.read_address = address();
+			state.read_size = 16;
+			if(it != 0) regs.VI[it].UL = *(u16*) &state.memory[state.read_address];
+			break;
+		}
+		case 0x08: if(it != 0) regs.VI[it].UL = (regs.VI[is].UL + imm15) & 0xffff; break; // IADDIU
+		case 0x09: if(it != 0) regs.VI[it].UL = (regs.VI[is].UL - imm15) & 0xffff; break; // ISUBIU
+		case 0x28: if(regs.VI[it].UL == regs.VI[is].UL) next_branch = branch_target; break; // IBEQ
+		case 0x29: if(regs.VI[it].UL != regs.VI[is].UL) next_branch = branch_target; break; // IBNE
+		case 0x40: {
+			u32 id = (lower >> 6) & 0xf;
+			if((lower & 0x3f) == 0x34 && id != 0) { // IAND
+				regs.VI[id].UL = regs.VI[is].UL & regs.VI[it].UL;
+			}
+			break;
+		}
+	}
+
+	// Branches and the E bit take effect after the next pair.
+	if(state.branch_target >= 0) {
+		state.pc = (u32) state.branch_target;
+		state.branch_target = -1;
+	} else if(state.ending) {
+		// Start the program again, as though it was called again.
+		state.pc = 0;
+		state.ending = false;
+	} else {
+		state.pc = (pc + 8) & (VU1_PROGSIZE - 1);
+	}
+	state.branch_target = next_branch;
+	if(upper & GEN_E_BIT) {
+		state.ending = true;
+	}
+	// Like the capture patch, which records the state after vu1Exec, TPC
+	// holds the address of the next instruction. The loads and stores stay
+	// with this snapshot, so they belong to the instruction at the TPC of the
+	// one before it.
+	regs.VI[TPC].UL = state.pc;
+}
+
+std::unique_ptr<GenTraceFormat> make_trace_format(const GenOptions &options)
+{
+	if(options.flight_recorder > 0) {
+		return std::make_unique<RecorderFormat>(options);
+	}
+	switch(options.version) {
+		case 1: return std::make_unique<FullStateFormat<old_pcsx2_structs_v1::VURegs>>(1);
+		case 2: return std::make_unique<FullStateFormat<old_pcsx2_structs_v2::VURegs>>(2);
+		default: return std::make_unique<DiffFormat>();
+	}
+}
+
+template <typename OldVURegs>
+bool FullStateFormat<OldVURegs>::begin(const std::string &path)
+{
+	file = fopen(path.c_str(), "wb");
+	if(file == nullptr) {
+		fprintf(stderr, "Error: Failed to open %s for writing.\n", path.c_str());
+		return false;
+	}
+	setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+	// Version 1 traces don't have a header.
+	if(version >= 2) {
+		fwrite("VUTR", 4, 1, file);
+		fwrite(&version, 4, 1, file);
+	}
+	return true;
+}
+
+template <typename OldVURegs>
+void FullStateFormat<OldVURegs>::snapshot(const GenState &state)
+{
+	if(!has_output_instructions) {
+		fputc(VUTRACE_SETINSTRUCTIONS, file);
+		fwrite(state.program, VU1_PROGSIZE, 1, file);
+		has_output_instructions = true;
+	}
+	memcpy(regs.VF, state.regs.VF, sizeof(regs.VF));
+	memcpy(regs.VI, state.regs.VI, sizeof(regs.VI));
+	regs.ACC = state.regs.ACC;
+	regs.q = state.regs.q;
+	regs.p = state.regs.p;
+	fputc(VUTRACE_SETREGISTERS, file);
+	fwrite(&regs, sizeof(regs), 1, file);
+	fputc(VUTRACE_SETMEMORY, file);
+	fwrite(state.memory, VU1_MEMSIZE, 1, file);
+	if(state.read_size > 0) {
+		fputc(VUTRACE_LOADOP, file);
+		fwrite(&state.read_address, 4, 1, file);
+		fwrite(&state.read_size, 4, 1, file);
+	}
+	if(state.write_size > 0) {
+		fputc(VUTRACE_STOREOP, file);
+		fwrite(&state.write_address, 4, 1, file);
+		fwrite(&state.write_size, 4, 1, file);
+	}
+	fputc(VUTRACE_PUSHSNAPSHOT, file);
+}
+
+template <typename OldVURegs>
+bool FullStateFormat<OldVURegs>::end()
+{
+	bool success = ferror(file) == 0;
+	success &= fclose(file) == 0;
+	file = nullptr;
+	if(!success) {
+		fprintf(stderr, "Error: Failed to write trace.\n");
+	}
+	return success;
+}
+
+void DiffFormat::snapshot(const GenState &state)
+{
+	if(state.read_size > 0) writer.memory_read(state.read_address, state.read_size);
+	if(state.write_size > 0) writer.memory_write(state.write_address, state.write_size);
+	writer.instruction(state.regs, state.memory, state.program);
+}
+
+bool DiffFormat::end()
+{
+	writer.end_trace();
+	writer.flush();
+	if(!writer.error().empty()) {
+		fprintf(stderr, "Error: %s\n", writer.error().c_str());
+		return false;
+	}
+	return true;
+}
+
+RecorderFormat::RecorderFormat(const GenOptions &options)
+	: recorder(64 * 1024 * 1024, options.flight_recorder)
+{
+	std::string error;
+	recorder.trigger.parse(options.trigger, error);
+}
+
+bool RecorderFormat::begin(const std::string &path)
+{
+	std::filesystem::path stem_path(path);
+	stem = (stem_path.parent_path() / stem_path.stem()).string();
+	recorder.begin_invocation();
+	return true;
+}
+
+void RecorderFormat::snapshot(const GenState &state)
+{
+	if(state.read_size > 0) recorder.memory_read(state.read_address, state.read_size);
+	if(state.write_size > 0) recorder.memory_write(state.write_address, state.write_size);
+	snapshot_count++;
+	if(recorder.instruction(state.regs, state.memory, state.program) && !failed) {
+		failed = !dump();
+	}
+}
+
+bool RecorderFormat::end()
+{
+	if(!failed && !recorder.trigger_reason().empty()) {
+		failed = !dump();
+	}
+	fprintf(stderr, "%s: %u dumps\n", stem.c_str(), dump_count);
+	return !failed;
+}
+
+bool RecorderFormat::dump()
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), "_dump%03u.bin", dump_count++);
+	std::string path = stem + suffix;
+	u64 first = snapshot_count - recorder.instruction_count();
+	u64 trigger = recorder.trigger_snapshot();
+	std::string reason = recorder.trigger_reason();
+	std::string error;
+	if(!recorder.dump(path, error)) {
+		fprintf(stderr, "Error: %s\n", error.c_str());
+		return false;
+	}
+	fprintf(stderr, "%s: %s, snapshots %llu onwards, trigger at snapshot %llu of the dump.\n",
+		path.c_str(), reason.c_str(), (unsigned long long) first, (unsigned long long) trigger);
+	return true;
+}
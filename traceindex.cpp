@@ -0,0 +1,244 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "traceindex.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include "gif.h"
+#include "session.h"
+#include "sessioncontainer.h"
+
+static const u32 INDEX_FORMAT_VERSION = 1;
+
+// The size and modification time of the file the trace is stored in.
+static bool trace_file_key(u64 &size, s64 &time, const std::string &trace_path)
+{
+	std::string file_path = trace_path;
+	std::size_t trace;
+	split_container_path(trace_path, file_path, trace);
+	std::error_code error_code;
+	size = std::filesystem::file_size(file_path, error_code);
+	if(error_code) {
+		return false;
+	}
+	time = (s64) std::filesystem::last_write_time(file_path, error_code).time_since_epoch().count();
+	return !error_code;
+}
+
+template <typename T>
+static bool write_array(FILE *file, const std::vector<T> &array)
+{
+	u64 count = array.size();
+	return fwrite(&count, 8, 1, file) == 1 && (count == 0 || fwrite(array.data(), sizeof(T) * count, 1, file) == 1);
+}
+
+template <typename T>
+static bool read_array(FILE *file, std::vector<T> &array, u64 file_size)
+{
+	u64 count;
+	if(fread(&count, 8, 1, file) != 1 || count > file_size / sizeof(T)) {
+		return false;
+	}
+	array.resize(count);
+	return count == 0 || fread(array.data(), sizeof(T) * count, 1, file) == 1;
+}
+
+bool build_trace_index(TraceIndex &index, const std::string &path, std::string &error)
+{
+	index = TraceIndex();
+	index.path = path;
+
+	TraceReader reader;
+	if(!reader.open(path)) {
+		error = reader.error;
+		return false;
+	}
+	index.version = reader.version;
+	while(reader.next_snapshot()) {
+		const Snapshot &snap = reader.snapshot();
+		u32 snapshot = (u32) index.pcs.size();
+		u32 pc = reader.pc();
+		index.pcs.push_back(pc);
+		// The loads and stores of a snapshot were done by the instruction at
+		// the PC of the one before it, so that's where they're recorded, the
+		// same as walk_until_mem_access does.
+		if(snapshot > 0 && snap.read_size > 0) {
+			index.accesses.push_back({snap.read_addr, snap.read_size, snapshot - 1, false, {}});
+		}
+		if(snapshot > 0 && snap.write_size > 0) {
+			index.accesses.push_back({snap.write_addr, snap.write_size, snapshot - 1, true, {}});
+		}
+		u32 lower;
+		memcpy(&lower, &snap.program[pc], 4);
+		if(is_xgkick(lower)) {
+			index.kicks.push_back(snapshot);
+		}
+	}
+	if(!reader.error.empty()) {
+		error = reader.error;
+		return false;
+	}
+	if(index.pcs.empty()) {
+		error = "Trace contains no snapshots.";
+		return false;
+	}
+	index.snapshot_count = index.pcs.size();
+	memcpy(index.program, reader.snapshot().program, VU1_PROGSIZE);
+	index.program_hash = hash_program(index.program);
+
+	// Counting sort of the snapshots by PC.
+	const std::size_t pair_count = VU1_PROGSIZE / INSN_PAIR_SIZE;
+	index.pc_offsets.assign(pair_count + 1, 0);
+	for(u32 pc : index.pcs) {
+		index.pc_offsets[pc / INSN_PAIR_SIZE + 1]++;
+	}
+	for(std::size_t i = 0; i < pair_count; i++) {
+		index.pc_offsets[i + 1] += index.pc_offsets[i];
+	}
+	index.pc_snapshots.resize(index.pcs.size());
+	std::vector<u32> cursors(index.pc_offsets.begin(), index.pc_offsets.end() - 1);
+	for(u32 snapshot = 0; snapshot < index.pcs.size(); snapshot++) {
+		index.pc_snapshots[cursors[index.pcs[snapshot] / INSN_PAIR_SIZE]++] = snapshot;
+	}
+
+	std::stable_sort(index.accesses.begin(), index.accesses.end(), [](const MemoryAccess &l, const MemoryAccess &r) {
+		return l.address / 0x10 < r.address / 0x10;
+	});
+	return true;
+}
+
+std::string trace_index_path(const std::string &trace_path)
+{
+	return trace_path + ".vuidx";
+}
+
+bool save_trace_index(const TraceIndex &index, std::string &error)
+{
+	u64 size;
+	s64 time;
+	if(!trace_file_key(size, time, index.path)) {
+		error = "Failed to stat " + index.path + ".";
+		return false;
+	}
+	// Write to a temporary file first so that another process never sees a
+	// partially written index.
+	std::string path = trace_index_path(index.path);
+	std::string temp_path = path + ".tmp";
+	FILE *file = fopen(temp_path.c_str(), "wb");
+	if(file == nullptr) {
+		error = "Failed to open " + temp_path + " for writing.";
+		return false;
+	}
+	u64 snapshot_count = index.snapshot_count;
+	bool success = fwrite("VUTI", 4, 1, file) == 1
+		&& fwrite(&INDEX_FORMAT_VERSION, 4, 1, file) == 1
+		&& fwrite(&size, 8, 1, file) == 1
+		&& fwrite(&time, 8, 1, file) == 1
+		&& fwrite(&index.version, 4, 1, file) == 1
+		&& fwrite(&snapshot_count, 8, 1, file) == 1
+		&& fwrite(index.program, VU1_PROGSIZE, 1, file) == 1
+		&& fwrite(&index.program_hash, 8, 1, file) == 1
+		&& write_array(file, index.pcs)
+		&& write_array(file, index.pc_offsets)
+		&& write_array(file, index.pc_snapshots)
+		&& write_array(file, index.accesses)
+		&& write_array(file, index.kicks);
+	success &= fclose(file) == 0;
+	std::error_code error_code;
+	if(success) {
+		std::filesystem::rename(temp_path, path, error_code);
+	}
+	if(!success || error_code) {
+		remove(temp_path.c_str());
+		error = "Failed to write " + path + ".";
+		return false;
+	}
+	return true;
+}
+
+bool load_trace_index(TraceIndex &index, const std::string &trace_path)
+{
+	u64 size;
+	s64 time;
+	if(!trace_file_key(size, time, trace_path)) {
+		return false;
+	}
+	std::string path = trace_index_path(trace_path);
+	std::error_code error_code;
+	u64 file_size = std::filesystem::file_size(path, error_code);
+	if(error_code) {
+		return false;
+	}
+	FILE *file = fopen(path.c_str(), "rb");
+	if(file == nullptr) {
+		return false;
+	}
+	index = TraceIndex();
+	index.path = trace_path;
+	char magic[4];
+	u32 format_version;
+	u64 saved_size, snapshot_count;
+	s64 saved_time;
+	bool success = fread(magic, 4, 1, file) == 1 && memcmp(magic, "VUTI", 4) == 0
+		&& fread(&format_version, 4, 1, file) == 1 && format_version == INDEX_FORMAT_VERSION
+		&& fread(&saved_size, 8, 1, file) == 1 && saved_size == size
+		&& fread(&saved_time, 8, 1, file) == 1 && saved_time == time
+		&& fread(&index.version, 4, 1, file) == 1
+		&& fread(&snapshot_count, 8, 1, file) == 1
+		&& fread(index.program, VU1_PROGSIZE, 1, file) == 1
+		&& fread(&index.program_hash, 8, 1, file) == 1
+		&& read_array(file, index.pcs, file_size)
+		&& read_array(file, index.pc_offsets, file_size)
+		&& read_array(file, index.pc_snapshots, file_size)
+		&& read_array(file, index.accesses, file_size)
+		&& read_array(file, index.kicks, file_size);
+	fclose(file);
+	index.snapshot_count = (std::size_t) snapshot_count;
+	success = success
+		&& index.pcs.size() == index.snapshot_count
+		&& index.pc_snapshots.size() == index.snapshot_count
+		&& index.pc_offsets.size() == VU1_PROGSIZE / INSN_PAIR_SIZE + 1;
+	if(!success) {
+		index = TraceIndex();
+	}
+	return success;
+}
+
+std::pair<const u32*, const u32*> find_pc_snapshots(const TraceIndex &index, u32 pc)
+{
+	if(pc >= VU1_PROGSIZE || pc % INSN_PAIR_SIZE != 0 || index.pc_offsets.empty()) {
+		return {nullptr, nullptr};
+	}
+	const u32 *snapshots = index.pc_snapshots.data();
+	return {snapshots + index.pc_offsets[pc / INSN_PAIR_SIZE], snapshots + index.pc_offsets[pc / INSN_PAIR_SIZE + 1]};
+}
+
+std::pair<const MemoryAccess*, const MemoryAccess*> find_accesses(const TraceIndex &index, u32 address)
+{
+	const MemoryAccess *begin = index.accesses.data();
+	const MemoryAccess *end = begin + index.accesses.size();
+	const MemoryAccess *first = std::lower_bound(begin, end, address / 0x10, [](const MemoryAccess &access, u32 qword) {
+		return access.address / 0x10 < qword;
+	});
+	const MemoryAccess *last = std::upper_bound(first, end, address / 0x10, [](u32 qword, const MemoryAccess &access) {
+		return qword < access.address / 0x10;
+	});
+	return {first, last};
+}
@@ -0,0 +1,109 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACEINDEX_H
+#define TRACEINDEX_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "pcsx2defs.h"
+#include "trace.h"
+
+struct MemoryAccess
+{
+	u32 address;
+	u32 size;
+	u32 snapshot;
+	bool write;
+	u8 pad[3]; // Zeroed, since the accesses are saved to disk as is.
+};
+
+// Lookup tables for a trace, built in a single pass with a TraceReader so the
+// snapshots themselves don't have to be kept in memory. Answering a query
+// from an index is a binary search or a table lookup instead of a scan over
+// every snapshot.
+struct TraceIndex
+{
+	std::string path;
+	u32 version = 0;
+	std::size_t snapshot_count = 0;
+	u8 program[VU1_PROGSIZE]; // As of the last snapshot.
+	u64 program_hash = 0;
+
+	std::vector<u32> pcs;
+	// The snapshots at each instruction pair, in order. The snapshots for the
+	// pair at pc are pc_snapshots[pc_offsets[pc / 8]] up to (but excluding)
+	// pc_snapshots[pc_offsets[pc / 8 + 1]].
+	std::vector<u32> pc_offsets;
+	std::vector<u32> pc_snapshots;
+	// Every load and store, sorted by quadword and then by snapshot. The
+	// snapshot is the one whose PC is the instruction that did it.
+	std::vector<MemoryAccess> accesses;
+	// Snapshots where the lower instruction is an XGKICK.
+	std::vector<u32> kicks;
+};
+
+bool build_trace_index(TraceIndex &index, const std::string &path, std::string &error);
+// An index is saved next to its trace as <trace>.vuidx, along with the size
+// and modification time of the trace (or the container it's in) so a stale
+// one isn't used after the trace has been overwritten or has grown.
+std::string trace_index_path(const std::string &trace_path);
+bool save_trace_index(const TraceIndex &index, std::string &error);
+// Returns false if there's no saved index for the trace or it's out of date.
+bool load_trace_index(TraceIndex &index, const std::string &trace_path);
+std::pair<const u32*, const u32*> find_pc_snapshots(const TraceIndex &index, u32 pc);
+// Accesses that touch the quadword containing address, same as
+// find_memory_access.
+std::pair<const MemoryAccess*, const MemoryAccess*> find_accesses(const TraceIndex &index, u32 address);
+// Stream through the trace again and call callback for each of the given
+// snapshots, which must be sorted. Used for queries that need the full state.
+template <typename Callback>
+bool visit_snapshots(const TraceIndex &index, const std::vector<u32> &snapshots, std::string &error, Callback callback);
+
+template <typename Callback>
+bool visit_snapshots(const TraceIndex &index, const std::vector<u32> &snapshots, std::string &error, Callback callback)
+{
+	if(snapshots.empty()) {
+		return true;
+	}
+	TraceReader reader;
+	if(!reader.open(index.path)) {
+		error = reader.error;
+		return false;
+	}
+	std::size_t next = 0;
+	for(u32 snapshot = 0; next < snapshots.size() && reader.next_snapshot(); snapshot++) {
+		while(next < snapshots.size() && snapshots[next] == snapshot) {
+			callback(snapshot, reader.snapshot());
+			next++;
+		}
+	}
+	if(!reader.error.empty()) {
+		error = reader.error;
+		return false;
+	}
+	if(next < snapshots.size()) {
+		error = "Snapshot " + std::to_string(snapshots[next]) + " is out of range.";
+		return false;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,536 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACEWRITER_H
+#define TRACEWRITER_H
+
+// This header is meant to be included by the capture patch as well as by
+// vutrace, so it doesn't depend on pcsx2defs.h (which would clash with
+// PCSX2's own definitions of the VU structures).
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "capturefilter.h"
+
+// A lock-free queue between exactly one producer thread and one consumer
+// thread. The capacity is rounded up to a power of two.
+template <typename T>
+class SpscQueue
+{
+public:
+	explicit SpscQueue(std::size_t capacity)
+	{
+		std::size_t size = 1;
+		while(size < capacity) size <<= 1;
+		items.resize(size);
+		mask = size - 1;
+	}
+
+	// Producer side. Returns false if the queue is full.
+	bool push(T item)
+	{
+		uint64_t h = head.load(std::memory_order_relaxed);
+		if(h - tail.load(std::memory_order_acquire) > mask) {
+			return false;
+		}
+		items[h & mask] = std::move(item);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns nullptr if the queue is empty.
+	T *front()
+	{
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		if(t == head.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		return &items[t & mask];
+	}
+
+	void pop()
+	{
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		items[t & mask] = T();
+		tail.store(t + 1, std::memory_order_release);
+	}
+
+	bool empty() const
+	{
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+private:
+	std::vector<T> items;
+	std::size_t mask;
+	alignas(64) std::atomic<uint64_t> head{0};
+	alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+// A lock-free ring of bytes between one producer and one consumer. The
+// producer stages data with put and makes it visible with publish, so the
+// consumer never sees half of a snapshot. Positions are byte counts since the
+// ring was created and never wrap.
+class SpscByteRing
+{
+public:
+	explicit SpscByteRing(std::size_t capacity)
+	{
+		std::size_t size = 1;
+		while(size < capacity) size <<= 1;
+		buffer.resize(size);
+		mask = size - 1;
+	}
+
+	// Producer side.
+	std::size_t free_space() const { return buffer.size() - (staged - tail.load(std::memory_order_acquire)); }
+	void put(const void *data, std::size_t size);
+	void publish() { head.store(staged, std::memory_order_release); }
+	uint64_t write_position() const { return staged; }
+
+	// Consumer side. Returns the number of contiguous published bytes that
+	// can be read starting from data.
+	std::size_t peek(const uint8_t *&data) const;
+	void consume(std::size_t size) { tail.store(tail.load(std::memory_order_relaxed) + size, std::memory_order_release); }
+	uint64_t read_position() const { return tail.load(std::memory_order_acquire); }
+
+private:
+	std::vector<uint8_t> buffer;
+	std::size_t mask;
+	uint64_t staged = 0;
+	alignas(64) std::atomic<uint64_t> head{0};
+	alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+// Encodes the state after each instruction as format version 3 packets,
+// diffing it against the previous instruction so only the registers and
+// memory words that changed are written ('r' and 'm' packets). Shared by
+// TraceWriter and FlightRecorder.
+class TracePacketEncoder
+{
+public:
+	static constexpr uint32_t MEMORY_SIZE = 0x4000;
+	static constexpr uint32_t PROGRAM_SIZE = 0x4000;
+	static constexpr uint32_t REGISTER_COUNT = 67; // VF, VI, ACC, Q, P.
+	// The most data one instruction can produce: the first snapshot of a
+	// trace, which includes the whole program, registers and memory.
+	static constexpr std::size_t MAX_INSTRUCTION_SIZE =
+		(1 + PROGRAM_SIZE) + (1 + REGISTER_COUNT * 16) + (1 + MEMORY_SIZE) + 2 * 9 + 1;
+
+	// Write the whole program, registers and memory out with the next
+	// instruction, as at the start of a trace.
+	void reset()
+	{
+		keyframe();
+		read_size = 0;
+		write_size = 0;
+	}
+	// Like reset, but keeps any loads and stores already reported for the
+	// next instruction.
+	void keyframe()
+	{
+		has_output_instructions = false;
+		has_last_state = false;
+	}
+	// Write the program out again with the next instruction.
+	void program_changed() { has_output_instructions = false; }
+	void memory_read(uint32_t address, uint32_t size) { read_address = address; read_size = size; }
+	void memory_write(uint32_t address, uint32_t size) { write_address = address; write_size = size; }
+
+	// Output must have a put(const void *data, std::size_t size) function,
+	// and room for MAX_INSTRUCTION_SIZE bytes.
+	template <typename Output>
+	void encode(Output &out, const uint8_t *const *registers, const uint8_t *memory, const uint8_t *program);
+
+	// Registers can be any structure with VF, VI, ACC, q and p members laid
+	// out like PCSX2's VURegs e.g. VU1 itself.
+	template <typename Registers>
+	static void register_pointers(const uint8_t **dest, const Registers &regs);
+
+private:
+	bool has_output_instructions = false;
+	bool has_last_state = false;
+	uint8_t last_registers[REGISTER_COUNT * 16];
+	uint8_t last_memory[MEMORY_SIZE];
+	uint32_t read_address = 0;
+	uint32_t read_size = 0;
+	uint32_t write_address = 0;
+	uint32_t write_size = 0;
+};
+
+// Writes VU1 traces in format version 3 without blocking the emulation
+// thread on disk I/O. Each instruction is encoded by a TracePacketEncoder
+// straight into a ring buffer that a background thread drains to disk. The
+// public functions other than error() must all be called from the same
+// thread.
+class TraceWriter
+{
+public:
+	static constexpr uint32_t FORMAT_VERSION = 3;
+	static constexpr std::size_t MAX_INSTRUCTION_SIZE = TracePacketEncoder::MAX_INSTRUCTION_SIZE;
+
+	explicit TraceWriter(std::size_t ring_size = 64 * 1024 * 1024);
+	~TraceWriter();
+	TraceWriter(const TraceWriter&) = delete;
+	TraceWriter &operator=(const TraceWriter&) = delete;
+
+	// Start writing to a new file, ending the current trace if there is one.
+	// The file is opened on the writer thread, so failures are reported
+	// through error() later on.
+	void begin_trace(const std::string &path);
+	void end_trace();
+	// Called when a microprogram is started. If the invocation passes the
+	// filter, a new trace is started at path, otherwise the current one is
+	// ended so nothing is recorded until the next invocation that passes.
+	// Returns whether a trace was started.
+	bool begin_invocation(const std::string &path, const uint8_t *program, uint32_t entry_pc);
+
+	// Record the state after an instruction has executed. Registers can be
+	// any structure with VF, VI, ACC, q and p members laid out like PCSX2's
+	// VURegs e.g. VU1 itself.
+	template <typename Registers>
+	void instruction(const Registers &regs, const uint8_t *memory, const uint8_t *program);
+	void memory_read(uint32_t address, uint32_t size) { encoder.memory_read(address, size); }
+	void memory_write(uint32_t address, uint32_t size) { encoder.memory_write(address, size); }
+
+	// Block until the writer thread has caught up.
+	void flush();
+
+	bool tracing() const { return is_tracing; }
+	uint64_t bytes_encoded() const { return ring.write_position(); }
+	// Number of times the emulation thread had to wait for the disk.
+	uint64_t stall_count() const { return stalls; }
+	// Empty unless the writer thread failed to open or write a file.
+	std::string error() const;
+
+	// Used by begin_invocation, and to limit the number of instructions
+	// recorded per trace.
+	CaptureFilter filter;
+
+private:
+	struct Command
+	{
+		uint64_t position = 0; // Switch files once this many bytes have been written.
+		std::string path; // Empty to close the current file.
+	};
+
+	void reserve(std::size_t size);
+	void send(Command command);
+	void writer_thread();
+	void fail(const std::string &message);
+	static void backoff(unsigned &spins);
+
+	SpscByteRing ring;
+	SpscQueue<Command> commands;
+	std::thread thread;
+	std::atomic<bool> stopping{false};
+	std::atomic<bool> failed{false};
+	std::string writer_error; // Only read once failed is set.
+
+	// Only accessed by the emulation thread.
+	bool is_tracing = false;
+	TracePacketEncoder encoder;
+	uint64_t trace_instructions = 0;
+	uint64_t stalls = 0;
+};
+
+inline void SpscByteRing::put(const void *data, std::size_t size)
+{
+	std::size_t offset = staged & mask;
+	std::size_t first = std::min(size, buffer.size() - offset);
+	memcpy(&buffer[offset], data, first);
+	memcpy(&buffer[0], (const uint8_t*) data + first, size - first);
+	staged += size;
+}
+
+inline std::size_t SpscByteRing::peek(const uint8_t *&data) const
+{
+	uint64_t t = tail.load(std::memory_order_relaxed);
+	uint64_t available = head.load(std::memory_order_acquire) - t;
+	std::size_t offset = t & mask;
+	data = &buffer[offset];
+	return (std::size_t) std::min<uint64_t>(available, buffer.size() - offset);
+}
+
+inline TraceWriter::TraceWriter(std::size_t ring_size)
+	: ring(std::max(ring_size, MAX_INSTRUCTION_SIZE * 2))
+	, commands(64)
+{
+	thread = std::thread([this]() { writer_thread(); });
+}
+
+inline TraceWriter::~TraceWriter()
+{
+	end_trace();
+	stopping.store(true, std::memory_order_release);
+	thread.join();
+}
+
+inline void TraceWriter::begin_trace(const std::string &path)
+{
+	end_trace();
+	reserve(8);
+	send({ring.write_position(), path});
+	uint32_t version = FORMAT_VERSION;
+	ring.put("VUTR", 4);
+	ring.put(&version, 4);
+	ring.publish();
+	is_tracing = true;
+	encoder.reset();
+	trace_instructions = 0;
+}
+
+inline void TraceWriter::end_trace()
+{
+	if(is_tracing) {
+		send({ring.write_position(), ""});
+		is_tracing = false;
+	}
+}
+
+inline bool TraceWriter::begin_invocation(const std::string &path, const uint8_t *program, uint32_t entry_pc)
+{
+	if(!filter.accept(program, entry_pc)) {
+		end_trace();
+		return false;
+	}
+	begin_trace(path);
+	return true;
+}
+
+template <typename Registers>
+void TraceWriter::instruction(const Registers &regs, const uint8_t *memory, const uint8_t *program)
+{
+	if(!is_tracing || (filter.max_instructions > 0 && trace_instructions >= filter.max_instructions)) {
+		return;
+	}
+	trace_instructions++;
+	const uint8_t *registers[TracePacketEncoder::REGISTER_COUNT];
+	TracePacketEncoder::register_pointers(registers, regs);
+	reserve(MAX_INSTRUCTION_SIZE);
+	encoder.encode(ring, registers, memory, program);
+	ring.publish();
+}
+
+template <typename Registers>
+void TracePacketEncoder::register_pointers(const uint8_t **dest, const Registers &regs)
+{
+	static_assert(sizeof(regs.VF) == 32 * 16 && sizeof(regs.VI) == 32 * 16, "VF and VI must be 32 quadwords each.");
+	static_assert(sizeof(regs.ACC) == 16 && sizeof(regs.q) == 16 && sizeof(regs.p) == 16, "ACC, Q and P must be quadwords.");
+	for(uint32_t i = 0; i < 32; i++) {
+		dest[i] = (const uint8_t*) &regs.VF[i];
+		dest[32 + i] = (const uint8_t*) &regs.VI[i];
+	}
+	dest[64] = (const uint8_t*) &regs.ACC;
+	dest[65] = (const uint8_t*) &regs.q;
+	dest[66] = (const uint8_t*) &regs.p;
+}
+
+// Produces the same packets as the original capture patch, in the same order,
+// so the output is identical to what it would have written synchronously.
+template <typename Output>
+void TracePacketEncoder::encode(Output &out, const uint8_t *const *registers, const uint8_t *memory, const uint8_t *program)
+{
+	// Only write the microcode out once per file, or again if it changed.
+	if(!has_output_instructions) {
+		out.put("I", 1);
+		out.put(program, PROGRAM_SIZE);
+		has_output_instructions = true;
+	}
+
+	if(!has_last_state) {
+		for(uint32_t i = 0; i < REGISTER_COUNT; i++) {
+			memcpy(&last_registers[i * 16], registers[i], 16);
+		}
+		memcpy(last_memory, memory, MEMORY_SIZE);
+		out.put("R", 1);
+		out.put(last_registers, sizeof(last_registers));
+		out.put("M", 1);
+		out.put(last_memory, MEMORY_SIZE);
+		has_last_state = true;
+	} else {
+		// Only write out the registers that have changed.
+		for(uint32_t i = 0; i < REGISTER_COUNT; i++) {
+			if(memcmp(&last_registers[i * 16], registers[i], 16) != 0) {
+				uint8_t packet[18];
+				packet[0] = 'r';
+				packet[1] = (uint8_t) i;
+				memcpy(&packet[2], registers[i], 16);
+				memcpy(&last_registers[i * 16], registers[i], 16);
+				out.put(packet, sizeof(packet));
+			}
+		}
+		// Only write out the words of memory that have changed. Most blocks
+		// don't change so they're compared a cache line at a time first.
+		for(uint32_t block = 0; block < MEMORY_SIZE; block += 64) {
+			if(memcmp(&last_memory[block], &memory[block], 64) == 0) {
+				continue;
+			}
+			for(uint32_t i = block; i < block + 64; i += 4) {
+				if(memcmp(&last_memory[i], &memory[i], 4) != 0) {
+					uint8_t packet[7];
+					uint16_t address = (uint16_t) i;
+					packet[0] = 'm';
+					memcpy(&packet[1], &address, 2);
+					memcpy(&packet[3], &memory[i], 4);
+					memcpy(&last_memory[i], &memory[i], 4);
+					out.put(packet, sizeof(packet));
+				}
+			}
+		}
+	}
+
+	// Keep track of which instructions are loads and stores.
+	if(read_size > 0) {
+		uint8_t packet[9] = {'L'};
+		memcpy(&packet[1], &read_address, 4);
+		memcpy(&packet[5], &read_size, 4);
+		out.put(packet, sizeof(packet));
+		read_size = 0;
+	}
+	if(write_size > 0) {
+		uint8_t packet[9] = {'S'};
+		memcpy(&packet[1], &write_address, 4);
+		memcpy(&packet[5], &write_size, 4);
+		out.put(packet, sizeof(packet));
+		write_size = 0;
+	}
+
+	out.put("P", 1);
+}
+
+inline void TraceWriter::flush()
+{
+	unsigned spins = 0;
+	while(ring.read_position() != ring.write_position() || !commands.empty()) {
+		backoff(spins);
+	}
+}
+
+inline std::string TraceWriter::error() const
+{
+	if(failed.load(std::memory_order_acquire)) {
+		return writer_error;
+	}
+	return "";
+}
+
+inline void TraceWriter::reserve(std::size_t size)
+{
+	if(ring.free_space() >= size) {
+		return;
+	}
+	stalls++;
+	unsigned spins = 0;
+	while(ring.free_space() < size) {
+		backoff(spins);
+	}
+}
+
+inline void TraceWriter::send(Command command)
+{
+	if(commands.push(command)) {
+		return;
+	}
+	stalls++;
+	unsigned spins = 0;
+	while(!commands.push(command)) {
+		backoff(spins);
+	}
+}
+
+inline void TraceWriter::writer_thread()
+{
+	FILE *file = nullptr;
+	std::string path;
+	unsigned spins = 0;
+	for(;;) {
+		// Read the flag first so that if it's set, everything the emulation
+		// thread published before setting it is visible below.
+		bool stop = stopping.load(std::memory_order_acquire);
+		Command *command = commands.front();
+		uint64_t position = ring.read_position();
+		const uint8_t *data;
+		std::size_t size = ring.peek(data);
+		if(command && position + size > command->position) {
+			size = (std::size_t) (command->position - position);
+		}
+		if(size > 0) {
+			if(file && fwrite(data, size, 1, file) != 1) {
+				fail("Failed to write to " + path + ".");
+				fclose(file);
+				file = nullptr;
+			}
+			ring.consume(size);
+			spins = 0;
+		} else if(command) {
+			if(file && fclose(file) != 0) {
+				fail("Failed to write to " + path + ".");
+			}
+			file = nullptr;
+			path = command->path;
+			if(!path.empty()) {
+				file = fopen(path.c_str(), "wb");
+				if(file == nullptr) {
+					fail("Failed to open " + path + " for writing.");
+				}
+			}
+			commands.pop();
+			spins = 0;
+		} else if(stop) {
+			break;
+		} else {
+			backoff(spins);
+		}
+	}
+	if(file) {
+		fclose(file);
+	}
+}
+
+inline void TraceWriter::fail(const std::string &message)
+{
+	if(!failed.load(std::memory_order_relaxed)) {
+		writer_error = message;
+		failed.store(true, std::memory_order_release);
+	}
+}
+
+// Spin briefly, then yield, then sleep, so an idle writer thread doesn't
+// burn a core while the emulator isn't tracing.
+inline void TraceWriter::backoff(unsigned &spins)
+{
+	if(spins < 64) {
+		spins++;
+	} else if(spins < 128) {
+		spins++;
+		std::this_thread::yield();
+	} else {
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+#endif
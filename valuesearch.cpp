@@ -0,0 +1,402 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "valuesearch.h"
+
+#include <cmath>
+#include <atomic>
+#include <sstream>
+#include <algorithm>
+#include <stdlib.h>
+
+u32 ValueSearch::size() const
+{
+	switch(type) {
+		case SEARCH_BYTES: return (u32) bytes.size();
+		case SEARCH_FLOAT: return 4;
+		case SEARCH_VEC4: return 16;
+		case SEARCH_INT16: return 2;
+		case SEARCH_INT32: return 4;
+		case SEARCH_GIF_TAG: return 16;
+	}
+	return 1;
+}
+
+u32 ValueSearch::alignment() const
+{
+	return type == SEARCH_BYTES ? 1 : size();
+}
+
+static bool parse_float(float &dest, const std::string &text)
+{
+	char *end = nullptr;
+	dest = strtof(text.c_str(), &end);
+	return !text.empty() && *end == '\0';
+}
+
+static bool parse_int(long long &dest, const std::string &text)
+{
+	char *end = nullptr;
+	dest = strtoll(text.c_str(), &end, 0);
+	return !text.empty() && *end == '\0';
+}
+
+// Set a field of the 128-bit GIF tag, and mark it as not being a wildcard.
+static void set_tag_field(ValueSearch &search, u32 first_bit, u32 bit_count, u64 value)
+{
+	u32 word = first_bit / 64;
+	u32 shift = first_bit % 64;
+	u64 mask = bit_count == 64 ? ~(u64) 0 : ((u64) 1 << bit_count) - 1;
+	search.tag_value[word] = (search.tag_value[word] & ~(mask << shift)) | ((value & mask) << shift);
+	search.tag_mask[word] |= mask << shift;
+}
+
+bool parse_value_search(ValueSearch &search, const std::string &text, std::string &error)
+{
+	search = ValueSearch();
+	std::istringstream stream(text);
+	std::string kind;
+	std::vector<std::string> args;
+	stream >> kind;
+	for(std::string arg; stream >> arg;) {
+		args.push_back(arg);
+	}
+	if(kind == "bytes") {
+		search.type = SEARCH_BYTES;
+		std::string hex;
+		for(const std::string &arg : args) hex += arg;
+		if(hex.empty() || hex.size() % 2 != 0) {
+			error = "Expected an even number of hex digits.";
+			return false;
+		}
+		for(std::size_t i = 0; i < hex.size(); i += 2) {
+			char *end = nullptr;
+			std::string byte = hex.substr(i, 2);
+			search.bytes.push_back((u8) strtoul(byte.c_str(), &end, 16));
+			if(*end != '\0') {
+				error = "Invalid hex digit in '" + byte + "'.";
+				return false;
+			}
+		}
+		if(search.bytes.size() > VU1_MEMSIZE) {
+			error = "Too many bytes.";
+			return false;
+		}
+	} else if(kind == "float") {
+		search.type = SEARCH_FLOAT;
+		if(args.empty() || args.size() > 2 || !parse_float(search.value[0], args[0]) ||
+			(args.size() == 2 && !parse_float(search.epsilon, args[1]))) {
+			error = "Expected: float <value> [epsilon]";
+			return false;
+		}
+	} else if(kind == "vec4") {
+		search.type = SEARCH_VEC4;
+		bool success = args.size() == 4 || args.size() == 5;
+		for(std::size_t i = 0; success && i < 4; i++) {
+			success = parse_float(search.value[i], args[i]);
+		}
+		if(!success || (args.size() == 5 && !parse_float(search.epsilon, args[4]))) {
+			error = "Expected: vec4 <x> <y> <z> <w> [epsilon]";
+			return false;
+		}
+	} else if(kind == "int16" || kind == "int32") {
+		search.type = kind == "int16" ? SEARCH_INT16 : SEARCH_INT32;
+		long long limit = kind == "int16" ? INT16_MAX : INT32_MAX;
+		long long min, max;
+		if(args.empty() || args.size() > 2 || !parse_int(min, args[0]) || !parse_int(max, args.back()) ||
+			min < -limit - 1 || max > limit || min > max) {
+			error = "Expected: " + kind + " <min> [max], between " + std::to_string(-limit - 1) + " and " + std::to_string(limit) + ".";
+			return false;
+		}
+		search.min = (s32) min;
+		search.max = (s32) max;
+	} else if(kind == "giftag") {
+		search.type = SEARCH_GIF_TAG;
+		static const struct { const char *name; u32 first_bit; u32 bit_count; } fields[] = {
+			{"nloop", 0, 15}, {"eop", 15, 1}, {"pre", 46, 1}, {"prim", 47, 11},
+			{"flg", 58, 2}, {"nreg", 60, 4}, {"regs", 64, 64}
+		};
+		for(const std::string &arg : args) {
+			std::size_t equals = arg.find('=');
+			std::string name = arg.substr(0, equals);
+			auto field = std::find_if(std::begin(fields), std::end(fields), [&](auto &f) { return name == f.name; });
+			long long value;
+			// The register descriptors are always written in hex.
+			bool valid = equals != std::string::npos && field != std::end(fields) &&
+				(name == "regs" ? (value = (long long) strtoull(arg.c_str() + equals + 1, nullptr, 16), true) :
+				parse_int(value, arg.substr(equals + 1)));
+			if(!valid) {
+				error = "Invalid GIF tag field '" + arg + "', expected one of nloop, eop, pre, prim, flg, nreg or regs e.g. eop=1.";
+				return false;
+			}
+			set_tag_field(search, field->first_bit, field->bit_count, (u64) value);
+		}
+	} else {
+		error = "Expected bytes, float, vec4, int16, int32 or giftag.";
+		return false;
+	}
+	return true;
+}
+
+// Check whether the value is at a single position i.e. address / alignment.
+static bool match_at(const ValueSearch &search, const u8 *memory, u32 position)
+{
+	const u8 *data = &memory[position * search.alignment()];
+	switch(search.type) {
+		case SEARCH_BYTES: {
+			return memcmp(data, search.bytes.data(), search.bytes.size()) == 0;
+		}
+		case SEARCH_FLOAT: {
+			float value;
+			memcpy(&value, data, 4);
+			return std::fabs(value - search.value[0]) <= search.epsilon;
+		}
+		case SEARCH_VEC4: {
+			float value[4];
+			memcpy(value, data, 16);
+			bool match = true;
+			for(int i = 0; i < 4; i++) match &= std::fabs(value[i] - search.value[i]) <= search.epsilon;
+			return match;
+		}
+		case SEARCH_INT16: {
+			s16 value;
+			memcpy(&value, data, 2);
+			return value >= search.min && value <= search.max;
+		}
+		case SEARCH_INT32: {
+			s32 value;
+			memcpy(&value, data, 4);
+			return value >= search.min && value <= search.max;
+		}
+		case SEARCH_GIF_TAG: {
+			u64 value[2];
+			memcpy(value, data, 16);
+			return ((value[0] & search.tag_mask[0]) == search.tag_value[0]) &
+				((value[1] & search.tag_mask[1]) == search.tag_value[1]);
+		}
+	}
+	return false;
+}
+
+// Check every position at once. The loops are branchless so the compiler
+// can vectorise them.
+static void match_all(const ValueSearch &search, const u8 *memory, u32 position_count, u8 *matches)
+{
+	switch(search.type) {
+		case SEARCH_BYTES: {
+			u8 first = search.bytes[0];
+			for(u32 i = 0; i < position_count; i++) {
+				matches[i] = memory[i] == first;
+			}
+			for(u32 i = 0; i < position_count; i++) {
+				if(matches[i]) matches[i] = match_at(search, memory, i);
+			}
+			break;
+		}
+		case SEARCH_FLOAT: {
+			float target = search.value[0], epsilon = search.epsilon;
+			for(u32 i = 0; i < position_count; i++) {
+				float value;
+				memcpy(&value, &memory[i * 4], 4);
+				matches[i] = std::fabs(value - target) <= epsilon;
+			}
+			break;
+		}
+		case SEARCH_VEC4: {
+			for(u32 i = 0; i < position_count; i++) {
+				float value[4];
+				memcpy(value, &memory[i * 16], 16);
+				u8 match = 1;
+				for(int j = 0; j < 4; j++) match &= std::fabs(value[j] - search.value[j]) <= search.epsilon;
+				matches[i] = match;
+			}
+			break;
+		}
+		case SEARCH_INT16: {
+			s32 min = search.min, max = search.max;
+			for(u32 i = 0; i < position_count; i++) {
+				s16 value;
+				memcpy(&value, &memory[i * 2], 2);
+				matches[i] = (value >= min) & (value <= max);
+			}
+			break;
+		}
+		case SEARCH_INT32: {
+			s32 min = search.min, max = search.max;
+			for(u32 i = 0; i < position_count; i++) {
+				s32 value;
+				memcpy(&value, &memory[i * 4], 4);
+				matches[i] = (value >= min) & (value <= max);
+			}
+			break;
+		}
+		case SEARCH_GIF_TAG: {
+			for(u32 i = 0; i < position_count; i++) {
+				matches[i] = match_at(search, memory, i);
+			}
+			break;
+		}
+	}
+}
+
+static bool search_block(std::vector<ValueMatch> &dest, SnapshotStore &store, const ValueSearch &search, std::size_t block)
+{
+	std::vector<u8> data;
+	if(!store.read_block(block, data)) {
+		return false;
+	}
+	u32 alignment = search.alignment();
+	u32 size = search.size();
+	u32 position_count = (VU1_MEMSIZE - size) / alignment + 1;
+	std::unique_ptr<Snapshot> snapshot(new Snapshot);
+	std::vector<u8> matches(position_count);
+	std::vector<u32> first(position_count);
+	std::vector<u16> changed;
+
+	u32 begin = (u32) (block * SnapshotStore::KEYFRAME_INTERVAL);
+	u32 end = (u32) std::min(begin + SnapshotStore::KEYFRAME_INTERVAL, store.size());
+	std::size_t offset = decode_snapshot(*snapshot, data.data(), 0);
+	match_all(search, snapshot->memory, position_count, matches.data());
+	std::fill(first.begin(), first.end(), begin);
+	for(u32 index = begin + 1; index < end; index++) {
+		changed.clear();
+		offset = decode_snapshot(*snapshot, data.data(), offset, &changed);
+		for(u16 qword : changed) {
+			// Every position that overlaps the quadword.
+			u32 low = qword * 16 < size ? 0 : (qword * 16 - size + alignment) / alignment;
+			u32 high = std::min((qword * 16 + 16 + alignment - 1) / alignment, position_count);
+			for(u32 position = low; position < high; position++) {
+				u8 match = match_at(search, snapshot->memory, position);
+				if(match == matches[position]) {
+					continue;
+				}
+				if(match) {
+					first[position] = index;
+				} else {
+					dest.push_back({position * alignment, first[position], index});
+				}
+				matches[position] = match;
+			}
+		}
+	}
+	for(u32 position = 0; position < position_count; position++) {
+		if(matches[position]) {
+			dest.push_back({position * alignment, first[position], end});
+		}
+	}
+	std::sort(dest.begin(), dest.end(), [](auto &l, auto &r) {
+		return l.address != r.address ? l.address < r.address : l.first_snapshot < r.first_snapshot;
+	});
+	return true;
+}
+
+// The blocks are searched a wave at a time, and the runs found are joined up
+// with the ones from the previous block in order, so the search can stop
+// once enough runs have been found without holding the results for every
+// block in memory.
+void search_values(ValueSearchResult &result, SnapshotStore &store, const ValueSearch &search, ThreadPool &pool, const MemoryAnnotations *annotations, std::size_t max_matches)
+{
+	result = ValueSearchResult();
+	if(store.empty() || search.size() == 0) {
+		return;
+	}
+	std::vector<ValueMatch> &matches = result.matches;
+	std::vector<ValueMatch> open; // Runs reaching the end of the last block, sorted by address.
+	std::size_t block_count = store.block_count();
+	std::size_t wave_size = pool.thread_count() * 4;
+	std::size_t block = 0;
+	while(block < block_count && matches.size() < max_matches) {
+		std::size_t wave_end = std::min(block + wave_size, block_count);
+		std::vector<std::vector<ValueMatch>> results(wave_end - block);
+		std::atomic<bool> failed{false};
+		for(std::size_t i = block; i < wave_end; i++) {
+			pool.submit([&, i]() {
+				if(!search_block(results[i - block], store, search, i)) {
+					failed = true;
+				}
+			});
+		}
+		pool.wait();
+		if(failed) {
+			result.error = store.spill_error() ? store.spill_error() : "Failed to read snapshots.";
+			return;
+		}
+		for(std::size_t i = block; i < wave_end; i++) {
+			// The filter only depends on the address, so the runs at an
+			// address are either all kept or all dropped, and the ones that
+			// are dropped never count towards max_matches.
+			if(annotations) {
+				filter_value_matches(results[i - block], search, *annotations);
+			}
+			u32 begin = (u32) (i * SnapshotStore::KEYFRAME_INTERVAL);
+			u32 end = (u32) std::min(begin + SnapshotStore::KEYFRAME_INTERVAL, store.size());
+			std::vector<ValueMatch> next_open;
+			auto iter = open.begin();
+			for(ValueMatch match : results[i - block]) {
+				while(iter != open.end() && iter->address < match.address) {
+					matches.push_back(*iter++);
+				}
+				if(match.first_snapshot == begin && iter != open.end() && iter->address == match.address) {
+					match.first_snapshot = iter->first_snapshot;
+					iter++;
+				}
+				if(match.end_snapshot == end) {
+					next_open.push_back(match);
+				} else {
+					matches.push_back(match);
+				}
+			}
+			matches.insert(matches.end(), iter, open.end());
+			open = std::move(next_open);
+		}
+		block = wave_end;
+	}
+	// If the search stopped early, the runs that were still going end where
+	// it stopped.
+	matches.insert(matches.end(), open.begin(), open.end());
+	std::sort(matches.begin(), matches.end(), [](auto &l, auto &r) {
+		return l.first_snapshot != r.first_snapshot ? l.first_snapshot < r.first_snapshot : l.address < r.address;
+	});
+	if(block < block_count || matches.size() > max_matches) {
+		result.truncated = true;
+		matches.resize(std::min(matches.size(), max_matches));
+	}
+}
+
+void filter_value_matches(std::vector<ValueMatch> &matches, const ValueSearch &search, const MemoryAnnotations &annotations)
+{
+	MemoryType wanted = MEMTYPE_NONE;
+	switch(search.type) {
+		case SEARCH_BYTES: wanted = MEMTYPE_NONE; break;
+		case SEARCH_FLOAT: wanted = MEMTYPE_VEC4; break;
+		case SEARCH_VEC4: wanted = MEMTYPE_VEC4; break;
+		case SEARCH_INT16: wanted = MEMTYPE_INT16X8; break;
+		case SEARCH_INT32: wanted = MEMTYPE_INT32X4; break;
+		case SEARCH_GIF_TAG: wanted = MEMTYPE_GIF_TAG; break;
+	}
+	u32 size = search.size();
+	matches.erase(std::remove_if(matches.begin(), matches.end(), [&](const ValueMatch &match) {
+		auto [begin, end] = annotations.find_range(match.address, match.address + size);
+		for(const MemoryAnnotation *annotation = begin; annotation < end; annotation++) {
+			if(wanted == MEMTYPE_NONE || annotation->type == wanted) {
+				return false;
+			}
+		}
+		return true;
+	}), matches.end());
+}
@@ -0,0 +1,93 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef VALUESEARCH_H
+#define VALUESEARCH_H
+
+#include <string>
+#include <vector>
+
+#include "pcsx2defs.h"
+#include "snapshotstore.h"
+#include "threadpool.h"
+#include "annotations.h"
+
+enum ValueSearchType
+{
+	SEARCH_BYTES,   // An exact byte sequence at any address.
+	SEARCH_FLOAT,   // A float within epsilon of value[0], 4 byte aligned.
+	SEARCH_VEC4,    // Four floats each within epsilon of value, 16 byte aligned.
+	SEARCH_INT16,   // A signed 16-bit integer in [min, max], 2 byte aligned.
+	SEARCH_INT32,   // A signed 32-bit integer in [min, max], 4 byte aligned.
+	SEARCH_GIF_TAG  // A quadword matching tag_value where tag_mask is set.
+};
+
+struct ValueSearch
+{
+	ValueSearchType type = SEARCH_BYTES;
+	std::vector<u8> bytes;
+	float value[4] = {};
+	float epsilon = 0.f;
+	s32 min = 0;
+	s32 max = 0;
+	u64 tag_value[2] = {};
+	u64 tag_mask[2] = {}; // Fields that aren't set are wildcards.
+
+	u32 size() const;
+	u32 alignment() const;
+};
+
+// A value being present at an address for a run of consecutive snapshots.
+struct ValueMatch
+{
+	u32 address;
+	u32 first_snapshot; // Where the value appears.
+	u32 end_snapshot; // Where it disappears, or the snapshot count.
+};
+
+struct ValueSearchResult
+{
+	std::vector<ValueMatch> matches; // Sorted by first_snapshot then address.
+	bool truncated = false;
+	std::string error;
+};
+
+// Parses searches like:
+//  bytes 0a0b0c0d
+//  float 1.5 0.001
+//  vec4 0 0 0 1 0.001
+//  int16 -100 100
+//  int32 0 65535
+//  giftag eop=1 flg=0 nreg=3 regs=512
+// where the epsilon for floats defaults to zero, and for a GIF tag any of
+// nloop, eop, pre, prim, flg, nreg and regs that are left out match anything.
+bool parse_value_search(ValueSearch &search, const std::string &text, std::string &error);
+
+// Find every run of snapshots where the value is present in VU memory. Each
+// block of the store is searched on the thread pool: the whole of memory is
+// checked at the keyframe, then only the addresses overlapping quadwords
+// that the deltas after it change. If annotations isn't null, only the
+// matches that pass filter_value_matches are kept. Once max_matches runs
+// have ended the search stops and truncated is set, and any runs still going
+// end there.
+void search_values(ValueSearchResult &result, SnapshotStore &store, const ValueSearch &search, ThreadPool &pool, const MemoryAnnotations *annotations = nullptr, std::size_t max_matches = 1000000);
+// Only keep the matches in memory annotated with the type being searched
+// for e.g. vec4 memory for a float. Byte searches match any annotated memory.
+void filter_value_matches(std::vector<ValueMatch> &matches, const ValueSearch &search, const MemoryAnnotations &annotations);
+
+#endif
@@ -0,0 +1,371 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "vif.h"
+
+bool is_vif_unpack(u8 command)
+{
+	return (command & 0x60) == 0x60;
+}
+
+bool is_vif_micro_call(u8 command)
+{
+	command &= 0x7f;
+	return command == VIF_MSCAL || command == VIF_MSCALF || command == VIF_MSCNT;
+}
+
+// The vn and vl fields of an UNPACK command select one of these formats.
+const char *vif_unpack_format_name(u8 command)
+{
+	static const char *names[16] = {
+		"S-32", "S-16", "S-8", "(invalid)",
+		"V2-32", "V2-16", "V2-8", "(invalid)",
+		"V3-32", "V3-16", "V3-8", "(invalid)",
+		"V4-32", "V4-16", "V4-8", "V4-5"
+	};
+	return names[command & 0xf];
+}
+
+// The top bit of a command is the interrupt bit, so it's ignored here.
+const char *vif_command_name(u8 command)
+{
+	command &= 0x7f;
+	if(is_vif_unpack(command)) {
+		return "UNPACK";
+	}
+	switch(command) {
+		case VIF_NOP: return "NOP";
+		case VIF_STCYCL: return "STCYCL";
+		case VIF_OFFSET: return "OFFSET";
+		case VIF_BASE: return "BASE";
+		case VIF_ITOP: return "ITOP";
+		case VIF_STMOD: return "STMOD";
+		case VIF_MSKPATH3: return "MSKPATH3";
+		case VIF_MARK: return "MARK";
+		case VIF_FLUSHE: return "FLUSHE";
+		case VIF_FLUSH: return "FLUSH";
+		case VIF_FLUSHA: return "FLUSHA";
+		case VIF_MSCAL: return "MSCAL";
+		case VIF_MSCALF: return "MSCALF";
+		case VIF_MSCNT: return "MSCNT";
+		case VIF_STMASK: return "STMASK";
+		case VIF_STROW: return "STROW";
+		case VIF_STCOL: return "STCOL";
+		case VIF_MPG: return "MPG";
+		case VIF_DIRECT: return "DIRECT";
+		case VIF_DIRECTHL: return "DIRECTHL";
+	}
+	return "(invalid)";
+}
+
+// Size of a single vector in the source data, in bytes.
+u32 vif_unpack_vector_size(u8 command)
+{
+	u32 vn = (command >> 2) & 3;
+	u32 vl = command & 3;
+	if(vl == 3) {
+		return vn == 3 ? 2 : 0; // V4-5 is the only valid format with vl = 3.
+	}
+	return (vn + 1) * (4 >> vl);
+}
+
+// Number of bytes of source data an UNPACK reads. In filling mode (cl < wl)
+// only the first cl of every wl vectors written come from the source.
+u32 vif_unpack_source_size(u8 command, u32 num, u32 cl, u32 wl)
+{
+	u32 count = num;
+	if(cl < wl) {
+		count = (num / wl) * cl + std::min(num % wl, cl);
+	}
+	u32 size = count * vif_unpack_vector_size(command);
+	return (size + 3) & ~3;
+}
+
+template <int components, typename Element>
+void vif_unpack_kernel(u32 *dest, const u8 *src, std::size_t count)
+{
+	// Plain loops so the compiler can vectorise them.
+	for(std::size_t i = 0; i < count; i++) {
+		Element elements[components];
+		memcpy(elements, src + i * sizeof(elements), sizeof(elements));
+		for(int j = 0; j < 4; j++) {
+			dest[i * 4 + j] = (u32) (s32) elements[components == 1 ? 0 : std::min(j, components - 1)];
+		}
+	}
+}
+
+void vif_unpack_v4_5(u32 *dest, const u8 *src, std::size_t count)
+{
+	for(std::size_t i = 0; i < count; i++) {
+		u16 pixel;
+		memcpy(&pixel, src + i * 2, 2);
+		dest[i * 4 + 0] = (pixel & 0x1f) << 3;
+		dest[i * 4 + 1] = ((pixel >> 5) & 0x1f) << 3;
+		dest[i * 4 + 2] = ((pixel >> 10) & 0x1f) << 3;
+		dest[i * 4 + 3] = (pixel >> 15) << 7;
+	}
+}
+
+// Decode count vectors into dest, four u32s per vector. S formats are
+// broadcast to all four fields. Fields beyond those in the source format are
+// filled with copies of the last one, but they're undefined on the hardware.
+void vif_decode_vectors(u32 *dest, const u8 *src, std::size_t count, u8 command, bool usn)
+{
+	u32 format = command & 0xf;
+	switch(format) {
+		case 0x0: vif_unpack_kernel<1, u32>(dest, src, count); break;
+		case 0x4: vif_unpack_kernel<2, u32>(dest, src, count); break;
+		case 0x8: vif_unpack_kernel<3, u32>(dest, src, count); break;
+		case 0xc: vif_unpack_kernel<4, u32>(dest, src, count); break;
+		case 0xf: vif_unpack_v4_5(dest, src, count); break;
+		default: {
+			u32 vn = format >> 2;
+			bool is_16 = (format & 3) == 1;
+			switch(vn * 4 + (is_16 ? 0 : 1) + (usn ? 2 : 0)) {
+				case 0x0: vif_unpack_kernel<1, s16>(dest, src, count); break;
+				case 0x1: vif_unpack_kernel<1, s8>(dest, src, count); break;
+				case 0x2: vif_unpack_kernel<1, u16>(dest, src, count); break;
+				case 0x3: vif_unpack_kernel<1, u8>(dest, src, count); break;
+				case 0x4: vif_unpack_kernel<2, s16>(dest, src, count); break;
+				case 0x5: vif_unpack_kernel<2, s8>(dest, src, count); break;
+				case 0x6: vif_unpack_kernel<2, u16>(dest, src, count); break;
+				case 0x7: vif_unpack_kernel<2, u8>(dest, src, count); break;
+				case 0x8: vif_unpack_kernel<3, s16>(dest, src, count); break;
+				case 0x9: vif_unpack_kernel<3, s8>(dest, src, count); break;
+				case 0xa: vif_unpack_kernel<3, u16>(dest, src, count); break;
+				case 0xb: vif_unpack_kernel<3, u8>(dest, src, count); break;
+				case 0xc: vif_unpack_kernel<4, s16>(dest, src, count); break;
+				case 0xd: vif_unpack_kernel<4, s8>(dest, src, count); break;
+				case 0xe: vif_unpack_kernel<4, u16>(dest, src, count); break;
+				case 0xf: vif_unpack_kernel<4, u8>(dest, src, count); break;
+			}
+		}
+	}
+}
+
+// Emulate a single UNPACK command. See EE User's Manual section 6.3.4.
+bool vif_unpack(VuMemoryImage &dest, VifUnpackState &state, u8 command, u16 immediate, u32 num, const u8 *src, std::size_t size, std::string &error)
+{
+	if(vif_unpack_vector_size(command) == 0) {
+		error = "Invalid UNPACK format.";
+		return false;
+	}
+	u32 cl = state.cl;
+	u32 wl = state.wl == 0 ? 256 : state.wl;
+	if(num == 0) {
+		num = 256;
+	}
+	if(vif_unpack_source_size(command, num, cl, wl) > size) {
+		error = "Not enough data for UNPACK.";
+		return false;
+	}
+	
+	bool usn = (immediate >> 14) & 1;
+	bool flg = (immediate >> 15) & 1;
+	bool masked = (command >> 4) & 1;
+	u32 address = immediate & 0x3ff;
+	if(flg) {
+		address += state.tops;
+	}
+	
+	u32 vector_count = vif_unpack_source_size(command, num, cl, wl) / std::max(vif_unpack_vector_size(command), 1u);
+	std::vector<u32> vectors((vector_count + 1) * 4);
+	vif_decode_vectors(vectors.data(), src, vector_count, command, usn);
+	
+	u32 defined_fields = ((command >> 2) & 3) + 1;
+	if((command & 0xc) == 0) {
+		defined_fields = 4; // S formats are broadcast.
+	}
+	
+	u32 read_index = 0;
+	for(u32 i = 0; i < num; i++) {
+		u32 cycle = i % wl;
+		u32 qword;
+		bool from_source;
+		if(cl >= wl) {
+			qword = address + (i / wl) * cl + cycle;
+			from_source = true;
+		} else {
+			qword = address + i;
+			from_source = cycle < cl;
+		}
+		u32 mask_row = std::min(cycle, 3u);
+		u8 *out = &dest.data[(qword * 16) % VU1_MEMSIZE];
+		u8 *valid = &dest.valid[(qword * 16) % VU1_MEMSIZE];
+		for(u32 field = 0; field < 4; field++) {
+			u32 mask = masked ? (state.mask >> (mask_row * 8 + field * 2)) & 3 : 0;
+			u32 value = 0;
+			bool is_defined = true;
+			switch(mask) {
+				case 0: {
+					if(!from_source || field >= defined_fields) {
+						is_defined = false;
+						break;
+					}
+					value = vectors[read_index * 4 + field];
+					if(state.mode == 1) {
+						value += state.row[field];
+					} else if(state.mode == 2) {
+						state.row[field] += value;
+						value = state.row[field];
+					}
+					break;
+				}
+				case 1: value = state.row[field]; break;
+				case 2: value = state.col[mask_row]; break;
+				case 3: continue; // Write protected.
+			}
+			memcpy(&out[field * 4], &value, 4);
+			memset(&valid[field * 4], is_defined, 4);
+		}
+		if(from_source) {
+			read_index++;
+		}
+	}
+	return true;
+}
+
+// Interpret a VIF command stream e.g. the payload of a DMA transfer, applying
+// all the UNPACKs in it. Other commands that transfer data are skipped.
+bool vif_run(VuMemoryImage &dest, VifUnpackState &state, const u8 *data, std::size_t size, std::vector<VifUnpackRecord> &unpacks, std::string &error)
+{
+	std::size_t pos = 0;
+	while(pos + 4 <= size) {
+		u32 code;
+		memcpy(&code, &data[pos], 4);
+		u32 immediate = code & 0xffff;
+		u32 num = (code >> 16) & 0xff;
+		u8 command = (code >> 24) & 0x7f;
+		std::size_t payload = 0;
+		pos += 4;
+		if(is_vif_unpack(command)) {
+			payload = vif_unpack_source_size(command, num == 0 ? 256 : num, state.cl, state.wl == 0 ? 256 : state.wl);
+			if(!vif_unpack(dest, state, command, immediate, num, &data[pos], size - pos, error)) {
+				char prefix[32];
+				snprintf(prefix, sizeof(prefix), "At offset 0x%lx: ", (long) pos - 4);
+				error = prefix + error;
+				return false;
+			}
+			u32 address = ((immediate & 0x3ff) + ((immediate >> 15) ? state.tops : 0)) * 16;
+			unpacks.push_back({(u32) (pos - 4), command, address, num == 0 ? 256 : num});
+		} else {
+			switch(command) {
+				case VIF_NOP: case VIF_ITOP: case VIF_MSKPATH3: case VIF_MARK:
+				case VIF_FLUSHE: case VIF_FLUSH: case VIF_FLUSHA: {
+					break;
+				}
+				case VIF_STCYCL: {
+					state.cl = immediate & 0xff;
+					state.wl = (immediate >> 8) & 0xff;
+					break;
+				}
+				case VIF_OFFSET: {
+					state.offset = immediate & 0x3ff;
+					state.dbf = false;
+					state.tops = state.base;
+					break;
+				}
+				case VIF_BASE: {
+					state.base = immediate & 0x3ff;
+					break;
+				}
+				case VIF_STMOD: {
+					state.mode = immediate & 3;
+					break;
+				}
+				case VIF_MSCAL: case VIF_MSCALF: case VIF_MSCNT: {
+					state.dbf = !state.dbf;
+					state.tops = state.dbf ? state.base + state.offset : state.base;
+					break;
+				}
+				case VIF_STMASK: {
+					payload = 4;
+					if(pos + payload <= size) memcpy(&state.mask, &data[pos], 4);
+					break;
+				}
+				case VIF_STROW: {
+					payload = 16;
+					if(pos + payload <= size) memcpy(state.row, &data[pos], 16);
+					break;
+				}
+				case VIF_STCOL: {
+					payload = 16;
+					if(pos + payload <= size) memcpy(state.col, &data[pos], 16);
+					break;
+				}
+				case VIF_MPG: {
+					payload = (num == 0 ? 256 : num) * 8;
+					break;
+				}
+				case VIF_DIRECT: case VIF_DIRECTHL: {
+					payload = (immediate == 0 ? 65536 : immediate) * 16;
+					break;
+				}
+				default: {
+					char message[64];
+					snprintf(message, sizeof(message), "Invalid VIF command 0x%02x at offset 0x%lx.", command, (long) pos - 4);
+					error = message;
+					return false;
+				}
+			}
+		}
+		if(payload > size - pos) {
+			error = "VIF command stream is truncated.";
+			return false;
+		}
+		pos += payload;
+	}
+	return true;
+}
+
+// Find every qword aligned position in memory where the valid bytes of the
+// image match, ignoring the address it was unpacked to.
+void vif_find_image(std::vector<u32> &addresses, const VuMemoryImage &image, const u8 *memory)
+{
+	u32 first = 0;
+	while(first < VU1_MEMSIZE && !image.valid[first]) first++;
+	if(first == VU1_MEMSIZE) {
+		return;
+	}
+	u32 last = VU1_MEMSIZE;
+	while(!image.valid[last - 1]) last--;
+	// Check a fully valid word first to reject most positions quickly.
+	u32 anchor = first & ~3;
+	while(anchor + 4 <= last && memchr(&image.valid[anchor], 0, 4) != nullptr) anchor += 4;
+	bool has_anchor = anchor + 4 <= last;
+	u32 anchor_value = 0;
+	if(has_anchor) {
+		memcpy(&anchor_value, &image.data[anchor], 4);
+	}
+	
+	u32 length = last - first;
+	for(u32 address = first % 16; address + length <= VU1_MEMSIZE; address += 16) {
+		if(has_anchor) {
+			u32 value;
+			memcpy(&value, &memory[address + anchor - first], 4);
+			if(value != anchor_value) continue;
+		}
+		bool matches = true;
+		for(u32 i = 0; i < length && matches; i++) {
+			matches = !image.valid[first + i] || image.data[first + i] == memory[address + i];
+		}
+		if(matches) {
+			addresses.push_back(address);
+		}
+	}
+}
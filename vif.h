@@ -0,0 +1,105 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIF_H
+#define VIF_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdio.h>
+
+#include "pcsx2defs.h"
+
+// See EE User's Manual section 6.3.
+enum VifCommand
+{
+	VIF_NOP      = 0x00,
+	VIF_STCYCL   = 0x01,
+	VIF_OFFSET   = 0x02,
+	VIF_BASE     = 0x03,
+	VIF_ITOP     = 0x04,
+	VIF_STMOD    = 0x05,
+	VIF_MSKPATH3 = 0x06,
+	VIF_MARK     = 0x07,
+	VIF_FLUSHE   = 0x10,
+	VIF_FLUSH    = 0x11,
+	VIF_FLUSHA   = 0x13,
+	VIF_MSCAL    = 0x14,
+	VIF_MSCALF   = 0x15,
+	VIF_MSCNT    = 0x17,
+	VIF_STMASK   = 0x20,
+	VIF_STROW    = 0x30,
+	VIF_STCOL    = 0x31,
+	VIF_MPG      = 0x4a,
+	VIF_DIRECT   = 0x50,
+	VIF_DIRECTHL = 0x51,
+	VIF_UNPACK   = 0x60 // 0x60 to 0x7f.
+};
+
+// The registers that affect how data is unpacked.
+struct VifUnpackState
+{
+	u32 row[4] = {};
+	u32 col[4] = {};
+	u32 mask = 0;
+	u32 mode = 0; // STMOD: 0 = normal, 1 = offset, 2 = difference.
+	u32 cl = 1;
+	u32 wl = 1;
+	u32 base = 0;
+	u32 offset = 0;
+	u32 tops = 0;
+	bool dbf = false;
+};
+
+// The result of unpacking data into VU memory. Bytes that weren't written to
+// or that hold values the hardware leaves undefined are marked as invalid so
+// they're ignored when searching.
+struct VuMemoryImage
+{
+	u8 data[VU1_MEMSIZE] = {};
+	u8 valid[VU1_MEMSIZE] = {};
+};
+
+struct VifUnpackRecord
+{
+	u32 source_offset;
+	u8 command;
+	u32 address; // In bytes.
+	u32 num;
+};
+
+struct VifSearchMatch
+{
+	std::size_t snapshot;
+	u32 address; // Where the first valid byte of the image was found.
+};
+
+bool is_vif_unpack(u8 command);
+bool is_vif_micro_call(u8 command);
+const char *vif_unpack_format_name(u8 command);
+const char *vif_command_name(u8 command);
+u32 vif_unpack_vector_size(u8 command);
+u32 vif_unpack_source_size(u8 command, u32 num, u32 cl, u32 wl);
+void vif_decode_vectors(u32 *dest, const u8 *src, std::size_t count, u8 command, bool usn);
+bool vif_unpack(VuMemoryImage &dest, VifUnpackState &state, u8 command, u16 immediate, u32 num, const u8 *src, std::size_t size, std::string &error);
+bool vif_run(VuMemoryImage &dest, VifUnpackState &state, const u8 *data, std::size_t size, std::vector<VifUnpackRecord> &unpacks, std::string &error);
+void vif_find_image(std::vector<u32> &addresses, const VuMemoryImage &image, const u8 *memory);
+
+#endif
@@ -21,6 +21,26 @@
 #include <stdio.h>
 
 #include "pcsx2disassemble.h"
+#include "trace.h"
+#include "sessioncontainer.h"
+
+// Traces (with a header) and traces in session containers are disassembled
+// using the program at their last snapshot, the one their hash is of.
+static bool is_trace(const std::string &path)
+{
+	std::string container;
+	std::size_t trace;
+	if(split_container_path(path, container, trace)) {
+		return true;
+	}
+	FILE *file = fopen(path.c_str(), "rb");
+	char magic[4];
+	bool result = file && fread(magic, 4, 1, file) == 1 && memcmp(magic, "VUTR", 4) == 0;
+	if(file) {
+		fclose(file);
+	}
+	return result;
+}
 
 int main(int argc, char **argv)
 {
@@ -29,6 +49,22 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 	
+	if(is_trace(argv[1])) {
+		TraceReader reader;
+		if(reader.open(argv[1])) {
+			while(reader.next_snapshot());
+		}
+		if(!reader.error.empty() || reader.snapshot_count == 0) {
+			fprintf(stderr, "Cannot read trace: %s\n", reader.error.empty() ? "No snapshots." : reader.error.c_str());
+			exit(1);
+		}
+		const u8 *program = reader.snapshot().program;
+		for(u32 i = 0; i < VU1_PROGSIZE; i += 8) {
+			printf("%s\n", disassemble(&program[i], i).c_str());
+		}
+		return 0;
+	}
+	
 	FILE *microcode = fopen(argv[1], "rb");
 	if(microcode == nullptr) {
 		fprintf(stderr, "Cannot open file.\n");
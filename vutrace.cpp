@@ -16,16 +16,25 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <map>
 #include <array>
 #include <string>
 #include <vector>
 #include <fstream>
+#include <unordered_map>
 #include <iomanip>
+#include <future>
+#include <memory>
 #include <sstream>
+#include <thread>
 #include <stdio.h>
 #include <stdlib.h>
-#include <functional>
+#include <algorithm>
+#include <filesystem>
+#include <climits>
+#ifdef _WIN32
+	#include <io.h>
+	#include <fcntl.h>
+#endif
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <imgui.h>
@@ -36,10 +45,24 @@
 
 #include "pcsx2defs.h"
 #include "pcsx2disassemble.h"
+#include "trace.h"
+#include "snapshotstore.h"
 #include "gif.h"
+#include "gstexture.h"
+#include "branches.h"
+#include "callstack.h"
+#include "profile.h"
+#include "threadpool.h"
+#include "coverage.h"
+#include "session.h"
+#include "sessioncontainer.h"
+#include "vif.h"
+#include "logindex.h"
+#include "framebuffer.h"
+#include "comments.h"
+#include "valuesearch.h"
 #include "fonts.h"
 
-static const int INSN_PAIR_SIZE = 8;
 static int row_size_imgui = 4;
 static int row_size = 16;
 static int tick_rate = 1;
@@ -47,24 +70,12 @@ static bool show_as_hex = false;
 static float font_size = 16.0f;
 static bool use_default_font = false;
 static bool require_font_update = false;
+static int snapshot_budget_mb = (int) (SnapshotStore::DEFAULT_BUDGET / (1024 * 1024));
 static ImFontConfig default_font_cfg = ImFontConfig();
 
-struct Snapshot
-{
-	VURegs registers = {};
-	u8 memory[VU1_MEMSIZE];
-	u8 program[VU1_PROGSIZE];
-	u32 read_addr = 0;
-	u32 read_size = 0;
-	u32 write_addr = 0;
-	u32 write_size = 0;
-};
-
 struct Instruction
 {
 	bool is_executed = false;
-	std::map<u32, std::size_t> branch_to_times;
-	std::map<u32, std::size_t> branch_from_times;
 	std::size_t times_executed = 0;
 	std::string disassembly;
 };
@@ -72,15 +83,34 @@ struct Instruction
 struct AppState
 {
 	std::size_t current_snapshot = 0;
-	std::vector<Snapshot> snapshots;
+	std::unique_ptr<SnapshotStore> snapshots;
 	bool snapshots_scroll_to = false;
 	bool disassembly_scroll_to = false;
 	std::vector<Instruction> instructions;
+	BranchStatistics branches;
+	CallTree call_tree;
+	ProgramProfile profile;
+	ProfileReport profile_report;
+	u64 program_hash = 0;
+	std::shared_ptr<CoverageJob> coverage;
+	std::unique_ptr<Session> session;
+	std::unique_ptr<ThreadPool> session_pool; // Must be destroyed before the session.
+	std::unordered_map<u64, std::vector<std::string>> disassembly_cache;
+	std::unique_ptr<LogIndex> log;
+	std::future<std::unique_ptr<LogIndex>> log_loading;
+	std::future<ValueSearchResult> value_search; // Uses snapshots.
+	s32 memory_scroll_to = -1;
+	std::string framebuffer_directory;
+	std::vector<FramebufferDump> framebuffer_dumps;
+	std::unique_ptr<FramebufferCache> framebuffer_cache;
 	std::string disassembly_highlight;
 	std::string trace_file_path;
-	bool comments_loaded = false;
-	std::string comment_file_path;
-	std::array<std::string, VU1_PROGSIZE / INSN_PAIR_SIZE> comments;
+	CommentDatabase comments;
+	// Used while following a trace that's still being written.
+	double last_poll_time = 0;
+	double statistics_time = 0;
+	bool statistics_stale = false;
+	bool stay_at_end = true;
 };
 
 struct MessageBoxState
@@ -94,20 +124,56 @@ static MessageBoxState comment_box;
 static MessageBoxState save_to_file;
 static MessageBoxState find_bytes;
 static MessageBoxState go_to_box;
+static MessageBoxState annotate_box;
+static MessageBoxState export_texture_box;
+static MessageBoxState export_stacks_box;
+static MessageBoxState coverage_box;
+static MessageBoxState open_session_box;
+
+struct VifUnpackSource
+{
+	std::string file_path; // e.g. an EE memory dump.
+	std::string address_hex;
+	std::string size_hex;
+	bool is_command_stream = true;
+	int format = 0xc; // V4-32.
+	bool usn = false;
+	int cl = 1;
+	int wl = 1;
+};
+
+static VifUnpackSource vif_unpack_source;
 
 void update_gui(AppState &app);
 void snapshots_window(AppState &app);
 void registers_window(AppState &app);
+ImVec4 memory_type_colour(MemoryType type);
 void memory_window(AppState &app);
 void disassembly_window(AppState &app);
 void gs_packet_window(AppState &app);
+void gs_image_view(AppState &app, const GsPacket &packet, const GsPrimitive &prim);
+void call_stack_window(AppState &app);
+void profile_window(AppState &app);
+void session_window(AppState &app);
+void log_window(AppState &app);
+void vif_unpack_window(AppState &app);
+void value_search_window(AppState &app);
+void framebuffer_window(AppState &app);
 bool walk_until_pc_equal(AppState &app, u32 target_pc, int step); // Add step to the current snapshot index until pc == target_pc, otherwise do nothing.
 void walk_until_mem_access(AppState &app, u32 address); // Add 1 to the current snapshot index until a snapshot reads from/writes to address, otherwise do nothing.
-void parse_trace(AppState &app, std::string trace_file_path);
+bool parse_trace(AppState &app, std::string trace_file_path);
+void follow_trace(AppState &app, const std::string &trace_file_path);
+void poll_trace(AppState &app);
+void set_trace(AppState &app, const std::string &trace_file_path, std::unique_ptr<SnapshotStore> snapshots);
+void update_statistics(AppState &app);
+void open_session_browser(AppState &app, const std::string &directory);
+void load_log_index(AppState &app, const std::string &directory);
+void load_coverage(AppState &app, const std::string &directory);
+const ProgramCoverage *current_coverage(const AppState &app);
+int run_profile(int argc, char **argv);
+int run_frames(int argc, char **argv);
 void parse_comment_file(AppState &app, std::string comment_file_path);
-void save_comment_file(AppState &app);
-std::string disassemble(u8 *program, u32 address);
-bool is_xgkick(u32 lower);
+std::string disassemble(const u8 *program, u32 address);
 void init_gui(GLFWwindow **window);
 void update_font();
 void main_menu_bar();
@@ -122,8 +188,25 @@ size_t from_hex(const std::string& in);
 
 int main(int argc, char **argv)
 {
+	if(argc >= 2 && strcmp(argv[1], "--profile") == 0) {
+		return run_profile(argc, argv);
+	}
+	if(argc >= 2 && strcmp(argv[1], "--frames") == 0) {
+		return run_frames(argc, argv);
+	}
+	
+	bool follow = argc >= 2 && strcmp(argv[1], "--follow") == 0;
+	if(follow) {
+		argc--;
+		argv++;
+	}
+	
 	if(argc != 2 && argc != 3) {
 		fprintf(stderr, "usage: %s <trace file> [comment file]\n", argv[0]);
+		fprintf(stderr, "       %s <vutrace_output directory or session container> [comment file]\n", argv[0]);
+		fprintf(stderr, "       %s --follow <trace file that's still being written> [comment file]\n", argv[0]);
+		fprintf(stderr, "       %s --profile [--csv <output file>] [--top <n>] <trace files...>\n", argv[0]);
+		fprintf(stderr, "       %s --frames <directory> [--trace <n>] (--contact-sheet <output.png> [--columns <n>] [--scale <n>] | --video <output.y4m or ->) [--fps <n>]\n", argv[0]);
 		return 1;
 	}
 	
@@ -132,7 +215,20 @@ int main(int argc, char **argv)
 	init_gui(&window);
 	
 	AppState app;
-	parse_trace(app, argv[1]);
+	if(follow) {
+		follow_trace(app, argv[1]);
+	} else if(std::filesystem::is_directory(argv[1]) || is_session_container(argv[1])) {
+		open_session_browser(app, argv[1]);
+		if(app.session->traces.empty()) {
+			fprintf(stderr, "Error: No traces found in %s.\n", argv[1]);
+			return 1;
+		}
+		if(!parse_trace(app, app.session->traces.front()->path)) {
+			return 1;
+		}
+	} else if(!parse_trace(app, argv[1])) {
+		return 1;
+	}
 	
 	if(argc == 3) {
 		parse_comment_file(app, argv[2]);
@@ -151,19 +247,22 @@ int main(int argc, char **argv)
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 		
-		if(g.InputTextState.ID == 0 || g.InputTextState.ID != ImGui::GetActiveID()) {
+		poll_trace(app);
+		
+		bool has_snapshots = !app.snapshots->empty();
+		if(has_snapshots && (g.InputTextState.ID == 0 || g.InputTextState.ID != ImGui::GetActiveID())) {
 			if(ImGui::IsKeyPressed(ImGuiKey_W) && app.current_snapshot > 0) {
 				app.current_snapshot--;
 				app.snapshots_scroll_to = true;
 				app.disassembly_scroll_to = true;
 			}
-			if(ImGui::IsKeyPressed(ImGuiKey_S) && app.current_snapshot < app.snapshots.size() - 1) {
+			if(ImGui::IsKeyPressed(ImGuiKey_S) && app.current_snapshot < app.snapshots->size() - 1) {
 				app.current_snapshot++;
 				app.snapshots_scroll_to = true;
 				app.disassembly_scroll_to = true;
 			}
 			
-			u32 pc = app.snapshots[app.current_snapshot].registers.VI[TPC].UL;
+			u32 pc = app.snapshots->pc(app.current_snapshot);
 			if(ImGui::IsKeyPressed(ImGuiKey_A)) {
 				walk_until_pc_equal(app, pc, -1);
 			}
@@ -197,6 +296,10 @@ int main(int argc, char **argv)
 		glfwSwapBuffers(window);
 	}
 		
+	if(!app.comments.flush()) {
+		fprintf(stderr, "Error: %s\n", app.comments.error.c_str());
+	}
+	
 	glfwDestroyWindow(window);
 
 	ImGui_ImplOpenGL3_Shutdown();
@@ -207,11 +310,50 @@ int main(int argc, char **argv)
 
 void update_gui(AppState &app)
 {
+	std::size_t snapshot_budget = (std::size_t) snapshot_budget_mb * 1024 * 1024;
+	if(app.snapshots->budget() != snapshot_budget) {
+		app.snapshots->set_budget(snapshot_budget);
+	}
+	app.comments.update();
+	
+	if(app.snapshots->empty()) {
+		// Following a trace that nothing has been written to yet.
+		if(ImGui::Begin("Snapshots")) {
+			ImGui::TextWrapped("Waiting for snapshots to be written to %s...", app.trace_file_path.c_str());
+			if(!app.snapshots->error.empty()) {
+				ImGui::TextWrapped("%s", app.snapshots->error.c_str());
+			}
+		}
+		ImGui::End();
+		return;
+	}
+	
 	if(ImGui::Begin("Snapshots"))   snapshots_window(app);   ImGui::End();
 	if(ImGui::Begin("Registers"))   registers_window(app);   ImGui::End();
 	if(ImGui::Begin("Memory"))      memory_window(app);      ImGui::End();
 	if(ImGui::Begin("Disassembly")) disassembly_window(app); ImGui::End();
 	if(ImGui::Begin("GS Packet"))   gs_packet_window(app);   ImGui::End();
+	if(ImGui::Begin("Call Stack"))  call_stack_window(app);  ImGui::End();
+	if(ImGui::Begin("Profile"))     profile_window(app);     ImGui::End();
+	if(ImGui::Begin("Log"))         log_window(app);         ImGui::End();
+	if(ImGui::Begin("VIF Unpack"))  vif_unpack_window(app);  ImGui::End();
+	if(ImGui::Begin("Value Search")) value_search_window(app); ImGui::End();
+	if(ImGui::Begin("Framebuffer")) framebuffer_window(app); ImGui::End();
+	if(app.session) {
+		if(ImGui::Begin("Session")) session_window(app);     ImGui::End();
+	}
+	
+	if(prompt(export_stacks_box, "Export Folded Stacks")) {
+		if(!write_folded_stacks(export_stacks_box.text, app.call_tree)) {
+			fprintf(stderr, "Failed to open %s for writing.\n", export_stacks_box.text.c_str());
+		}
+	}
+	if(prompt(coverage_box, "Load Coverage (Trace Directory or Container)")) {
+		load_coverage(app, coverage_box.text);
+	}
+	if(prompt(open_session_box, "Open Session (Trace Directory or Container)")) {
+		open_session_browser(app, open_session_box.text);
+	}
 }
 
 void snapshots_window(AppState &app)
@@ -220,7 +362,7 @@ void snapshots_window(AppState &app)
 	ImGui::AlignTextToFramePadding();
 	ImGui::Text("Iter:");
 	ImGui::SameLine();
-	u32 pc = app.snapshots[app.current_snapshot].registers.VI[TPC].UL;
+	u32 pc = app.snapshots->pc(app.current_snapshot);
 	if(ImGui::Button(" < ")) {
 		walk_until_pc_equal(app, pc, -1);
 	}
@@ -229,78 +371,131 @@ void snapshots_window(AppState &app)
 		walk_until_pc_equal(app, pc, 1);
 	}
 	
-	std::function<bool(Snapshot &)> filter;
+	ImGui::SameLine();
+	ImGui::Text("%.1f MB in memory, %.1f MB spilled",
+		app.snapshots->resident_bytes() / (1024.0 * 1024.0), app.snapshots->spilled_bytes() / (1024.0 * 1024.0));
+	if(app.snapshots->following()) {
+		ImGui::Text("Following, %zu snapshots so far.", app.snapshots->size());
+		ImGui::SameLine();
+		ImGui::Checkbox("Stay At End", &app.stay_at_end);
+		ImGui::SetItemTooltip("Select new snapshots as they're read in, if the last one is selected.");
+	}
+	if(!app.snapshots->error.empty()) {
+		ImGui::TextWrapped("%s", app.snapshots->error.c_str());
+	}
+	if(const char *spill_error = app.snapshots->spill_error()) {
+		ImGui::TextWrapped("%s", spill_error);
+	}
+	
+	// The list is drawn from the arrays kept in memory for every snapshot,
+	// so the snapshots themselves don't need to be decoded, and only the
+	// visible rows are drawn.
+	enum {SNAPSHOTS_ALL, SNAPSHOTS_XGKICK, SNAPSHOTS_HIGHLIGHTED} tab = SNAPSHOTS_ALL;
 	
 	if(ImGui::BeginTabBar("tabs")) {
 		if(ImGui::BeginTabItem("All")) {
-			filter = [&](Snapshot &snapshot) { return true; };
+			tab = SNAPSHOTS_ALL;
 			ImGui::EndTabItem();
 		}
 		if(ImGui::BeginTabItem("XGKICK")) {
-			filter = [&](Snapshot &snapshot) {
-				u32 pc = snapshot.registers.VI[TPC].UL;
-				u32 lower = *(u32*) &snapshot.program[pc];
-				return is_xgkick(lower);
-			};
+			tab = SNAPSHOTS_XGKICK;
 			ImGui::EndTabItem();
 		}
 		if(ImGui::BeginTabItem("Highlighted")) {
-			filter = [&](Snapshot &snapshot) {
-				std::string disassembly = disassemble(&snapshot.program[snapshot.registers.VI[TPC].SL], snapshot.registers.VI[TPC].SL);
-				bool is_highlighted =
-					app.disassembly_highlight.size() > 0 &&
-					disassembly.find(app.disassembly_highlight) != std::string::npos;
-				return is_highlighted;
-			};
+			tab = SNAPSHOTS_HIGHLIGHTED;
 			ImGui::EndTabItem();
 		}
 		ImGui::EndTabBar();
 	}
 	
-	ImVec2 size = ImGui::GetContentRegionAvail();
-	ImGui::PushItemWidth(-1);
-	if(ImGui::BeginListBox("##snapshots", size)) {
-		for(std::size_t i = 0; i < app.snapshots.size(); i++) {
-			Snapshot& snap = app.snapshots[i];
-			Snapshot next_snap;
-			if(i < app.snapshots.size() - 1) {
-				next_snap = app.snapshots[i + 1];
-			}
-			bool is_selected = i == app.current_snapshot;
-			
-			if(!filter(snap)) {
-				continue;
+	const SnapshotStore &store = *app.snapshots;
+	auto is_highlighted = [&](std::size_t i) {
+		if(app.disassembly_highlight.empty()) {
+			return false;
+		}
+		std::string disassembly = disassemble(store.instruction(i), store.pc(i));
+		return disassembly.find(app.disassembly_highlight) != std::string::npos;
+	};
+	
+	static std::vector<u32> filtered;
+	filtered.clear();
+	if(tab == SNAPSHOTS_XGKICK) {
+		const std::vector<u8> &flags = store.flags();
+		for(std::size_t i = 0; i < flags.size(); i++) {
+			if(flags[i] & SNAPSHOT_XGKICK) {
+				filtered.push_back((u32) i);
 			}
-			
-			std::stringstream ss;
-			ss << i;
-			if(next_snap.read_size > 0) {
-				ss << " READ 0x" << std::hex << next_snap.read_addr;
-			} else if(next_snap.write_size > 0) {
-				ss << " WRITE 0x" << std::hex << next_snap.write_addr;
+		}
+	} else if(tab == SNAPSHOTS_HIGHLIGHTED && !app.disassembly_highlight.empty()) {
+		// Only disassemble each instruction again if the program changed.
+		const std::size_t slot_count = VU1_PROGSIZE / INSN_PAIR_SIZE;
+		std::vector<u64> slot_instructions(slot_count);
+		std::vector<s8> slot_highlighted(slot_count, -1);
+		const std::vector<u32> &pcs = store.pcs();
+		const std::vector<u64> &instructions = store.instructions();
+		for(std::size_t i = 0; i < pcs.size(); i++) {
+			std::size_t slot = (pcs[i] / INSN_PAIR_SIZE) % slot_count;
+			if(slot_highlighted[slot] < 0 || slot_instructions[slot] != instructions[i]) {
+				slot_instructions[slot] = instructions[i];
+				slot_highlighted[slot] = is_highlighted(i);
 			}
-			
-			u32 pc = snap.registers.VI[TPC].UL;
-			std::string disassembly = disassemble(&snap.program[pc], pc);
-			
-			bool is_highlighted =
-			app.disassembly_highlight.size() > 0 &&
-				disassembly.find(app.disassembly_highlight) != std::string::npos;
-		
-			if(is_highlighted) {
-				ImGui::PushStyleColor(ImGuiCol_Text, ImColor(255, 255, 0).Value);
+			if(slot_highlighted[slot]) {
+				filtered.push_back((u32) i);
 			}
-			if(ImGui::Selectable(ss.str().c_str(), is_selected)) {
-				app.current_snapshot = i;
-				app.disassembly_scroll_to = true;
+		}
+	}
+	std::size_t row_count = tab == SNAPSHOTS_ALL ? store.size() : filtered.size();
+	
+	ImVec2 size = ImGui::GetContentRegionAvail();
+	ImGui::PushItemWidth(-1);
+	if(ImGui::BeginListBox("##snapshots", size)) {
+		ImGuiListClipper clipper;
+		clipper.Begin((int) row_count);
+		std::size_t selected_row = SIZE_MAX;
+		if(app.snapshots_scroll_to) {
+			if(tab == SNAPSHOTS_ALL) {
+				selected_row = app.current_snapshot;
+			} else {
+				auto iter = std::lower_bound(filtered.begin(), filtered.end(), app.current_snapshot);
+				if(iter != filtered.end() && *iter == app.current_snapshot) {
+					selected_row = iter - filtered.begin();
+				}
 			}
-			if(is_highlighted) {
-				ImGui::PopStyleColor();
+			if(selected_row < row_count) {
+				clipper.IncludeItemByIndex((int) selected_row);
 			}
-			
-			if(app.snapshots_scroll_to && is_selected) {
-				ImGui::SetScrollHereY(0.5);
-				app.snapshots_scroll_to = false;
+		}
+		while(clipper.Step()) {
+			for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				std::size_t i = tab == SNAPSHOTS_ALL ? row : filtered[row];
+				bool is_selected = i == app.current_snapshot;
+				
+				std::stringstream ss;
+				ss << i;
+				if(i + 1 < store.size()) {
+					if(store.read_size(i + 1) > 0) {
+						ss << " READ 0x" << std::hex << store.read_addr(i + 1);
+					} else if(store.write_size(i + 1) > 0) {
+						ss << " WRITE 0x" << std::hex << store.write_addr(i + 1);
+					}
+				}
+				
+				bool highlight = is_highlighted(i);
+				if(highlight) {
+					ImGui::PushStyleColor(ImGuiCol_Text, ImColor(255, 255, 0).Value);
+				}
+				if(ImGui::Selectable(ss.str().c_str(), is_selected)) {
+					app.current_snapshot = i;
+					app.disassembly_scroll_to = true;
+				}
+				if(highlight) {
+					ImGui::PopStyleColor();
+				}
+				
+				if(app.snapshots_scroll_to && (std::size_t) row == selected_row) {
+					ImGui::SetScrollHereY(0.5);
+					app.snapshots_scroll_to = false;
+				}
 			}
 		}
 		ImGui::EndListBox();
@@ -309,8 +504,8 @@ void snapshots_window(AppState &app)
 }
 
 void registers_window(AppState &app) {
-	Snapshot &current = app.snapshots[app.current_snapshot];
-	VURegs &regs = current.registers;
+	std::shared_ptr<const Snapshot> current = app.snapshots->get(app.current_snapshot);
+	const VURegs &regs = current->registers;
 	
 	static const char *integer_register_names[] = {
 			"vi00", "vi01", "vi02", "vi03",
@@ -357,15 +552,24 @@ void registers_window(AppState &app) {
 	ImGui::EndTable();
 }
 
-void memory_window(AppState &app)
+ImVec4 memory_type_colour(MemoryType type)
 {
-	Snapshot &current = app.snapshots[app.current_snapshot];
-	Snapshot *last;
-	if(app.current_snapshot > 0) {
-		last = &app.snapshots[app.current_snapshot - 1];
-	} else {
-		last = &current;
+	switch(type) {
+		case MEMTYPE_VEC4: return ImVec4(0.6f, 0.8f, 1.f, 1.f);
+		case MEMTYPE_INT32X4: return ImVec4(0.6f, 1.f, 0.6f, 1.f);
+		case MEMTYPE_INT16X8: return ImVec4(1.f, 1.f, 0.6f, 1.f);
+		case MEMTYPE_GIF_TAG: return ImVec4(1.f, 0.6f, 1.f, 1.f);
+		case MEMTYPE_XYZF2: return ImVec4(1.f, 0.8f, 0.5f, 1.f);
+		default: return ImVec4(0.8f, 0.8f, 0.8f, 1.f);
 	}
+}
+
+void memory_window(AppState &app)
+{
+	std::shared_ptr<const Snapshot> last_snapshot = app.snapshots->get(app.current_snapshot > 0 ? app.current_snapshot - 1 : 0);
+	std::shared_ptr<const Snapshot> current_snapshot = app.snapshots->get(app.current_snapshot);
+	const Snapshot &current = *current_snapshot;
+	const Snapshot *last = last_snapshot.get();
 	
 	static MessageBoxState found_bytes;
 	alert(found_bytes, "Found Bytes");
@@ -402,6 +606,23 @@ void memory_window(AppState &app)
 	{
 		scroll_to_address = strtol(go_to_box.text.c_str(), NULL, 16);
 	}
+	if(app.memory_scroll_to >= 0) {
+		scroll_to_address = app.memory_scroll_to;
+		app.memory_scroll_to = -1;
+	}
+	
+	if(prompt(annotate_box, "Annotate Range (begin end type)")) {
+		char type_name[16];
+		u32 begin, end;
+		MemoryType type;
+		if(sscanf(annotate_box.text.c_str(), "%x %x %15s", &begin, &end, type_name) == 3 && parse_memory_type(type, type_name)) {
+			app.comments.annotate(app.program_hash, begin, end, type);
+		} else {
+			fprintf(stderr, "Expected <begin> <end> <type>, where the type is none, vec4, int32x4, int16x8, giftag or xyzf2.\n");
+		}
+	}
+	
+	const MemoryAnnotations *annotations = app.comments.annotations(app.program_hash);
 	
 	ImGui::BeginChild("rows_outer");
 	if(ImGui::BeginChild("rows")) {
@@ -411,55 +632,99 @@ void memory_window(AppState &app)
 		ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
 		ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(18, 4));
 		
-		for(int i = 0; i < VU1_MEMSIZE / row_size; i++) {
-			ImGui::PushID(i);
+		// Only the visible rows are drawn, and the annotations for each of
+		// them are looked up with a binary search.
+		ImGuiListClipper clipper;
+		clipper.Begin(VU1_MEMSIZE / row_size);
+		if(scroll_to_address >= 0 && scroll_to_address < VU1_MEMSIZE) {
+			clipper.IncludeItemByIndex(scroll_to_address / row_size);
+		}
+		while(clipper.Step()) {
+			for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+				ImGui::PushID(i);
 			
-			static ImColor row_header_col = ImColor(1.f, 1.f, 1.f);
-			std::stringstream row_header;
-			row_header << std::hex << std::setfill('0') << std::setw(5) << i * row_size;
-			ImGui::Text("%s", row_header.str().c_str());
-			ImGui::SameLine();
+				static ImColor row_header_col = ImColor(1.f, 1.f, 1.f);
+				std::stringstream row_header;
+				row_header << std::hex << std::setfill('0') << std::setw(5) << i * row_size;
+				ImGui::Text("%s", row_header.str().c_str());
+				ImGui::SameLine();
 			
-			for(int j = 0; j < row_size / 4; j++) {
-				ImGui::PushID(j);
-				const auto draw_byte = [&](int k) {
-					ImGui::PushID(k);
-					
-					u32 address = i * row_size + j * 4 + k;
-					u32 val = current.memory[address];
-					u32 last_val = last->memory[address];
-					std::stringstream hex;
-					if(val < 0x10) hex << "0";
-					hex << std::hex << val;
-					ImVec4 hex_col = ImVec4(0.8f, 0.8f, 0.8f, 1.f);
-					if(val != last_val) {
-						hex_col = ImVec4(1.f, 0.5f, 0.5f, 1.f);
-					}
-					ImGui::PushStyleColor(ImGuiCol_Text, hex_col);
-					if(ImGui::Button(hex.str().c_str())) {
-						walk_until_mem_access(app, address);
+				const MemoryAnnotation *row_begin = nullptr;
+				const MemoryAnnotation *row_end = nullptr;
+				if(annotations) {
+					std::tie(row_begin, row_end) = annotations->find_range(i * row_size, (i + 1) * row_size);
+				}
+				auto type_at = [&](u32 address) {
+					for(const MemoryAnnotation *annotation = row_begin; annotation < row_end; annotation++) {
+						if(address >= annotation->begin && address < annotation->end) {
+							return annotation->type;
+						}
 					}
-					ImGui::SameLine();
-					ImGui::PopStyleColor();
+					return MEMTYPE_NONE;
+				};
+			
+				for(int j = 0; j < row_size / 4; j++) {
+					ImGui::PushID(j);
+					const auto draw_byte = [&](int k) {
+						ImGui::PushID(k);
 					
-					if(address == scroll_to_address) {
-						ImGui::SetScrollHereY(0.5);
-					}
+						u32 address = i * row_size + j * 4 + k;
+						u32 val = current.memory[address];
+						u32 last_val = last->memory[address];
+						std::stringstream hex;
+						if(val < 0x10) hex << "0";
+						hex << std::hex << val;
+						ImVec4 hex_col = memory_type_colour(type_at(address));
+						if(val != last_val) {
+							hex_col = ImVec4(1.f, 0.5f, 0.5f, 1.f);
+						}
+						ImGui::PushStyleColor(ImGuiCol_Text, hex_col);
+						if(ImGui::Button(hex.str().c_str())) {
+							walk_until_mem_access(app, address);
+						}
+						if(ImGui::BeginPopupContextItem("byte_menu")) {
+							for(u8 type = MEMTYPE_NONE; type < MEMTYPE_COUNT; type++) {
+								std::string label = type == MEMTYPE_NONE ? "Remove Annotation" : std::string("Annotate as ") + memory_type_name((MemoryType) type);
+								if(ImGui::MenuItem(label.c_str())) {
+									app.comments.annotate(app.program_hash, address, address + 1, (MemoryType) type);
+								}
+							}
+							ImGui::EndPopup();
+						}
+						ImGui::SameLine();
+						ImGui::PopStyleColor();
 					
-					ImGui::PopID(); // k
-				};
+						if(address == scroll_to_address) {
+							ImGui::SetScrollHereY(0.5);
+						}
+					
+						ImGui::PopID(); // k
+					};
 				
-				ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(6, 4));
-				draw_byte(0);
-				draw_byte(1);
-				draw_byte(2);
-				ImGui::PopStyleVar();
-				draw_byte(3);
-				ImGui::PopID(); // j
-			}
-			ImGui::NewLine();
+					ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(6, 4));
+					draw_byte(0);
+					draw_byte(1);
+					draw_byte(2);
+					ImGui::PopStyleVar();
+					draw_byte(3);
+					ImGui::PopID(); // j
+				}
+			
+				// Show the annotated quadwords that start on this row as their
+				// type.
+				for(u32 address = (i * row_size + 15) & ~15; address < (u32) (i + 1) * row_size; address += 16) {
+					MemoryType type = type_at(address);
+					if(type != MEMTYPE_NONE) {
+						ImGui::PushStyleColor(ImGuiCol_Text, memory_type_colour(type));
+						ImGui::Text("%s %s", memory_type_name(type), format_qword(type, &current.memory[address]).c_str());
+						ImGui::PopStyleColor();
+						ImGui::SameLine();
+					}
+				}
+				ImGui::NewLine();
 			
-			ImGui::PopID(); // i
+				ImGui::PopID(); // i
+			}
 		}
 		
 		ImGui::PopStyleColor();
@@ -472,12 +737,30 @@ void memory_window(AppState &app)
 
 void disassembly_window(AppState &app)
 {
-	Snapshot &current = app.snapshots[app.current_snapshot];
+	std::shared_ptr<const Snapshot> current_snapshot = app.snapshots->get(app.current_snapshot);
+	const Snapshot &current = *current_snapshot;
 	
 	ImGui::PushItemWidth(ImGui::GetWindowWidth() - (ImGui::GetWindowWidth() * .75f));
 	ImGui::InputText("Highlight", &app.disassembly_highlight);
 	ImGui::PopItemWidth();
 	
+	const ProgramCoverage *coverage = current_coverage(app);
+	if(app.coverage) {
+		ImGui::SameLine();
+		if(!app.coverage->finished) {
+			ImGui::Text("Coverage: scanning %ld/%ld traces...",
+				app.coverage->traces_done.load(), app.coverage->trace_count.load());
+		} else if(coverage) {
+			ImGui::Text("Coverage: %ld traces ran this program", coverage->trace_paths.size());
+		} else {
+			ImGui::Text("Coverage: no other traces ran this program");
+		}
+	}
+	if(!app.comments.error.empty()) {
+		ImGui::SameLine();
+		ImGui::Text("Comments: %s", app.comments.error.c_str());
+	}
+	
 	if(prompt(comment_box, "Load Comment File")) {
 		parse_comment_file(app, comment_box.text);
 	}
@@ -485,10 +768,11 @@ void disassembly_window(AppState &app)
 		std::ofstream disassembly_out_file(export_box.text);
 		for(std::size_t i = 0; i < VU1_PROGSIZE; i+= INSN_PAIR_SIZE) {
 			disassembly_out_file << disassemble(&current.program[i], i);
-			if(app.comments.at(i / INSN_PAIR_SIZE).size() > 0) {
+			const std::string &comment = app.comments.get(app.program_hash, i);
+			if(comment.size() > 0) {
 				disassembly_out_file << "; ";
 			}
-			disassembly_out_file << app.comments.at(i / INSN_PAIR_SIZE);
+			disassembly_out_file << comment;
 			disassembly_out_file << "\n";
 		}
 	}
@@ -503,20 +787,27 @@ void disassembly_window(AppState &app)
 		ImGui::TableSetColumnIndex(0);
 		ImGui::PushID(i);
 
-		Instruction instruction = app.instructions[i / INSN_PAIR_SIZE];
+		const Instruction &instruction = app.instructions[i / INSN_PAIR_SIZE];
 		bool is_pc = current.registers.VI[TPC].UL == i;
 		ImGuiSelectableFlags flags = instruction.is_executed ?
 									 ImGuiSelectableFlags_None :
 									 ImGuiSelectableFlags_Disabled;
+		// Instructions that only ran in other traces are shown in blue.
+		bool is_covered_elsewhere = !instruction.is_executed &&
+				coverage && coverage->times_executed[i / INSN_PAIR_SIZE] > 0;
 
-		std::string disassembly = instruction.disassembly; 
-
-		if(instruction.branch_from_times.size() > 0) {
+		const std::string &disassembly = instruction.disassembly;
+		
+		const BranchStatistics &branches = app.branches;
+		u32 from_begin = branches.target_begin[i / INSN_PAIR_SIZE];
+		u32 from_end = branches.target_begin[i / INSN_PAIR_SIZE + 1];
+		if(from_begin != from_end) {
 			std::stringstream addresses;
-			std::size_t fallthrough_times = app.instructions[i / 8 + 1].times_executed;
-			for(auto addrtimes = instruction.branch_from_times.begin(); addrtimes != instruction.branch_from_times.end(); addrtimes++) {
-				addresses << std::hex << addrtimes->first << " (" << std::dec << addrtimes->second << ") ";
-				fallthrough_times -= addrtimes->second;
+			std::size_t fallthrough_times = instruction.times_executed;
+			for(u32 j = from_begin; j < from_end; j++) {
+				const BranchEdge &edge = branches.edges_by_target[j];
+				addresses << std::hex << edge.from << " (" << std::dec << edge.times << ") ";
+				fallthrough_times -= edge.times;
 			}
 			ImGui::Text("  %s/ ft (%ld) ->", addresses.str().c_str(), fallthrough_times);
 		}
@@ -527,18 +818,34 @@ void disassembly_window(AppState &app)
 
 		if(is_highlighted) {
 			ImGui::PushStyleColor(ImGuiCol_Text, ImColor(255, 255, 0).Value);
+		} else if(is_covered_elsewhere) {
+			ImGui::PushStyleColor(ImGuiCol_TextDisabled, ImColor(96, 160, 255).Value);
 		}
 		bool clicked = ImGui::Selectable(disassembly.c_str(), is_pc, flags);
-		if(is_highlighted) {
+		if(is_highlighted || is_covered_elsewhere) {
 			ImGui::PopStyleColor();
 		}
+		
+		if(coverage) {
+			std::size_t taken = coverage->times_taken[i / INSN_PAIR_SIZE];
+			std::size_t not_taken = coverage->times_not_taken[i / INSN_PAIR_SIZE];
+			if(taken > 0 || not_taken > 0) {
+				const char *note = "";
+				if(taken == 0) note = " (never taken)";
+				if(not_taken == 0) note = " (always taken)";
+				ImGui::Text("  all traces: taken (%ld) / not taken (%ld)%s", taken, not_taken, note);
+			}
+		}
 
-		if(instruction.branch_to_times.size() > 0) {
+		u32 to_begin = branches.source_begin[i / INSN_PAIR_SIZE];
+		u32 to_end = branches.source_begin[i / INSN_PAIR_SIZE + 1];
+		if(to_begin != to_end) {
 			std::stringstream addresses;
 			std::size_t fallthrough_times = instruction.times_executed;
-			for(auto addrtimes = instruction.branch_to_times.begin(); addrtimes != instruction.branch_to_times.end(); addrtimes++) {
-				addresses << std::hex << addrtimes->first << " (" << std::dec << addrtimes->second << ") ";
-				fallthrough_times -= addrtimes->second;
+			for(u32 j = to_begin; j < to_end; j++) {
+				const BranchEdge &edge = branches.edges_by_source[j];
+				addresses << std::hex << edge.to << " (" << std::dec << edge.times << ") ";
+				fallthrough_times -= edge.times;
 			}
 			ImGui::Text("  -> %s/ ft (%ld)", addresses.str().c_str(), fallthrough_times);
 		}
@@ -572,14 +879,14 @@ void disassembly_window(AppState &app)
 			ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0.f, 0.f, 0.f, 0.f));
 		}
 		ImVec2 comment_size(ImGui::GetWindowSize().x - 768.f, 14.f);
-		std::string &comment = app.comments.at(i / INSN_PAIR_SIZE);
+		std::string comment = app.comments.get(app.program_hash, i);
 		ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
 		ImGui::PushItemWidth(-1);
-		ImGuiInputTextFlags comment_flags = app.comments_loaded ?
+		ImGuiInputTextFlags comment_flags = app.comments.loaded() ?
 											ImGuiInputTextFlags_None :
 											ImGuiInputTextFlags_ReadOnly;
 		if(ImGui::InputText("##comment", &comment, comment_flags)) {
-			save_comment_file(app);
+			app.comments.set(app.program_hash, i, comment);
 		}
 		ImGui::PopItemWidth();
 		ImGui::PopStyleVar();
@@ -601,7 +908,8 @@ void gs_packet_window(AppState &app)
 	static std::string address_hex;
 	ImGui::InputText("Address", &address_hex);
 	
-	Snapshot &snap = app.snapshots[app.current_snapshot];
+	std::shared_ptr<const Snapshot> snapshot = app.snapshots->get(app.current_snapshot);
+	const Snapshot &snap = *snapshot;
 	
 	std::size_t address;
 	if(address_hex.size() == 0) {
@@ -638,6 +946,9 @@ void gs_packet_window(AppState &app)
 	ImGui::EndChild();
 	ImGui::NextColumn();
 	
+	if(!packet.error.empty()) {
+		ImGui::TextWrapped("%s", packet.error.c_str());
+	}
 	if(packet.primitives.size() < 1) {
 		return;
 	}
@@ -664,7 +975,15 @@ void gs_packet_window(AppState &app)
 	}
 	ImGui::NewLine();
 	
+	if(tag.flag == GIFFLAG_IMAGE) {
+		gs_image_view(app, packet, prim);
+		return;
+	}
+	
 	ImGui::BeginChild("data");
+	for(const GsRegListData& item : prim.reglist_data) {
+		ImGui::Text("%x: %lx", item.source_address, item.value);
+	}
 	for(const GsPackedData& item : prim.packed_data) {
 		ImGui::Text("%x: %6s", item.source_address, gs_register_name(item.reg));
 		ImGui::SameLine();
@@ -695,16 +1014,218 @@ void gs_packet_window(AppState &app)
 	ImGui::EndChild();
 }
 
-bool walk_until_pc_equal(AppState &app, u32 target_pc, int step)
+void gs_image_view(AppState &app, const GsPacket &packet, const GsPrimitive &prim)
 {
-	std::size_t snapshot = app.current_snapshot;
-	do {
-		if(-step > (int) snapshot || snapshot + step >= app.snapshots.size()) {
-			return false;
+	GsImageInfo info = read_image_info(prim.image.registers);
+	ImGui::TextWrapped("DBP=%x, DBW=%x, DPSM=%s, DSAX=%d, DSAY=%d, RRW=%d, RRH=%d",
+		info.dbp, info.dbw, gs_pixel_format_name(info.dpsm), info.dsax, info.dsay, info.rrw, info.rrh);
+	
+	static GLuint texture_id = 0;
+	static GsTexture texture;
+	static bool decoded = false;
+	static std::size_t decoded_snapshot = SIZE_MAX;
+	static int decoded_address = -1;
+	if(decoded_snapshot != app.current_snapshot || decoded_address != prim.image.source_address) {
+		decoded = decode_gs_image(texture, packet, prim);
+		decoded_snapshot = app.current_snapshot;
+		decoded_address = prim.image.source_address;
+		if(decoded) {
+			if(texture_id == 0) {
+				glGenTextures(1, &texture_id);
+			}
+			glBindTexture(GL_TEXTURE_2D, texture_id);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels.data());
+		}
+	}
+	
+	if(!decoded) {
+		ImGui::Text("Cannot decode image data.");
+		return;
+	}
+	
+	if(prompt(export_texture_box, "Export Texture (.png or .ppm)")) {
+		const std::string &path = export_texture_box.text;
+		bool is_ppm = path.size() >= 4 && path.substr(path.size() - 4) == ".ppm";
+		if(!(is_ppm ? write_ppm(path, texture) : write_png(path, texture))) {
+			fprintf(stderr, "Failed to open %s for writing.\n", path.c_str());
+		}
+	}
+	if(ImGui::Button("Export")) {
+		export_texture_box.is_open = true;
+	}
+	
+	static int zoom = 2;
+	ImGui::SameLine();
+	ImGui::SliderInt("Zoom", &zoom, 1, 8);
+	
+	ImGui::BeginChild("image", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+	ImGui::Image((ImTextureID) (intptr_t) texture_id, ImVec2(texture.width * zoom, texture.height * zoom));
+	ImGui::EndChild();
+}
+
+void call_stack_window(AppState &app)
+{
+	const CallTree &tree = app.call_tree;
+	
+	ImGui::BeginChild("stack", ImVec2(0, ImGui::GetContentRegionAvail().y * 0.4f));
+	std::vector<u32> stack = call_stack_at(tree, app.current_snapshot);
+	for(u32 frame : stack) {
+		const CallNode &node = tree.nodes[frame];
+		ImGui::PushID(frame);
+		std::string label = subroutine_name(node, frame == 0);
+		if(frame != 0) {
+			label += " (called from " + to_hex(node.call_site) + ")";
+		}
+		if(ImGui::Selectable(label.c_str(), frame == stack.front()) && frame != 0) {
+			// Walk back to the call site.
+			std::size_t snapshot = app.current_snapshot;
+			while(snapshot > 0 && tree.snapshot_nodes[snapshot] != node.parent) {
+				snapshot--;
+			}
+			app.current_snapshot = snapshot;
+			app.snapshots_scroll_to = true;
+			app.disassembly_scroll_to = true;
+		}
+		ImGui::PopID();
+	}
+	ImGui::EndChild();
+	
+	ImGui::BeginTable("subroutines", 4, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_BordersInnerV |
+	                                    ImGuiTableFlags_BordersInnerH | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY);
+	ImGui::TableSetupColumn("Subroutine");
+	ImGui::TableSetupColumn("Calls");
+	ImGui::TableSetupColumn("Inclusive");
+	ImGui::TableSetupColumn("Exclusive");
+	ImGui::TableHeadersRow();
+	for(const SubroutineStats &stats : tree.subroutines) {
+		ImGui::TableNextRow();
+		ImGui::TableSetColumnIndex(0);
+		ImGui::Text("%04x", stats.entry_pc);
+		ImGui::TableSetColumnIndex(1);
+		ImGui::Text("%zu", stats.calls);
+		ImGui::TableSetColumnIndex(2);
+		ImGui::Text("%zu", stats.inclusive);
+		ImGui::TableSetColumnIndex(3);
+		ImGui::Text("%zu", stats.exclusive);
+	}
+	ImGui::EndTable();
+}
+
+void profile_window(AppState &app)
+{
+	const ProgramProfile &profile = app.profile;
+	ImGui::Text("%zu instructions, ~%zu cycles", profile.snapshot_count, profile.total_cycles);
+	
+	auto entry_table = [&](const char *id, const std::vector<ProfileEntry> &entries) {
+		ImGui::BeginTable(id, 4, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_BordersInnerV |
+		                         ImGuiTableFlags_BordersInnerH | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY);
+		ImGui::TableSetupColumn("Address");
+		ImGui::TableSetupColumn("Count");
+		ImGui::TableSetupColumn("Cycles");
+		ImGui::TableSetupColumn("%");
+		ImGui::TableHeadersRow();
+		for(std::size_t i = 0; i < entries.size(); i++) {
+			const ProfileEntry &entry = entries[i];
+			ImGui::TableNextRow();
+			ImGui::TableSetColumnIndex(0);
+			ImGui::PushID(i);
+			char label[32];
+			if(entry.end - entry.begin == INSN_PAIR_SIZE) {
+				snprintf(label, sizeof(label), "%04x", entry.begin);
+			} else {
+				snprintf(label, sizeof(label), "%04x-%04x", entry.begin, entry.end);
+			}
+			if(ImGui::Selectable(label, false, ImGuiSelectableFlags_SpanAllColumns)) {
+				if(!walk_until_pc_equal(app, entry.begin, 1)) {
+					walk_until_pc_equal(app, entry.begin, -1);
+				}
+				app.disassembly_scroll_to = true;
+			}
+			ImGui::PopID();
+			ImGui::TableSetColumnIndex(1);
+			ImGui::Text("%zu", entry.count);
+			ImGui::TableSetColumnIndex(2);
+			ImGui::Text("%zu", entry.cycles);
+			ImGui::TableSetColumnIndex(3);
+			ImGui::Text("%.1f", profile.total_cycles > 0 ? (entry.cycles * 100.0) / profile.total_cycles : 0.0);
 		}
-		snapshot += step;
-	} while(app.snapshots[snapshot].registers.VI[TPC].UL != target_pc);
-	app.current_snapshot = snapshot;
+		ImGui::EndTable();
+	};
+	
+	if(ImGui::BeginTabBar("profile_tabs")) {
+		if(ImGui::BeginTabItem("Instructions")) {
+			entry_table("instructions", app.profile_report.instructions);
+			ImGui::EndTabItem();
+		}
+		if(ImGui::BeginTabItem("Blocks")) {
+			entry_table("blocks", app.profile_report.blocks);
+			ImGui::EndTabItem();
+		}
+		if(ImGui::BeginTabItem("Loops")) {
+			entry_table("loops", app.profile_report.loops);
+			ImGui::EndTabItem();
+		}
+		ImGui::EndTabBar();
+	}
+}
+
+void session_window(AppState &app)
+{
+	static MessageBoxState load_failed_box;
+	alert(load_failed_box, "Load Failed");
+	
+	Session &session = *app.session;
+	ImGui::Text("%zu/%zu traces scanned", session.traces_scanned.load(), session.traces.size());
+	
+	ImGui::BeginTable("traces", 6, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_BordersInnerV |
+	                               ImGuiTableFlags_BordersInnerH | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY);
+	ImGui::TableSetupColumn("Trace");
+	ImGui::TableSetupColumn("Instructions");
+	ImGui::TableSetupColumn("Program");
+	ImGui::TableSetupColumn("Entry");
+	ImGui::TableSetupColumn("Kicks");
+	ImGui::TableSetupColumn("Size");
+	ImGui::TableHeadersRow();
+	for(std::size_t i = 0; i < session.traces.size(); i++) {
+		const TraceInfo &info = *session.traces[i];
+		ImGui::TableNextRow();
+		ImGui::TableSetColumnIndex(0);
+		ImGui::PushID(i);
+		bool is_loaded = info.path == app.trace_file_path;
+		if(ImGui::Selectable(info.name.c_str(), is_loaded, ImGuiSelectableFlags_SpanAllColumns) && !is_loaded) {
+			if(!parse_trace(app, info.path)) {
+				load_failed_box.is_open = true;
+				load_failed_box.text = "Failed to load " + info.name + ", see the console for details.";
+			}
+		}
+		ImGui::PopID();
+		if(info.scanned) {
+			ImGui::TableSetColumnIndex(1);
+			if(info.error.empty()) {
+				ImGui::Text("%zu", info.snapshot_count);
+				ImGui::TableSetColumnIndex(2);
+				ImGui::Text("%016llx", (unsigned long long) info.program_hash);
+				ImGui::TableSetColumnIndex(3);
+				ImGui::Text("%04x", info.entry_pc);
+				ImGui::TableSetColumnIndex(4);
+				ImGui::Text("%zu", info.kick_count);
+			} else {
+				ImGui::TextColored(ImColor(255, 96, 96).Value, "%s", info.error.c_str());
+			}
+		}
+		ImGui::TableSetColumnIndex(5);
+		ImGui::Text("%.1f MB", info.file_size / (1024.0 * 1024.0));
+	}
+	ImGui::EndTable();
+}
+
+bool walk_until_pc_equal(AppState &app, u32 target_pc, int step)
+{
+	if(!find_pc(*app.snapshots, app.current_snapshot, target_pc, step)) {
+		return false;
+	}
 	app.snapshots_scroll_to = true;
 	return true;
 }
@@ -712,224 +1233,749 @@ bool walk_until_pc_equal(AppState &app, u32 target_pc, int step)
 void walk_until_mem_access(AppState &app, u32 address)
 {
 	std::size_t snapshot_index = app.current_snapshot;
-	do {
-		snapshot_index = (snapshot_index + 1) % app.snapshots.size();
-		
-		Snapshot &snap = app.snapshots[snapshot_index];
-		if((snap.read_size > 0 && (snap.read_addr / 0x10 == address / 0x10)) ||
-		   (snap.write_size > 0 && (snap.write_addr / 0x10 == address / 0x10))) {
-			if(snapshot_index >= 1) {
-				app.current_snapshot = snapshot_index - 1;
-				app.snapshots_scroll_to = true;
-				app.disassembly_scroll_to = true;
-			}
-			return;
-		}
-	} while(snapshot_index != app.current_snapshot);
+	if(find_memory_access(*app.snapshots, snapshot_index, address) && snapshot_index >= 1) {
+		app.current_snapshot = snapshot_index - 1;
+		app.snapshots_scroll_to = true;
+		app.disassembly_scroll_to = true;
+	}
 }
 
-enum VUTracePacketType {
-	VUTRACE_NULLPACKET = 0,
-	VUTRACE_PUSHSNAPSHOT = 'P',
-	VUTRACE_SETREGISTERS = 'R',
-	VUTRACE_SETMEMORY = 'M',
-	VUTRACE_SETINSTRUCTIONS = 'I',
-	VUTRACE_LOADOP = 'L',
-	VUTRACE_STOREOP = 'S',
-	VUTRACE_PATCHREGISTER = 'r',
-	VUTRACE_PATCHMEMORY = 'm'
-};
+bool parse_trace(AppState &app, std::string trace_file_path)
+{
+	std::unique_ptr<SnapshotStore> snapshots = std::make_unique<SnapshotStore>();
+	snapshots->set_budget((std::size_t) snapshot_budget_mb * 1024 * 1024);
+	std::string error;
+	if(!snapshots->load(trace_file_path, error)) {
+		fprintf(stderr, "Error: %s\n", error.c_str());
+		return false;
+	}
+	set_trace(app, trace_file_path, std::move(snapshots));
+	return true;
+}
 
-void parse_trace(AppState &app, std::string trace_file_path)
+// Open a trace that's still being written e.g. by a capture in progress. The
+// snapshots are read in by poll_trace as they're written.
+void follow_trace(AppState &app, const std::string &trace_file_path)
 {
-	std::vector<Snapshot> snapshots;
+	std::unique_ptr<SnapshotStore> snapshots = std::make_unique<SnapshotStore>();
+	snapshots->set_budget((std::size_t) snapshot_budget_mb * 1024 * 1024);
+	snapshots->follow(trace_file_path);
+	set_trace(app, trace_file_path, std::move(snapshots));
+}
+
+void poll_trace(AppState &app)
+{
+	if(!app.snapshots->following() && !app.statistics_stale) {
+		return;
+	}
+	double now = glfwGetTime();
+	if(now - app.last_poll_time < 0.1) {
+		return;
+	}
+	app.last_poll_time = now;
 	
+	// Only read in so many snapshots per frame so the GUI stays responsive
+	// while catching up with a long trace.
+	bool at_end = app.current_snapshot + 1 >= app.snapshots->size();
+	if(app.snapshots->poll(64 * 1024) > 0) {
+		app.statistics_stale = true;
+		if(app.stay_at_end && at_end) {
+			app.current_snapshot = app.snapshots->size() - 1;
+			app.snapshots_scroll_to = true;
+			app.disassembly_scroll_to = true;
+		}
+	}
+	
+	// The statistics are recomputed from the PCs, which are all in memory,
+	// so this doesn't have to go back to the trace file. It gets slower as
+	// the trace grows though, so it's only done once a second.
+	if(app.statistics_stale && (now - app.statistics_time >= 1.0 || !app.snapshots->following())) {
+		update_statistics(app);
+		app.statistics_time = now;
+		app.statistics_stale = false;
+	}
+}
+
+void set_trace(AppState &app, const std::string &trace_file_path, std::unique_ptr<SnapshotStore> snapshots)
+{
+	// A value search of the old trace has to finish before its snapshots
+	// are freed.
+	if(app.value_search.valid()) {
+		app.value_search.get();
+	}
 	app.trace_file_path = trace_file_path;
+	// The log and framebuffer dumps are kept next to a session container,
+	// but coverage and the session browser can read the container itself.
+	std::string container_path;
+	std::size_t container_trace;
+	bool in_container = split_container_path(trace_file_path, container_path, container_trace);
+	std::string directory = std::filesystem::path(in_container ? container_path : trace_file_path).parent_path().string();
+	coverage_box.text = in_container ? container_path : directory;
+	open_session_box.text = coverage_box.text;
+	load_log_index(app, directory);
+	if(app.framebuffer_directory != directory || !app.framebuffer_cache) {
+		app.framebuffer_directory = directory;
+		app.framebuffer_dumps = list_framebuffer_dumps(directory.empty() ? "." : directory);
+		app.framebuffer_cache = std::make_unique<FramebufferCache>();
+	}
+	app.snapshots = std::move(snapshots);
+	app.current_snapshot = 0;
+	app.snapshots_scroll_to = true;
+	app.disassembly_scroll_to = true;
+	app.statistics_stale = false;
+	app.instructions.resize(VU1_PROGSIZE / INSN_PAIR_SIZE);
+	if(!app.snapshots->empty()) {
+		update_statistics(app);
+	}
+}
+
+void update_statistics(AppState &app)
+{
+	const u8 *program = app.snapshots->program();
+	const std::vector<u32> &pcs = app.snapshots->pcs();
+	app.program_hash = hash_program(program);
+	app.branches = compute_branch_statistics(pcs.data(), pcs.size());
+	app.call_tree = build_call_tree(pcs.data(), pcs.size(), program);
+	app.profile = ProgramProfile();
+	accumulate_profile(app.profile, pcs.data(), pcs.size(), program);
+	app.profile_report = build_profile_report(app.profile);
 	
-	FILE *trace = fopen(trace_file_path.c_str(), "rb");
-	if(trace == nullptr) {
-		fprintf(stderr, "Error: Failed to read trace!\n");
-		exit(1);
+	// Traces in a session usually share a handful of programs, so the
+	// disassembly is only generated the first time each one is seen.
+	std::vector<std::string> &disassembly = app.disassembly_cache[app.program_hash];
+	if(disassembly.empty()) {
+		for(std::size_t i = 0; i < VU1_PROGSIZE; i += INSN_PAIR_SIZE) {
+			disassembly.push_back(disassemble((u8*) &program[i], i));
+		}
 	}
 	
-	app.instructions.resize(VU1_PROGSIZE / INSN_PAIR_SIZE);
+	for(std::size_t i = 0; i < VU1_PROGSIZE; i += INSN_PAIR_SIZE) {
+		Instruction &instruction = app.instructions[i / INSN_PAIR_SIZE];
+		instruction.times_executed = app.branches.times_executed[i / INSN_PAIR_SIZE];
+		instruction.is_executed = instruction.times_executed > 0;
+		instruction.disassembly = disassembly[i / INSN_PAIR_SIZE];
+	}
+}
+
+void log_window(AppState &app)
+{
+	if(app.log_loading.valid()) {
+		if(app.log_loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			ImGui::Text("Indexing log...");
+			return;
+		}
+		app.log = app.log_loading.get();
+	}
+	if(!app.log) {
+		ImGui::Text("No LOG.txt file found next to the trace.");
+		return;
+	}
+	const LogIndex &log = *app.log;
+	if(!log.error.empty()) {
+		ImGui::Text("%s", log.error.c_str());
+		return;
+	}
 	
-	auto check_eof = [](int n) {
-		if(n != 1) {
-			fprintf(stderr, "Error: Unexpected end of file.\n");
-			exit(1);
+	auto entry_list = [&](const char *id, const std::vector<u32> &indices, bool show_trace) {
+		ImGui::BeginChild(id);
+		ImGuiListClipper clipper;
+		clipper.Begin((int) indices.size());
+		while(clipper.Step()) {
+			for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+				const LogEntry &entry = log.entries[indices[i]];
+				std::string_view text = log.text(entry);
+				ImGui::PushID(i);
+				if(!show_trace) {
+					ImGui::TextUnformatted(text.data(), text.data() + text.size());
+				} else {
+					int trace_index = log.trace_index(entry);
+					std::string label = "trace" + std::to_string(trace_index) + ": " + std::string(text);
+					if(ImGui::BeginPopupContextItem("entry_menu")) {
+						if(entry.type == LOG_DMA && ImGui::MenuItem("Unpack Transfer")) {
+							vif_unpack_source.address_hex = to_hex(entry.address);
+							vif_unpack_source.size_hex = to_hex(entry.size);
+							vif_unpack_source.is_command_stream = true;
+						}
+						ImGui::EndPopup();
+					}
+					if(ImGui::Selectable(label.c_str())) {
+						std::string trace_path = session_trace_path(app.trace_file_path, trace_index);
+						if(!trace_path.empty() && trace_path != app.trace_file_path) {
+							parse_trace(app, trace_path);
+						}
+					}
+				}
+				ImGui::PopID();
+			}
 		}
+		ImGui::EndChild();
 	};
 	
-	app.snapshots = {};
+	if(ImGui::BeginTabBar("log_tabs")) {
+		if(ImGui::BeginTabItem("This Trace")) {
+			// The lines leading up to the microprogram call that started
+			// this trace.
+			static std::vector<u32> indices;
+			static const LogIndex *last_log = nullptr;
+			static std::string last_trace;
+			const LogSection *section = log.find_section(parse_trace_index(app.trace_file_path));
+			if(&log != last_log || app.trace_file_path != last_trace) {
+				indices.clear();
+				for(u32 i = section ? section->first_entry : 0; section && i < section->end_entry; i++) {
+					indices.push_back(i);
+				}
+				last_log = &log;
+				last_trace = app.trace_file_path;
+			}
+			ImGui::Text("Entry point %04x, %zu log lines.", app.snapshots->pc(0), indices.size());
+			entry_list("section", indices, false);
+			ImGui::EndTabItem();
+		}
+		if(ImGui::BeginTabItem("Search")) {
+			static std::string address_hex;
+			static int memory = 0;
+			static std::vector<u32> results;
+			ImGui::PushItemWidth(200);
+			bool changed = ImGui::InputText("Address", &address_hex, ImGuiInputTextFlags_EnterReturnsTrue);
+			ImGui::SameLine();
+			changed |= ImGui::RadioButton("EE (DMA)", &memory, 0);
+			ImGui::SameLine();
+			changed |= ImGui::RadioButton("VU (UNPACK)", &memory, 1);
+			ImGui::PopItemWidth();
+			if(changed && !address_hex.empty()) {
+				results = log.search((u32) from_hex(address_hex), memory == 0 ? LOG_DMA : LOG_UNPACK);
+			}
+			ImGui::Text("%zu results.", results.size());
+			entry_list("results", results, true);
+			ImGui::EndTabItem();
+		}
+		ImGui::EndTabBar();
+	}
+}
+
+// Search VU memory in every snapshot for a typed value, and list where each
+// match appears and disappears.
+void value_search_window(AppState &app)
+{
+	static std::string text;
+	static std::string status;
+	static std::string results_path;
+	static ValueSearchResult results;
+	static std::unique_ptr<ThreadPool> pool;
+	static bool annotated_only = false;
+	
+	auto finish_search = [&](ValueSearchResult result) {
+		results = std::move(result);
+		results_path = app.trace_file_path;
+		if(!results.error.empty()) {
+			status = results.error;
+		} else {
+			status = std::to_string(results.matches.size()) + " matches.";
+			if(results.truncated) {
+				status += " Too many matches, stopped early.";
+			}
+		}
+	};
 	
-	char magic[4];
-	u32 version;
-	check_eof(fread(magic, 4, 1, trace));
-	if(memcmp(magic, "VUTR", 4) == 0) {
-		check_eof(fread(&version, 4, 1, trace));
-	} else {
-		version = 1;
-		fseek(trace, 0, SEEK_SET);
+	if(app.value_search.valid()) {
+		if(app.value_search.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			ImGui::Text("Searching...");
+			return;
+		}
+		finish_search(app.value_search.get());
+	}
+	if(results_path != app.trace_file_path) {
+		results = ValueSearchResult();
+		results_path.clear();
+		status.clear();
 	}
 	
-	if(version > 3) {
-		fprintf(stderr, "Format version too new!\n");
-		exit(1);
+	ImGui::PushItemWidth(ImGui::GetWindowWidth() * 0.5f);
+	bool search = ImGui::InputText("Value", &text, ImGuiInputTextFlags_EnterReturnsTrue) && !text.empty();
+	ImGui::PopItemWidth();
+	ImGui::SetItemTooltip("e.g. float 1.5 0.001, vec4 0 0 0 1 0.001, int16 -8 8, int32 0 255, bytes 0a0b0c0d or giftag eop=1 nreg=3");
+	ImGui::SameLine();
+	search |= ImGui::Button("Search");
+	ImGui::SameLine();
+	search |= ImGui::Checkbox("Annotated Memory Only", &annotated_only);
+	ImGui::SetItemTooltip("Only show matches in memory annotated with the type being searched for.");
+	if(search) {
+		ValueSearch value;
+		std::string error;
+		if(!parse_value_search(value, text, error)) {
+			status = error;
+		} else {
+			if(!pool) {
+				pool = std::make_unique<ThreadPool>();
+			}
+			// The annotations are copied, since they can be edited while the
+			// search is running.
+			std::shared_ptr<MemoryAnnotations> annotations;
+			if(annotated_only) {
+				const MemoryAnnotations *program_annotations = app.comments.annotations(app.program_hash);
+				annotations = std::make_shared<MemoryAnnotations>(program_annotations ? *program_annotations : MemoryAnnotations());
+			}
+			auto run = [&store = *app.snapshots, &pool = *pool, value, annotations]() {
+				ValueSearchResult result;
+				search_values(result, store, value, pool, annotations.get());
+				return result;
+			};
+			// Once blocks have been spilled a search has to read them back
+			// in from disk, so it's run in the background like log loading.
+			// A trace that's being followed is still having snapshots added
+			// to it, so that's searched straight away.
+			if(app.snapshots->spilled_bytes() > 0 && !app.snapshots->following()) {
+				app.value_search = std::async(std::launch::async, run);
+				status = "Searching...";
+			} else {
+				finish_search(run());
+			}
+		}
 	}
+	ImGui::Text("%s", status.c_str());
 	
-	Snapshot current;
-	VUTracePacketType packet_type = VUTRACE_NULLPACKET;
-	while(fread(&packet_type, 1, 1, trace) == 1) {
-		switch(packet_type) {
-			case VUTRACE_PUSHSNAPSHOT: {
-				if(current.registers.VI[TPC].UL >= VU1_PROGSIZE || current.registers.VI[TPC].UL % INSN_PAIR_SIZE != 0) {
-					fprintf(stderr, "Bad program counter value.\n");
-					exit(1);
+	ImGui::BeginChild("matches");
+	ImGuiListClipper clipper;
+	clipper.Begin((int) results.matches.size());
+	while(clipper.Step()) {
+		for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+			const ValueMatch &match = results.matches[i];
+			char label[64];
+			snprintf(label, sizeof(label), "%04x: snapshots %u to %u", match.address, match.first_snapshot, match.end_snapshot - 1);
+			ImGui::PushID(i);
+			std::size_t go_to = SIZE_MAX;
+			if(ImGui::Selectable(label)) {
+				go_to = match.first_snapshot;
+			}
+			if(ImGui::BeginPopupContextItem("match_menu")) {
+				if(ImGui::MenuItem("Go To Appearance")) {
+					go_to = match.first_snapshot;
 				}
-				app.snapshots.push_back(current);
-				
-				u32 pc = current.registers.VI[TPC].UL;
-				Instruction &instruction = app.instructions[pc / INSN_PAIR_SIZE];
-				instruction.is_executed = true;
-				
-				if(app.snapshots.size() >= 2) {
-					Snapshot &last = app.snapshots.at(app.snapshots.size() - 2);
-					u32 last_pc = last.registers.VI[TPC].UL;
-					if(last_pc + INSN_PAIR_SIZE != pc) {
-						// A branch has taken place.
-						app.instructions[last_pc / INSN_PAIR_SIZE].branch_to_times[pc]++;
-						instruction.branch_from_times[last_pc]++;
-					}
+				if(match.end_snapshot < app.snapshots->size() && ImGui::MenuItem("Go To Disappearance")) {
+					go_to = match.end_snapshot;
 				}
-				instruction.times_executed++;
-				
-				current.read_addr = 0;
-				current.read_size = 0;
-				current.write_addr = 0;
-				current.write_size = 0;
-				break;
+				ImGui::EndPopup();
 			}
-			case VUTRACE_SETREGISTERS: {
-				if(version == 1) {
-					old_pcsx2_structs_v1::VURegs old_regs = {};
-					check_eof(fread(&old_regs, sizeof(old_regs), 1, trace));
-					memcpy(current.registers.VF, old_regs.VF, sizeof(current.registers.VF));
-					memcpy(current.registers.VI, old_regs.VI, sizeof(current.registers.VI));
-					current.registers.ACC = old_regs.ACC;
-					current.registers.q = old_regs.q;
-					current.registers.p = old_regs.p;
-				} else if(version == 2) {
-					old_pcsx2_structs_v2::VURegs old_regs = {};
-					check_eof(fread(&old_regs, sizeof(old_regs), 1, trace));
-					memcpy(current.registers.VF, old_regs.VF, sizeof(current.registers.VF));
-					memcpy(current.registers.VI, old_regs.VI, sizeof(current.registers.VI));
-					current.registers.ACC = old_regs.ACC;
-					current.registers.q = old_regs.q;
-					current.registers.p = old_regs.p;
-				} else {
-					check_eof(fread(&current.registers.VF, sizeof(current.registers.VF), 1, trace));
-					check_eof(fread(&current.registers.VI, sizeof(current.registers.VI), 1, trace));
-					check_eof(fread(&current.registers.ACC, sizeof(current.registers.ACC), 1, trace));
-					check_eof(fread(&current.registers.q, sizeof(current.registers.q), 1, trace));
-					check_eof(fread(&current.registers.p, sizeof(current.registers.p), 1, trace));
-				}
-				break;
+			if(go_to != SIZE_MAX) {
+				app.current_snapshot = go_to;
+				app.snapshots_scroll_to = true;
+				app.disassembly_scroll_to = true;
+				app.memory_scroll_to = match.address;
 			}
-			case VUTRACE_SETMEMORY: {
-				check_eof(fread(current.memory, VU1_MEMSIZE, 1, trace));
-				break;
+			ImGui::PopID();
+		}
+	}
+	ImGui::EndChild();
+}
+
+// Unpack some data the same way the VIF would and search the trace for the
+// result. The data is either a VIF command stream (e.g. a DMA transfer found
+// in the log) or raw data to be unpacked with a single UNPACK command.
+void vif_unpack_window(AppState &app)
+{
+	static std::vector<VifSearchMatch> matches;
+	static std::vector<VifUnpackRecord> unpacks;
+	static std::string status;
+	
+	VifUnpackSource &source = vif_unpack_source;
+	ImGui::PushItemWidth(ImGui::GetWindowWidth() * 0.3f);
+	ImGui::InputText("EE Memory File", &source.file_path);
+	ImGui::InputText("Address", &source.address_hex);
+	ImGui::SameLine();
+	ImGui::InputText("Size", &source.size_hex);
+	if(ImGui::RadioButton("VIF Command Stream", source.is_command_stream)) {
+		source.is_command_stream = true;
+	}
+	ImGui::SameLine();
+	if(ImGui::RadioButton("Raw Data", !source.is_command_stream)) {
+		source.is_command_stream = false;
+	}
+	if(!source.is_command_stream) {
+		if(ImGui::BeginCombo("Format", vif_unpack_format_name(source.format))) {
+			for(int format = 0; format < 16; format++) {
+				if(vif_unpack_vector_size(format) > 0 && ImGui::Selectable(vif_unpack_format_name(format), format == source.format)) {
+					source.format = format;
+				}
 			}
-			case VUTRACE_SETINSTRUCTIONS: {
-				check_eof(fread(current.program, VU1_PROGSIZE, 1, trace));
-				break;
+			ImGui::EndCombo();
+		}
+		ImGui::Checkbox("Unsigned", &source.usn);
+		ImGui::SameLine();
+		ImGui::InputInt("CL", &source.cl);
+		ImGui::SameLine();
+		ImGui::InputInt("WL", &source.wl);
+	}
+	ImGui::PopItemWidth();
+	
+	if(ImGui::Button("Unpack and Search")) {
+		matches.clear();
+		unpacks.clear();
+		status.clear();
+		
+		std::vector<u8> data;
+		FILE *file = fopen(source.file_path.c_str(), "rb");
+		if(file) {
+			std::size_t size = from_hex(source.size_hex);
+			data.resize(size);
+			if(fseek(file, (long) from_hex(source.address_hex), SEEK_SET) != 0 || fread(data.data(), size, 1, file) != 1) {
+				status = "Failed to read " + source.file_path + ".";
 			}
-			case VUTRACE_LOADOP: {
-				check_eof(fread(&current.read_addr, sizeof(u32), 1, trace));
-				check_eof(fread(&current.read_size, sizeof(u32), 1, trace));
-				break;
+			fclose(file);
+		} else {
+			status = "Failed to open " + source.file_path + ".";
+		}
+		
+		VuMemoryImage image;
+		VifUnpackState state;
+		if(status.empty()) {
+			if(source.is_command_stream) {
+				vif_run(image, state, data.data(), data.size(), unpacks, status);
+			} else {
+				state.cl = std::clamp(source.cl, 1, 255);
+				state.wl = std::clamp(source.wl, 1, 255);
+				u32 vector_size = vif_unpack_vector_size(source.format);
+				u32 num = std::min((u32) (data.size() / vector_size), 256u);
+				if(state.cl < state.wl) {
+					num = std::min(num / state.cl * state.wl, 256u);
+				}
+				u8 command = VIF_UNPACK | source.format;
+				vif_unpack(image, state, command, source.usn ? (1 << 14) : 0, num, data.data(), data.size(), status);
+				unpacks.push_back({0, command, 0, num});
 			}
-			case VUTRACE_STOREOP: {
-				check_eof(fread(&current.write_addr, sizeof(u32), 1, trace));
-				check_eof(fread(&current.write_size, sizeof(u32), 1, trace));
+		}
+		
+		// Only check the keyframes and the snapshots where memory changed,
+		// whether by a store or by a write from outside the VU e.g. VIF. The
+		// blocks are decoded in order so only the deltas are applied.
+		std::vector<u32> addresses, last_addresses;
+		std::vector<u8> block_data;
+		std::vector<u16> changed;
+		std::unique_ptr<Snapshot> snapshot(new Snapshot);
+		for(std::size_t block = 0; status.empty() && block < app.snapshots->block_count(); block++) {
+			if(!app.snapshots->read_block(block, block_data)) {
+				const char *error = app.snapshots->spill_error();
+				status = error ? error : "Failed to read snapshots.";
 				break;
 			}
-			case VUTRACE_PATCHREGISTER: {
-				u8 index = 0;
-				u128 data = {};
-				check_eof(fread(&index, sizeof(u8), 1, trace));
-				check_eof(fread(&data, sizeof(u128), 1, trace));
-				if(index < 32) {
-					memcpy(&current.registers.VF[index], &data, 16);
-				} else if(index < 64) {
-					memcpy(&current.registers.VI[index - 32], &data, 16);
-				} else if(index == 64) {
-					memcpy(&current.registers.ACC, &data, 16);
-				} else if(index == 65) {
-					memcpy(&current.registers.q, &data, 16);
-				} else if(index == 66) {
-					memcpy(&current.registers.p, &data, 16);
-				} else {
-					fprintf(stderr, "Error: 'r' packet has bad register index.\n");
-					exit(1);
+			std::size_t begin = block * SnapshotStore::KEYFRAME_INTERVAL;
+			std::size_t end = std::min(begin + SnapshotStore::KEYFRAME_INTERVAL, app.snapshots->size());
+			std::size_t offset = 0;
+			for(std::size_t i = begin; i < end; i++) {
+				changed.clear();
+				offset = decode_snapshot(*snapshot, block_data.data(), offset, &changed);
+				if(i > begin && changed.empty()) {
+					continue;
 				}
-				break;
-			}
-			case VUTRACE_PATCHMEMORY: {
-				u16 address = 0;
-				u32 data = 0;
-				check_eof(fread(&address, sizeof(u16), 1, trace));
-				check_eof(fread(&data, sizeof(u32), 1, trace));
-				if(address < VU1_MEMSIZE - 4) {
-					memcpy(&current.memory[address], &data, sizeof(data));
-				} else {
-					fprintf(stderr, "Error: 'm' packet has address that is too big.\n");
-					exit(1);
+				addresses.clear();
+				vif_find_image(addresses, image, snapshot->memory);
+				for(u32 address : addresses) {
+					if(std::find(last_addresses.begin(), last_addresses.end(), address) == last_addresses.end()) {
+						matches.push_back({i, address});
+					}
 				}
-				break;
-			}
-			default: {
-				fprintf(stderr, "Error: Invalid packet type 0x%x in trace file at 0x%lx!\n",
-					packet_type, ftell(trace));
-				exit(1);
+				std::swap(addresses, last_addresses);
 			}
 		}
+		if(status.empty()) {
+			status = std::to_string(unpacks.size()) + " unpacks, " + std::to_string(matches.size()) + " matches.";
+		}
 	}
-	if(!feof(trace)) {
-		fprintf(stderr, "Error: Failed to read trace!\n");
-		exit(1);
+	ImGui::TextWrapped("%s", status.c_str());
+	
+	ImGui::Columns(2);
+	ImGui::BeginChild("unpacks");
+	for(const VifUnpackRecord &unpack : unpacks) {
+		ImGui::Text("%04x: UNPACK %s num=%d -> %04x", unpack.source_offset, vif_unpack_format_name(unpack.command), unpack.num, unpack.address);
+	}
+	ImGui::EndChild();
+	ImGui::NextColumn();
+	ImGui::BeginChild("matches");
+	for(std::size_t i = 0; i < matches.size(); i++) {
+		char label[64];
+		snprintf(label, sizeof(label), "Snapshot %ld: %04x", matches[i].snapshot, matches[i].address);
+		if(ImGui::Selectable(label, app.current_snapshot == matches[i].snapshot)) {
+			app.current_snapshot = matches[i].snapshot;
+			app.snapshots_scroll_to = true;
+			app.disassembly_scroll_to = true;
+			app.memory_scroll_to = matches[i].address;
+		}
+	}
+	ImGui::EndChild();
+	ImGui::Columns();
+}
+
+// Show the framebuffer dumps written by GSdx while the trace was recorded.
+// They're decoded in the background the first time they're shown.
+void framebuffer_window(AppState &app)
+{
+	int trace_index = parse_trace_index(app.trace_file_path);
+	auto begin = std::find_if(app.framebuffer_dumps.begin(), app.framebuffer_dumps.end(),
+		[&](const FramebufferDump &dump) { return dump.trace_index == trace_index; });
+	auto end = std::find_if(begin, app.framebuffer_dumps.end(),
+		[&](const FramebufferDump &dump) { return dump.trace_index != trace_index; });
+	int count = (int) (end - begin);
+	if(count == 0) {
+		ImGui::Text("No framebuffer dumps for this trace.");
+		return;
+	}
+	
+	static int buffer = 0;
+	static int zoom = 1;
+	buffer = std::clamp(buffer, 0, count - 1);
+	ImGui::PushItemWidth(ImGui::GetWindowWidth() * 0.3f);
+	ImGui::SliderInt("Draw", &buffer, 0, count - 1);
+	ImGui::SameLine();
+	ImGui::SliderInt("Zoom", &zoom, 1, 4);
+	ImGui::PopItemWidth();
+	
+	const FramebufferDump &dump = *(begin + buffer);
+	// Prefetch the neighbours so stepping through them is smooth.
+	if(buffer + 1 < count) app.framebuffer_cache->get((begin + buffer + 1)->path);
+	std::shared_ptr<const GsTexture> image = app.framebuffer_cache->get(dump.path);
+	if(!image) {
+		ImGui::Text("Decoding %s...", dump.path.c_str());
+		return;
+	}
+	if(image->width == 0) {
+		ImGui::TextWrapped("%s", app.framebuffer_cache->error(dump.path).c_str());
+		return;
 	}
 	
-	fclose(trace);
+	static GLuint texture_id = 0;
+	static const GsTexture *uploaded = nullptr;
+	static std::shared_ptr<const GsTexture> uploaded_image;
+	if(uploaded != image.get()) {
+		if(texture_id == 0) {
+			glGenTextures(1, &texture_id);
+		}
+		glBindTexture(GL_TEXTURE_2D, texture_id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels.data());
+		uploaded = image.get();
+		uploaded_image = image;
+	}
+	
+	ImGui::BeginChild("framebuffer", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+	ImGui::Image((ImTextureID) (intptr_t) texture_id, ImVec2(image->width * zoom, image->height * zoom));
+	ImGui::EndChild();
+}
 
-	for(std::size_t i = 0; i < VU1_PROGSIZE; i += INSN_PAIR_SIZE) {
-		app.instructions[i >> 3].disassembly = disassemble(&current.program[i], i);
-	}    
+// Index the log file written alongside the traces on a background thread.
+// Does nothing if the log for the given directory is already loaded.
+void load_log_index(AppState &app, const std::string &directory)
+{
+	std::string path = find_log_file(directory.empty() ? "." : directory);
+	if(path.empty() || app.log_loading.valid() || (app.log && app.log->path == path)) {
+		return;
+	}
+	app.log_loading = std::async(std::launch::async, [path]() {
+		std::unique_ptr<LogIndex> log = std::make_unique<LogIndex>();
+		if(!log->open(path)) {
+			fprintf(stderr, "Error: %s\n", log->error.c_str());
+		}
+		return log;
+	});
 }
 
-void parse_comment_file(AppState &app, std::string comment_file_path) {
-	app.comment_file_path = comment_file_path;
-	std::ifstream comment_file(comment_file_path);
-	if(comment_file) {
-		std::string line;
-		for(std::size_t i = 0; std::getline(comment_file, line) && i < VU1_PROGSIZE / INSN_PAIR_SIZE; i++) {
-			app.comments[i] = line;
+void open_session_browser(AppState &app, const std::string &directory)
+{
+	app.session_pool.reset();
+	app.session = std::make_unique<Session>();
+	if(!open_session(*app.session, directory)) {
+		fprintf(stderr, "Error: Failed to open session %s.\n", directory.c_str());
+	}
+	app.session_pool = std::make_unique<ThreadPool>();
+	scan_session(*app.session, *app.session_pool);
+}
+
+// Scan every trace in a directory on a background thread so the GUI stays
+// responsive. The job is shared so it outlives the app if it's closed early.
+void load_coverage(AppState &app, const std::string &directory)
+{
+	std::vector<std::string> paths = list_trace_files(directory.empty() ? "." : directory);
+	std::shared_ptr<CoverageJob> job = std::make_shared<CoverageJob>();
+	job->trace_count = paths.size();
+	app.coverage = job;
+	std::thread([job, paths]() {
+		ThreadPool pool;
+		aggregate_coverage(*job, paths, pool);
+		for(const std::string &error : job->result.errors) {
+			fprintf(stderr, "Error: %s\n", error.c_str());
 		}
-		app.comments_loaded = true;
+	}).detach();
+}
+
+// Returns the combined coverage of the program in the loaded trace, or
+// nullptr if no coverage has been loaded yet.
+const ProgramCoverage *current_coverage(const AppState &app)
+{
+	if(!app.coverage || !app.coverage->finished) {
+		return nullptr;
 	}
+	auto iter = app.coverage->result.programs.find(app.program_hash);
+	if(iter == app.coverage->result.programs.end()) {
+		return nullptr;
+	}
+	return &iter->second;
 }
 
-void save_comment_file(AppState &app)
+// Profile any number of traces without opening a window. Traces are grouped
+// by microprogram, so the totals for each program are across all the traces
+// that ran it.
+int run_profile(int argc, char **argv)
 {
-	std::ofstream comment_file(app.comment_file_path);
-	for(std::size_t i = 0; i < app.comments.size(); i++) {
-		comment_file << app.comments[i] << "\n";
+	std::string csv_path;
+	std::size_t top = 10;
+	std::vector<std::string> trace_paths;
+	for(int i = 2; i < argc; i++) {
+		if(strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+			csv_path = argv[++i];
+		} else if(strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+			top = strtoul(argv[++i], nullptr, 10);
+		} else {
+			trace_paths.push_back(argv[i]);
+		}
 	}
+	
+	std::vector<ProgramProfile> profiles;
+	std::vector<u32> pcs;
+	TraceReader reader;
+	for(const std::string &path : trace_paths) {
+		pcs.clear();
+		if(reader.open(path)) {
+			while(reader.next_snapshot()) {
+				pcs.push_back(reader.pc());
+			}
+		}
+		if(!reader.error.empty()) {
+			fprintf(stderr, "Error: %s: %s\n", path.c_str(), reader.error.c_str());
+			continue;
+		}
+		const u8 *program = reader.snapshot().program;
+		u64 hash = hash_program(program);
+		auto profile = std::find_if(profiles.begin(), profiles.end(), [&](const ProgramProfile &p) {
+			return p.program_hash == hash;
+		});
+		if(profile == profiles.end()) {
+			profile = profiles.emplace(profiles.end());
+		}
+		accumulate_profile(*profile, pcs.data(), pcs.size(), program);
+	}
+	
+	std::sort(profiles.begin(), profiles.end(), [](const ProgramProfile &l, const ProgramProfile &r) {
+		return l.total_cycles > r.total_cycles;
+	});
+	
+	FILE *csv = nullptr;
+	if(!csv_path.empty()) {
+		csv = fopen(csv_path.c_str(), "w");
+		if(csv == nullptr) {
+			fprintf(stderr, "Failed to open %s for writing.\n", csv_path.c_str());
+			return 1;
+		}
+		fprintf(csv, "program,kind,begin,end,count,cycles,disassembly\n");
+	}
+	for(const ProgramProfile &profile : profiles) {
+		ProfileReport report = build_profile_report(profile);
+		print_profile_report(stdout, profile, report, top);
+		if(csv) {
+			write_profile_csv(csv, profile, report);
+		}
+	}
+	if(csv) {
+		fclose(csv);
+	}
+	return 0;
 }
 
-bool is_xgkick(u32 lower)
+// Combine the framebuffer dumps in a directory into a contact sheet or a
+// video stream without opening a window.
+int run_frames(int argc, char **argv)
 {
-	return bit_range(lower, 0, 10) == 0b11011111100;
+	std::string directory, contact_sheet_path, video_path;
+	int trace_index = INT_MIN;
+	int columns = 8;
+	int scale = 4;
+	int fps = 30;
+	for(int i = 2; i < argc; i++) {
+		if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_index = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--contact-sheet") == 0 && i + 1 < argc) {
+			contact_sheet_path = argv[++i];
+		} else if(strcmp(argv[i], "--columns") == 0 && i + 1 < argc) {
+			columns = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+			scale = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--video") == 0 && i + 1 < argc) {
+			video_path = argv[++i];
+		} else if(strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			fps = atoi(argv[++i]);
+		} else {
+			directory = argv[i];
+		}
+	}
+	
+	std::vector<FramebufferDump> dumps = list_framebuffer_dumps(directory.empty() ? "." : directory);
+	if(trace_index != INT_MIN) {
+		dumps.erase(std::remove_if(dumps.begin(), dumps.end(), [&](const FramebufferDump &dump) {
+			return dump.trace_index != trace_index;
+		}), dumps.end());
+	}
+	if(dumps.empty()) {
+		fprintf(stderr, "Error: No framebuffer dumps found.\n");
+		return 1;
+	}
+	
+	ThreadPool pool;
+	std::vector<std::string> errors;
+	auto print_errors = [&]() {
+		for(const std::string &error : errors) {
+			fprintf(stderr, "Error: %s\n", error.c_str());
+		}
+		errors.clear();
+	};
+	if(!contact_sheet_path.empty()) {
+		GsTexture sheet;
+		bool success = build_contact_sheet(sheet, errors, dumps, columns, scale, pool);
+		print_errors();
+		if(!success || !write_png(contact_sheet_path, sheet)) {
+			fprintf(stderr, "Error: Failed to write %s.\n", contact_sheet_path.c_str());
+			return 1;
+		}
+	}
+	if(!video_path.empty()) {
+		bool is_stdout = video_path == "-";
+		FILE *file = is_stdout ? stdout : fopen(video_path.c_str(), "wb");
+		if(file == nullptr) {
+			fprintf(stderr, "Error: Failed to open %s for writing.\n", video_path.c_str());
+			return 1;
+		}
+#ifdef _WIN32
+		if(is_stdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+		bool success = write_y4m(file, errors, dumps, fps, pool);
+		print_errors();
+		if(!is_stdout) {
+			fclose(file);
+		}
+		if(!success) {
+			fprintf(stderr, "Error: Failed to write video.\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Comments from an old style comment file are assumed to be for the program
+// that's currently loaded.
+void parse_comment_file(AppState &app, std::string comment_file_path) {
+	std::string error;
+	if(!app.comments.load(comment_file_path, error)) {
+		fprintf(stderr, "Error: %s\n", error.c_str());
+		return;
+	}
+	app.comments.assign_legacy(app.program_hash);
 }
 
 void init_gui(GLFWwindow **window)
@@ -998,12 +2044,21 @@ void main_menu_bar() {
 	
 	if (ImGui::BeginMainMenuBar()) {
 		if(ImGui::BeginMenu("File")) {
+			if(ImGui::MenuItem("Open Session")) {
+				open_session_box.is_open = true;
+			}
 			if(ImGui::MenuItem("Load Comments", "Ctrl+L")) {
 				comment_box.is_open = true;
 			}
 			if(ImGui::MenuItem("Export Disassembly", "Ctrl+D")) {
 				export_box.is_open = true;
 			}
+			if(ImGui::MenuItem("Export Folded Stacks")) {
+				export_stacks_box.is_open = true;
+			}
+			if(ImGui::MenuItem("Load Coverage")) {
+				coverage_box.is_open = true;
+			}
 			ImGui::EndMenu();
 		}
 		if(ImGui::BeginMenu("System")) {
@@ -1015,6 +2070,10 @@ void main_menu_bar() {
 			
 			ImGui::SetItemTooltip("Limits the application's refresh rate to decrease impact on CPU. Assuming a 60Hz monitor, the default value (1) is enough.\n0 is unlimited, 60Hz / 2 = 30fps, 60Hz / 3 = 20fps, etc.");
 			
+			ImGui::SliderInt("##snapshotbudget", &snapshot_budget_mb, 16, 16384, "Snapshot Memory %d MB", ImGuiSliderFlags_Logarithmic);
+			
+			ImGui::SetItemTooltip("How much memory the snapshots of the current trace can use before the least recently used ones are moved to a temporary file.");
+			
 			ImGui::EndMenu();
 		}
 		if(ImGui::BeginMenu("Registers")) {
@@ -1033,6 +2092,9 @@ void main_menu_bar() {
 			if(ImGui::MenuItem("Go To", "Ctrl+G")) {
 				go_to_box.is_open = true;
 			}
+			if(ImGui::MenuItem("Annotate Range")) {
+				annotate_box.is_open = true;
+			}
 			if(ImGui::SliderInt("##rowsize", &row_size_imgui, 1, 8, "Line Width: %d")) {
 				row_size = row_size_imgui * 4;
 			}
@@ -1122,10 +2184,17 @@ void create_dock_layout(GLFWwindow *window)
 	ImGui::DockBuilderSplitNode(bottom, ImGuiDir_Left, 0.5f, &memory, &gs_packet);
 	
 	ImGui::DockBuilderDockWindow("Registers", registers);
+	ImGui::DockBuilderDockWindow("Call Stack", registers);
 	ImGui::DockBuilderDockWindow("Snapshots", snapshots);
+	ImGui::DockBuilderDockWindow("Session", snapshots);
 	ImGui::DockBuilderDockWindow("Disassembly", disassembly);
 	ImGui::DockBuilderDockWindow("Memory", memory);
+	ImGui::DockBuilderDockWindow("Log", memory);
+	ImGui::DockBuilderDockWindow("VIF Unpack", memory);
+	ImGui::DockBuilderDockWindow("Value Search", memory);
 	ImGui::DockBuilderDockWindow("GS Packet", gs_packet);
+	ImGui::DockBuilderDockWindow("Profile", gs_packet);
+	ImGui::DockBuilderDockWindow("Framebuffer", gs_packet);
 }
 
 void alert(MessageBoxState &state, const char *title)
@@ -0,0 +1,456 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+	Copyright (C) 2020-2024 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Stand-in for the capture patch that feeds synthetic VU states to the trace
+// writer, so its throughput can be measured without running PCSX2. It can
+// also write the same states synchronously the way the patch used to, to
+// compare the two. Each trace is one invocation of a microprogram, so a
+// capture filter can be applied to them too.
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pcsx2defs.h"
+#include "tracewriter.h"
+
+// Something that looks enough like a running microprogram: a loop that
+// updates a few registers per instruction and stores to memory regularly.
+struct SyntheticVu
+{
+	VURegs regs;
+	u8 memory[VU1_MEMSIZE];
+	u8 program[VU1_PROGSIZE];
+	u64 rng;
+	u32 read_address, read_size, write_address, write_size;
+
+	void reset(u64 seed);
+	void randomise_program(u64 seed);
+	void step(u32 instruction);
+	u32 random();
+};
+
+// Writes traces the way the capture patch does, with stdio calls for each
+// packet on the emulation thread.
+class SynchronousWriter
+{
+public:
+	void begin_trace(const std::string &path);
+	void end_trace();
+	void instruction(const SyntheticVu &vu);
+
+private:
+	FILE *file = nullptr;
+	bool has_output_instructions = false;
+	bool has_last_state = false;
+	VURegs last_regs;
+	u8 last_memory[VU1_MEMSIZE];
+};
+
+struct BenchResult
+{
+	double total_seconds = 0;
+	double emulation_seconds = 0;
+	u64 bytes = 0;
+	u64 stalls = 0;
+	u64 recorded = 0; // Invocations that passed the capture filter.
+};
+
+// How the synthetic invocations look to a capture filter.
+struct InvocationOptions
+{
+	CaptureFilter filter;
+	u32 programs = 0; // Distinct programs cycled through, or 0 for one per trace.
+};
+
+BenchResult run_async(const std::string &directory, int trace_count, u32 instruction_count, u64 seed, std::size_t ring_size, const InvocationOptions &invocations);
+BenchResult run_sync(const std::string &directory, int trace_count, u32 instruction_count, u64 seed, const InvocationOptions &invocations);
+void begin_invocation(SyntheticVu &vu, int trace, u64 seed, const InvocationOptions &invocations, u32 &entry_pc);
+bool compare_files(const std::string &lhs, const std::string &rhs);
+std::string trace_path(const std::string &directory, int index);
+void print_result(const char *name, const BenchResult &result, u64 instructions);
+
+int main(int argc, char **argv)
+{
+	std::string directory = "writerbench_output";
+	int trace_count = 16;
+	u32 instruction_count = 20000;
+	u64 seed = 1;
+	std::size_t ring_size = 64 * 1024 * 1024;
+	bool sync = false;
+	bool compare = false;
+	InvocationOptions invocations;
+	std::string filter_error;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			directory = argv[++i];
+		} else if(strcmp(argv[i], "--traces") == 0 && i + 1 < argc) {
+			trace_count = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--instructions") == 0 && i + 1 < argc) {
+			instruction_count = (u32) strtoul(argv[++i], nullptr, 10);
+		} else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], nullptr, 10);
+		} else if(strcmp(argv[i], "--ring-mb") == 0 && i + 1 < argc) {
+			ring_size = (std::size_t) strtoul(argv[++i], nullptr, 10) * 1024 * 1024;
+		} else if(strcmp(argv[i], "--sync") == 0) {
+			sync = true;
+		} else if(strcmp(argv[i], "--compare") == 0) {
+			compare = true;
+		} else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc && filter_error.empty()) {
+			invocations.filter.parse(argv[++i], filter_error);
+		} else if(strcmp(argv[i], "--programs") == 0 && i + 1 < argc) {
+			invocations.programs = (u32) strtoul(argv[++i], nullptr, 10);
+		} else {
+			fprintf(stderr, "usage: %s [--output <directory>] [--traces <n>] [--instructions <n per trace>] [--seed <n>] [--ring-mb <n>] [--sync] [--compare] [--filter <options>] [--programs <n>]\n", argv[0]);
+			fprintf(stderr, "  --sync      Also write the traces synchronously, like the original capture patch.\n");
+			fprintf(stderr, "  --compare   Check the two sets of traces are identical (implies --sync).\n");
+			fprintf(stderr, "  --filter    Capture filter e.g. \"program=<hash> entry=0x100-0x300 every=4 max=1000\".\n");
+			fprintf(stderr, "              Trace i is an invocation starting at (i %% 8) * 0x100.\n");
+			fprintf(stderr, "  --programs  Cycle through n different programs instead of one per trace.\n");
+			return 1;
+		}
+	}
+	if(!filter_error.empty()) {
+		fprintf(stderr, "Error: %s\n", filter_error.c_str());
+		return 1;
+	}
+	sync |= compare;
+
+	std::error_code error;
+	std::filesystem::create_directories(directory + "/async", error);
+	std::filesystem::create_directories(directory + "/sync", error);
+	// Traces left over from an earlier run would look like ones that
+	// weren't filtered out.
+	for(int i = 0; i < trace_count; i++) {
+		std::filesystem::remove(trace_path(directory + "/async", i), error);
+		std::filesystem::remove(trace_path(directory + "/sync", i), error);
+	}
+	u64 instructions = (u64) trace_count * instruction_count;
+
+	BenchResult async_result = run_async(directory + "/async", trace_count, instruction_count, seed, ring_size, invocations);
+	print_result("async", async_result, instructions);
+	if(sync) {
+		BenchResult sync_result = run_sync(directory + "/sync", trace_count, instruction_count, seed, invocations);
+		print_result("sync", sync_result, instructions);
+	}
+
+	if(compare) {
+		// With a filter only some of the invocations are recorded, but both
+		// writers have to have recorded the same ones.
+		int compared = 0;
+		for(int i = 0; i < trace_count; i++) {
+			bool async_exists = std::filesystem::exists(trace_path(directory + "/async", i), error);
+			bool sync_exists = std::filesystem::exists(trace_path(directory + "/sync", i), error);
+			if(!async_exists && !sync_exists) {
+				continue;
+			}
+			if(async_exists != sync_exists) {
+				fprintf(stderr, "Error: Trace %d was only written by the %s writer.\n", i, async_exists ? "async" : "sync");
+				return 1;
+			}
+			if(!compare_files(trace_path(directory + "/async", i), trace_path(directory + "/sync", i))) {
+				fprintf(stderr, "Error: Trace %d differs between the async and sync writers.\n", i);
+				return 1;
+			}
+			compared++;
+		}
+		if(compared == 0) {
+			fprintf(stderr, "Error: Neither writer wrote any traces.\n");
+			return 1;
+		}
+		printf("%d of %d invocations were recorded, and all %d traces are identical.\n", compared, trace_count, compared);
+	}
+	return 0;
+}
+
+void SyntheticVu::reset(u64 seed)
+{
+	rng = seed * 0x9e3779b97f4a7c15 + 1;
+	regs = {};
+	for(u32 i = 0; i < VU1_MEMSIZE; i += 4) {
+		u32 value = random();
+		memcpy(&memory[i], &value, 4);
+	}
+	for(u32 i = 0; i < VU1_PROGSIZE; i += 4) {
+		u32 value = random();
+		memcpy(&program[i], &value, 4);
+	}
+	read_size = 0;
+	write_size = 0;
+}
+
+void SyntheticVu::randomise_program(u64 seed)
+{
+	u64 state = rng;
+	rng = seed * 0x9e3779b97f4a7c15 + 1;
+	for(u32 i = 0; i < VU1_PROGSIZE; i += 4) {
+		u32 value = random();
+		memcpy(&program[i], &value, 4);
+	}
+	rng = state;
+}
+
+void SyntheticVu::step(u32 instruction)
+{
+	// A 64 instruction loop.
+	regs.VI[TPC].UL = (instruction % 64) * 8;
+	regs.VI[1].UL = instruction / 64;
+	u32 dest = 1 + random() % 8;
+	for(int i = 0; i < 4; i++) {
+		regs.VF[dest].UL[i] = random();
+	}
+	if(instruction % 4 == 0) {
+		regs.ACC.UL[instruction % 3] = random();
+	}
+	read_size = 0;
+	write_size = 0;
+	if(instruction % 3 == 0) {
+		read_address = (random() % (VU1_MEMSIZE / 16)) * 16;
+		read_size = 16;
+	}
+	if(instruction % 4 == 1) {
+		write_address = (random() % (VU1_MEMSIZE / 16)) * 16;
+		write_size = 16;
+		memcpy(&memory[write_address], &regs.VF[dest], 16);
+	}
+}
+
+// xorshift64*
+u32 SyntheticVu::random()
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (u32) ((rng * 0x2545f4914f6cdd1d) >> 32);
+}
+
+void SynchronousWriter::begin_trace(const std::string &path)
+{
+	end_trace();
+	file = fopen(path.c_str(), "wb");
+	if(file == nullptr) {
+		fprintf(stderr, "Error: Failed to open %s for writing.\n", path.c_str());
+		exit(1);
+	}
+	u32 version = 3;
+	fwrite("VUTR", 4, 1, file);
+	fwrite(&version, 4, 1, file);
+	has_output_instructions = false;
+	has_last_state = false;
+}
+
+void SynchronousWriter::end_trace()
+{
+	if(file) {
+		if(ftell(file) > 8) {
+			fputc('P', file);
+		}
+		fclose(file);
+		file = nullptr;
+	}
+}
+
+void SynchronousWriter::instruction(const SyntheticVu &vu)
+{
+	if(ftell(file) > 8) {
+		fputc('P', file);
+	}
+	if(!has_output_instructions) {
+		fputc('I', file);
+		fwrite(vu.program, VU1_PROGSIZE, 1, file);
+		has_output_instructions = true;
+	}
+	const u8 *registers[67];
+	const u8 *last_registers[67];
+	for(int i = 0; i < 32; i++) {
+		registers[i] = (const u8*) &vu.regs.VF[i];
+		registers[32 + i] = (const u8*) &vu.regs.VI[i];
+		last_registers[i] = (const u8*) &last_regs.VF[i];
+		last_registers[32 + i] = (const u8*) &last_regs.VI[i];
+	}
+	registers[64] = (const u8*) &vu.regs.ACC;
+	registers[65] = (const u8*) &vu.regs.q;
+	registers[66] = (const u8*) &vu.regs.p;
+	last_registers[64] = (const u8*) &last_regs.ACC;
+	last_registers[65] = (const u8*) &last_regs.q;
+	last_registers[66] = (const u8*) &last_regs.p;
+	if(!has_last_state) {
+		fputc('R', file);
+		for(int i = 0; i < 67; i++) {
+			fwrite(registers[i], 16, 1, file);
+		}
+		fputc('M', file);
+		fwrite(vu.memory, VU1_MEMSIZE, 1, file);
+		last_regs = vu.regs;
+		memcpy(last_memory, vu.memory, VU1_MEMSIZE);
+		has_last_state = true;
+	} else {
+		for(u8 i = 0; i < 67; i++) {
+			if(memcmp(last_registers[i], registers[i], 16) != 0) {
+				fputc('r', file);
+				fwrite(&i, 1, 1, file);
+				fwrite(registers[i], 16, 1, file);
+			}
+		}
+		last_regs = vu.regs;
+		for(u32 i = 0; i < VU1_MEMSIZE; i += 4) {
+			if(memcmp(&last_memory[i], &vu.memory[i], 4) != 0) {
+				fputc('m', file);
+				fwrite(&i, 2, 1, file);
+				fwrite(&vu.memory[i], 4, 1, file);
+				memcpy(&last_memory[i], &vu.memory[i], 4);
+			}
+		}
+	}
+	if(vu.read_size > 0) {
+		fputc('L', file);
+		fwrite(&vu.read_address, 4, 1, file);
+		fwrite(&vu.read_size, 4, 1, file);
+	}
+	if(vu.write_size > 0) {
+		fputc('S', file);
+		fwrite(&vu.write_address, 4, 1, file);
+		fwrite(&vu.write_size, 4, 1, file);
+	}
+}
+
+BenchResult run_async(const std::string &directory, int trace_count, u32 instruction_count, u64 seed, std::size_t ring_size, const InvocationOptions &invocations)
+{
+	BenchResult result;
+	SyntheticVu *vu = new SyntheticVu;
+	auto start = std::chrono::steady_clock::now();
+	{
+		TraceWriter writer(ring_size);
+		writer.filter = invocations.filter;
+		for(int trace = 0; trace < trace_count; trace++) {
+			u32 entry_pc;
+			begin_invocation(*vu, trace, seed, invocations, entry_pc);
+			writer.begin_invocation(trace_path(directory, trace), vu->program, entry_pc);
+			for(u32 i = 0; i < instruction_count; i++) {
+				vu->step(i);
+				if(vu->read_size > 0) writer.memory_read(vu->read_address, vu->read_size);
+				if(vu->write_size > 0) writer.memory_write(vu->write_address, vu->write_size);
+				writer.instruction(vu->regs, vu->memory, vu->program);
+			}
+		}
+		writer.end_trace();
+		result.emulation_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.bytes = writer.bytes_encoded();
+		result.stalls = writer.stall_count();
+		result.recorded = writer.filter.accepted();
+		writer.flush();
+		if(!writer.error().empty()) {
+			fprintf(stderr, "Error: %s\n", writer.error().c_str());
+			exit(1);
+		}
+	}
+	result.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	delete vu;
+	return result;
+}
+
+BenchResult run_sync(const std::string &directory, int trace_count, u32 instruction_count, u64 seed, const InvocationOptions &invocations)
+{
+	BenchResult result;
+	SyntheticVu *vu = new SyntheticVu;
+	SynchronousWriter *writer = new SynchronousWriter;
+	CaptureFilter filter = invocations.filter;
+	auto start = std::chrono::steady_clock::now();
+	for(int trace = 0; trace < trace_count; trace++) {
+		u32 entry_pc;
+		begin_invocation(*vu, trace, seed, invocations, entry_pc);
+		bool recording = filter.accept(vu->program, entry_pc);
+		if(recording) {
+			writer->begin_trace(trace_path(directory, trace));
+		} else {
+			writer->end_trace();
+		}
+		for(u32 i = 0; i < instruction_count; i++) {
+			vu->step(i);
+			if(recording && (filter.max_instructions == 0 || i < filter.max_instructions)) {
+				writer->instruction(*vu);
+			}
+		}
+	}
+	writer->end_trace();
+	result.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.emulation_seconds = result.total_seconds;
+	for(int trace = 0; trace < trace_count; trace++) {
+		std::error_code error;
+		u64 size = std::filesystem::file_size(trace_path(directory, trace), error);
+		result.bytes += error ? 0 : size;
+	}
+	result.recorded = filter.accepted();
+	delete writer;
+	delete vu;
+	return result;
+}
+
+// Set up the VU for the given trace, which stands in for one invocation of a
+// microprogram.
+void begin_invocation(SyntheticVu &vu, int trace, u64 seed, const InvocationOptions &invocations, u32 &entry_pc)
+{
+	vu.reset(seed + trace);
+	if(invocations.programs > 0) {
+		vu.randomise_program(seed + trace % invocations.programs);
+	}
+	entry_pc = (trace % 8) * 0x100;
+}
+
+bool compare_files(const std::string &lhs, const std::string &rhs)
+{
+	FILE *l = fopen(lhs.c_str(), "rb");
+	FILE *r = fopen(rhs.c_str(), "rb");
+	bool equal = l && r;
+	std::vector<u8> l_buffer(1024 * 1024), r_buffer(1024 * 1024);
+	while(equal) {
+		std::size_t l_size = fread(l_buffer.data(), 1, l_buffer.size(), l);
+		std::size_t r_size = fread(r_buffer.data(), 1, r_buffer.size(), r);
+		equal = l_size == r_size && memcmp(l_buffer.data(), r_buffer.data(), l_size) == 0;
+		if(l_size == 0) {
+			break;
+		}
+	}
+	if(l) fclose(l);
+	if(r) fclose(r);
+	return equal;
+}
+
+std::string trace_path(const std::string &directory, int index)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/trace%06d.bin", index);
+	return directory + name;
+}
+
+void print_result(const char *name, const BenchResult &result, u64 instructions)
+{
+	double megabytes = result.bytes / (1024.0 * 1024.0);
+	printf("%-5s: %llu instructions, %.1f MB in %.3fs (%.0f instructions/s, %.1f MB/s)",
+		name, (unsigned long long) instructions, megabytes, result.total_seconds,
+		instructions / result.total_seconds, megabytes / result.total_seconds);
+	if(result.emulation_seconds != result.total_seconds) {
+		printf(", emulation thread busy for %.3fs, %llu stalls",
+			result.emulation_seconds, (unsigned long long) result.stalls);
+	}
+	printf(", %llu traces recorded\n", (unsigned long long) result.recorded);
+}